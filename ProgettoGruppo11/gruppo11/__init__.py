@@ -5,6 +5,7 @@ Quantized Pivot Indexing Package
 from . import quantpivot32
 from . import quantpivot64
 from . import quantpivot64omp
+from . import ds3
 
 __version__ = '1.0'
-__all__ = ['quantpivot32','quantpivot64','quantpivot64omp']
+__all__ = ['quantpivot32','quantpivot64','quantpivot64omp','ds3']
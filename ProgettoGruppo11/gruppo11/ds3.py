@@ -0,0 +1,121 @@
+"""
+Formato .ds3: header a 64 bit con dtype e payload allineato a pagina
+
+Layout (little endian):
+  [4 byte]  magic "QPDS"
+  [4 byte]  versione (1)
+  [4 byte]  dtype (1=f16, 2=f32, 3=f64, 4=i8, 5=i32, 6=bf16)
+  [4 byte]  dimensione elemento in byte
+  [8 byte]  numero righe
+  [8 byte]  numero colonne
+  [8 byte]  offset del payload (multiplo di 4096)
+  [24 byte] riservati (zero)
+  padding fino all'offset, poi righe x colonne elementi row-major
+
+bf16 (i 16 bit alti di un float32) non ha un dtype numpy: load_ds3() lo
+legge come uint16 e lo allarga a float32 (copia, non mappatura).
+"""
+
+import struct
+import numpy as np
+
+MAGIC = b'QPDS'
+VERSION = 1
+DATA_ALIGN = 4096
+
+_HEADER = struct.Struct('<4sIIIQQQ24x')
+
+_DTYPES = {
+    1: np.dtype('<f2'),
+    2: np.dtype('<f4'),
+    3: np.dtype('<f8'),
+    4: np.dtype('i1'),
+    5: np.dtype('<i4'),
+    6: np.dtype('<u2'),     # bf16, memorizzato come uint16
+}
+_BF16 = 6
+_CODES = {dt: code for code, dt in _DTYPES.items() if code != _BF16}
+
+
+def read_header(filename):
+    """Restituisce (dtype, righe, colonne, offset) di un file .ds3 (uint16 per bf16)"""
+    code, rows, cols, offset = _read_header(filename)
+    return _DTYPES[code], rows, cols, offset
+
+
+def _read_header(filename):
+    with open(filename, 'rb') as f:
+        raw = f.read(_HEADER.size)
+    if len(raw) < _HEADER.size:
+        raise ValueError(f"{filename}: file troppo corto per un header .ds3")
+    magic, version, code, elem_size, rows, cols, offset = _HEADER.unpack(raw)
+    if magic != MAGIC:
+        raise ValueError(f"{filename}: non è un file .ds3")
+    if version != VERSION or code not in _DTYPES or _DTYPES[code].itemsize != elem_size:
+        raise ValueError(f"{filename}: versione {version} / dtype {code} non supportati")
+    if offset % DATA_ALIGN != 0:
+        raise ValueError(f"{filename}: payload non allineato")
+    return code, rows, cols, offset
+
+
+def load_ds3(filename, dtype=None):
+    """
+    Mappa un file .ds3 senza copia (np.memmap in sola lettura).
+
+    Il payload è allineato a pagina, quindi l'array soddisfa l'allineamento
+    richiesto dai moduli QuantPivot. Se dtype è indicato e diverso da quello
+    del file, restituisce una copia convertita (allineata a 64 byte).
+    Un file bf16 è sempre una copia float32 (o nel dtype indicato).
+    """
+    code, rows, cols, offset = _read_header(filename)
+    file_dtype = _DTYPES[code]
+    data = np.memmap(filename, dtype=file_dtype, mode='r', offset=offset, shape=(rows, cols))
+    if code == _BF16:
+        wide = _aligned_copy(data, np.dtype('<u4'))
+        wide <<= 16
+        data = wide.view(np.float32)
+        if dtype is None or np.dtype(dtype) == data.dtype:
+            return data
+        return _aligned_copy(data, np.dtype(dtype))
+    if dtype is None or np.dtype(dtype) == file_dtype:
+        return data
+    return _aligned_copy(data, np.dtype(dtype))
+
+
+def save_ds3(data, filename):
+    """Salva un array 2D in formato .ds3 (dtype f16, f32, f64, i8 o i32)"""
+    data = np.ascontiguousarray(data)
+    dt = data.dtype.newbyteorder('<') if data.dtype.byteorder == '>' else data.dtype
+    if data.ndim != 2 or dt not in _CODES:
+        raise ValueError("serve un array 2D di tipo float16/32/64, int8 o int32")
+    rows, cols = data.shape
+    header = _HEADER.pack(MAGIC, VERSION, _CODES[dt], dt.itemsize, rows, cols, DATA_ALIGN)
+    with open(filename, 'wb') as f:
+        f.write(header.ljust(DATA_ALIGN, b'\0'))
+        data.astype(dt, copy=False).tofile(f)
+
+
+def convert_ds2(src, dst, src_dtype='float64', dst_dtype=None):
+    """
+    Converte un .ds2 legacy (header di due int32) in .ds3.
+
+    src_dtype è il tipo degli elementi nel .ds2 (non registrato nel file),
+    dst_dtype quello del .ds3 prodotto (default: uguale a src_dtype).
+    """
+    with open(src, 'rb') as f:
+        n, d = struct.unpack('ii', f.read(8))
+        data = np.fromfile(f, dtype=src_dtype, count=n * d)
+    if data.size != n * d:
+        raise ValueError(f"{src}: file troncato")
+    data = data.reshape(n, d)
+    if dst_dtype is not None:
+        data = data.astype(dst_dtype)
+    save_ds3(data, dst)
+
+
+def _aligned_copy(data, dtype, alignment=64):
+    buf = np.empty(data.size * dtype.itemsize + alignment, dtype=np.uint8)
+    off = (-buf.ctypes.data) % alignment
+    out = buf[off:off + data.size * dtype.itemsize].view(dtype).reshape(data.shape)
+    out[...] = data
+    return out
@@ -55,8 +55,10 @@ module64omp = Extension(
     f"{gruppo}.quantpivot64omp._quantpivot64omp",  # Nome completo del modulo
     sources=['src/64omp/quantpivot64omp_py.c'],
     include_dirs=[np.get_include()],
+    # QP_ID64=1 per ID a 64 bit (dataset con più di 2^31 righe)
+    define_macros=[('ID64', None)] if os.environ.get('QP_ID64') else [],
     extra_compile_args=['-m64', '-O3', '-march=native', '-mavx', '-Wall', '-fPIC', '-fopenmp'],
-    extra_link_args=['-z', 'noexecstack', '-lm', '-fopenmp']
+    extra_link_args=['-z', 'noexecstack', '-lm', '-lrt', '-fopenmp']
 )
 
 setup(
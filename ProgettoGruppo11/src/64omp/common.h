@@ -2,6 +2,15 @@
 #define QUANTPIVOT_COMMON
 
 #include <stdint.h>
+#include <stddef.h>
+
+// header di sistema che usano 'type' come identificatore: vanno inclusi
+// prima della macro sottostante
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #define	type double
 #define	align 32
@@ -9,27 +18,164 @@
 #define	MATRIX		type*
 #define	VECTOR		type*
 
+// ID dei punti (pivot, vicini): 32 bit di default, 64 bit con -DID64.
+// Dimensioni e offset sono sempre a 64 bit (N*D può superare 2^31).
+#ifdef ID64
+#define	ID			int64_t
+#define	ID_MAX		INT64_MAX
+#else
+#define	ID			int32_t
+#define	ID_MAX		INT32_MAX
+#endif
+
+// Strategia di scansione di predict() (quantpivot64omp_plan.c)
+#define	PLAN_AUTO	0			// scelta per lotto dal planner
+#define	PLAN_PRUNE	1			// pruning con i bound sui pivot
+#define	PLAN_BRUTE	2			// forza bruta sui codici quantizzati
+
+// Motore di predict()
+#define	MODE_PIVOT	0			// indice quantizzato con pruning sui pivot
+#define	MODE_EXACT	1			// forza bruta esatta GEMM (quantpivot64omp_exact.c)
+#define	MODE_PQ		2			// quantizzazione a prodotto (quantpivot64omp_pq.c)
+#define	MODE_IVF	3			// indice a pivot diviso in liste invertite (quantpivot64omp_ivf.c)
+#define	MODE_HNSW	4			// grafo di prossimità gerarchico (quantpivot64omp_hnsw.c)
+#define	MODE_VPT	5			// albero di punti di vantaggio (quantpivot64omp_vpt.c)
+#define	MODE_MIH	6			// indice a pivot con tabelle hash sui codici (quantpivot64omp_mih.c)
+
+// Livello intermedio int8 (quantpivot64omp_sq.c)
+#define	SQ_OFF		0			// candidati della scansione direttamente al raffinamento
+#define	SQ_RERANK	1			// filtro con le distanze int8, poi raffinamento esatto
+#define	SQ_ONLY		2			// distanze int8 al posto del raffinamento esatto
+
+// Filtro in dimensione ridotta (quantpivot64omp_proj.c)
+#define	PROJ_OFF	0			// nessun filtro
+#define	PROJ_PCA	1			// prime proj_dim componenti principali
+#define	PROJ_SRHT	2			// segni casuali, Walsh-Hadamard e proj_dim coordinate casuali
+
+// Livelli fini della cascata di quantizzazione (quantpivot64omp_cascade.c)
+#define	CASCADE_MAX	4
+
+// Statistiche dell'ultima predict()
+typedef struct{
+	int64_t batches_pruned;		// lotti eseguiti con il pruning
+	int64_t batches_brute;		// lotti eseguiti a forza bruta
+	double est_prune_rate;		// frazione di righe scartate stimata dal planner (media)
+	double cost_ratio;			// costo bound / costo approx_distance per riga (ultimo lotto)
+	int64_t rows_scanned;		// righe esaminate dalla scansione
+	int64_t rows_pruned;		// righe scartate dal bound
+} qp_stats;
+
+// Nodo del VP-tree (quantpivot64omp_vpt.c), in ordine di visita in ampiezza
+typedef struct{
+	ID vp;						// pivot del nodo, -1 nelle foglie
+	int32_t depth;				// profondità (0 = radice)
+	int64_t parent;				// nodo padre, -1 per la radice
+	int64_t first;				// nodo interno: primo figlio (l'altro è first + 1); foglia: inizio in vpt_ids
+	int64_t n;					// foglia: righe in vpt_ids
+	type lo[2], hi[2];			// nodo interno: distanze minima e massima dal pivot nei due figli
+} vpt_node;
+
 typedef struct{
 	// Variabili
 	MATRIX DS; 					// dataset
-	int* P;						// vettore contenente gli indici dei pivot
+	ID* P;						// vettore contenente gli indici dei pivot
 	MATRIX index;				// indice
 	MATRIX Q;					// query
-	int* id_nn;					// per ogni query point gli ID dei K-NN
+	ID* id_nn;					// per ogni query point gli ID dei K-NN
 	MATRIX dist_nn;				// per ogni query point le distanze dai K-NN
 
 	
 	uint8_t* DS_quantized_plus; 
 	uint8_t* DS_quantized_minus; 
+	uint8_t* P_quantized_plus;	// codici dei pivot [h x D], salvati da fit()
+	uint8_t* P_quantized_minus;
 
 
 	int h;						// numero di pivot
 	int k;						// numero di vicini
 	int x;						// parametro x per la quantizzazione
-	int N;						// numero di righe del dataset
-	int D;						// numero di colonne/feature del dataset
-	int nq;						// numero delle query
+	int r;						// candidati raffinati per query (rerank), <= k significa k
+	int plan;					// PLAN_AUTO, PLAN_PRUNE o PLAN_BRUTE
+	int mode;					// MODE_PIVOT, MODE_EXACT, MODE_PQ, MODE_IVF, MODE_HNSW, MODE_VPT o MODE_MIH
+	type* norms;				// ||x_i||^2 delle righe di DS, calcolate alla prima predict esatta
+	int var_order;				// early abandon: dimensioni a blocchi per varianza decrescente
+	int32_t* dim_order;			// ordine dei blocchi, calcolato alla prima predict (NULL = naturale)
+	void* DS_half;				// dataset a 16 bit per il raffinamento (NULL = usa DS)
+	uint32_t half_dtype;		// DS3_F16 o DS3_BF16
+	int half_owned;				// DS_half allocato da compact_dataset(), altrimenti nel file mappato
+	int sq_mode;				// SQ_OFF, SQ_RERANK o SQ_ONLY
+	int sq_keep;				// candidati dopo il filtro SQ_RERANK, <= 0 significa 2k
+	double sq_clip;				// frazione saturata per coda negli intervalli (0 = min/max)
+	uint8_t* DS_sq;				// codici int8 [N x D], costruiti da fit() se sq_mode != SQ_OFF
+	type* sq_min;				// inizio dell'intervallo per dimensione [D]
+	type* sq_scale;				// passo per dimensione [D]
+	type* sq_norms;				// ||x~_i||^2 delle righe ricostruite [N]
+	int proj_mode;				// PROJ_OFF, PROJ_PCA o PROJ_SRHT
+	int proj_dim;				// dimensione ridotta d', <= 0 significa min(D, 64)
+	int proj_keep;				// candidati dopo il filtro, <= 0 significa 4k
+	type* proj_mean;			// media del campione (PROJ_PCA) [D]
+	type* proj_basis;			// componenti principali (PROJ_PCA) [d' x D]
+	int8_t* proj_sign;			// segni casuali (PROJ_SRHT) [D]
+	int32_t* proj_coord;		// coordinate della trasformata tenute (PROJ_SRHT) [d']
+	type* DS_proj;				// vettori ridotti [N x d'], costruiti da fit() se proj_mode != PROJ_OFF
+	int levels;					// livelli fini della cascata dopo la scansione (0 = nessuno)
+	int level_x[CASCADE_MAX];	// x di ogni livello
+	int level_keep[CASCADE_MAX];// candidati che sopravvivono al livello, <= 0 significa 1/4 del precedente
+	uint8_t* level_vp[CASCADE_MAX];	// codici dei livelli [N x D], costruiti da fit()
+	uint8_t* level_vm[CASCADE_MAX];
+	int pq_m;					// sottospazi PQ (divide D)
+	int pq_bits;				// bit per codice PQ: 8 o 4 (fast-scan)
+	int pq_iters;				// iterazioni di k-means, <= 0 significa 20
+	int pq_refine;				// raffinamento esatto dei candidati PQ (0 = solo ADC)
+	type* pq_centroids;			// centroidi [pq_m x D/pq_m x 2^pq_bits], costruiti da fit()
+	uint8_t* pq_codes;			// codici PQ: [N x pq_m] (8 bit) o a blocchi di 32 punti (4 bit)
+	int ivf_nlist;				// liste invertite costruite da fit() con MODE_IVF
+	int ivf_nprobe;				// liste visitate per query, <= 0 significa 1/16 delle liste
+	int ivf_iters;				// iterazioni di k-means, <= 0 significa 10
+	type* ivf_centroids;		// centroidi delle liste [ivf_nlist x D]
+	type* ivf_norms;			// ||c||^2 dei centroidi [ivf_nlist]
+	int64_t* ivf_offsets;		// inizio di ogni lista nell'indice [ivf_nlist + 1]
+	ID* ivf_ids;				// ID della riga in ogni posizione dell'indice [N] (NULL = identità)
+	int hnsw_m;					// vicini per nodo (2M al livello 0), <= 1 significa 16
+	int hnsw_ef_construction;	// candidati esplorati per inserimento, <= 0 significa 200
+	int hnsw_ef_search;			// candidati esplorati per query, <= 0 significa 64 (almeno pool_size())
+	int hnsw_max_level;			// livello del punto d'ingresso
+	ID hnsw_entry;				// punto d'ingresso del grafo
+	uint8_t* hnsw_level;		// livello di ogni nodo [N]
+	int64_t* hnsw_link_off;		// inizio delle liste dei livelli >= 1 in hnsw_links [N]
+	ID* hnsw_links0;			// liste del livello 0 [N x (2M + 1)], costruite da fit()
+	ID* hnsw_links;				// liste dei livelli >= 1, (M + 1) per livello
+	int vpt_leaf;				// righe per foglia del VP-tree, <= 0 significa 32
+	int64_t vpt_nnodes;			// nodi del VP-tree
+	vpt_node* vpt_nodes;		// nodi [vpt_nnodes], costruiti da fit()
+	ID* vpt_ids;				// ID delle righe in ordine di foglia [N]
+	MATRIX vpt_table;			// distanze dagli h antenati più vicini, in ordine di foglia [N x h]
+	int mih_m;					// sottostringhe dei codici con tabella hash (MODE_MIH)
+	int mih_radius;				// raggio di Hamming massimo per query, < 0 significa 1
+	int64_t* mih_table;			// inizio delle chiavi di ogni tabella in mih_keys [mih_m + 1]
+	uint64_t* mih_keys;			// chiavi distinte, ordinate tabella per tabella
+	int64_t* mih_bucket;		// inizio del bucket di ogni chiave in mih_ids [chiavi + 1]
+	ID* mih_ids;				// righe dei bucket, concatenati
+	qp_stats stats;				// statistiche dell'ultima predict()
+	int64_t N;					// numero di righe del dataset
+	int64_t D;					// numero di colonne/feature del dataset
+	int64_t nq;					// numero delle query
 	int silent;					// modalità silenziosa
+	int pivot_strategy;			// PIVOTS_* (quantpivot64omp_pivots.c)
+	uint64_t seed;				// seme per le strategie casuali
+
+	// indice condiviso (export_index / attach_index)
+	void* shm_base;				// base della mappatura, NULL se l'indice è privato
+	size_t shm_size;			// dimensione della mappatura in byte
+
+	// dataset mappato da fit_file() (fit out-of-core)
+	void* ds_base;				// base della mappatura, NULL se DS appartiene al chiamante
+	size_t ds_size;				// dimensione della mappatura in byte
+
+	// dataset su disco (open_disk_dataset): il raffinamento legge le righe con pread
+	int ds_fd;					// file descriptor, -1 se il dataset è in memoria
+	int64_t ds_offset;			// offset del payload nel file
+	uint32_t ds_dtype;			// tipo degli elementi nel file (DS3_*)
 } params;
 
 #endif
\ No newline at end of file
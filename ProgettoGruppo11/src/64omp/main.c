@@ -4,6 +4,7 @@
 #include <xmmintrin.h>
 #include <omp.h>
 #include <math.h>  
+#include <string.h>
 
 #include "common.h"
 #include "quantpivot64omp.c"
@@ -16,79 +17,113 @@
  *  - primi 4 byte: numero righe (N) → int
  *  - successivi 4 byte: numero colonne (M) → int
  *  - successivi N*M*sizeof(type) byte: dati matrice
+ *
+ *  Il payload viene letto con pread paralleli a blocchi direttamente nel
+ *  buffer allineato (parallel_pread)
  */
-MATRIX load_data(char* filename, int *n, int *k) {
-    FILE* fp;
-    int rows, cols, status;
-    
-    fp = fopen(filename, "rb");
-    
-    if (fp == NULL){
+MATRIX load_data(char* filename, int64_t *n, int64_t *k) {
+    int dims[2];
+    struct stat st;
+
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0){
         printf("'%s': bad data file name!\n", filename);
-        exit(0);
+        exit(1);
     }
-    
-    status = fread(&rows, sizeof(int), 1, fp);
-    status = fread(&cols, sizeof(int), 1, fp);
-    
+
+    if (fstat(fd, &st) != 0 || read_exact(fd, dims, sizeof(dims), 0) != 0 ||
+        dims[0] < 0 || dims[1] < 0) {
+        fprintf(stderr, "Errore: header .ds2 non valido in '%s'\n", filename);
+        exit(1);
+    }
+    int rows = dims[0], cols = dims[1];
+    size_t bytes = (size_t)rows * cols * sizeof(type);
+
     printf("[DEBUG] File: %s, rows=%d, cols=%d, sizeof(type)=%zu\n",
            filename, rows, cols, sizeof(type));
-    
+
+    if ((size_t)st.st_size < sizeof(dims) + bytes) {
+        fprintf(stderr, "Errore: '%s' troncato (%zu byte attesi, %zu presenti)\n",
+                filename, sizeof(dims) + bytes, (size_t)st.st_size);
+        exit(1);
+    }
+
     // Alloca e legge come type (double)
-    MATRIX data = _mm_malloc(rows * cols * sizeof(type), align);
-    status = fread(data, sizeof(type), rows * cols, fp);
-    fclose(fp);
-    
+    MATRIX data = _mm_malloc(bytes, align);
+    if (!data) {
+        fprintf(stderr, "Errore allocazione in load_data\n");
+        exit(1);
+    }
+    if (parallel_pread(fd, data, bytes, sizeof(dims), filename, 0) != 0)
+        exit(1);
+    close(fd);
+
     *n = rows;
     *k = cols;
-    
+
     return data;
 }
 
+/*
+ *  Carica un .ds2 legacy o un .ds3 in base all'estensione
+ *  (per i .ds3 con dtype double la matrice è mappata senza copia)
+ */
+MATRIX load_matrix(char* filename, int64_t *n, int64_t *k, ds3_mapping* map) {
+    size_t len = strlen(filename);
+    if (len >= 4 && strcmp(filename + len - 4, ".ds3") == 0)
+        return load_ds3(filename, n, k, map);
+    map->base = NULL;
+    map->size = 0;
+    return load_data(filename, n, k);
+}
+
 /*
  *  Salva array lineare come matrice N x M
+ *  (header + un'unica scrittura parallela del payload)
  */
-void save_data(char* filename, void* X, int n, int k) {
-    FILE* fp;
-    int i;
-    fp = fopen(filename, "wb");
-    if(X != NULL){
-        fwrite(&n, 4, 1, fp);
-        fwrite(&k, 4, 1, fp);
-        for (i = 0; i < n; i++) {
-            fwrite(X, sizeof(type), k, fp);
-            X += sizeof(type)*k;
-        }
+void save_raw(char* filename, const void* X, int64_t n, int64_t k, size_t elem_size) {
+    int dims[2] = {0, 0};
+    if (n > INT32_MAX || k > INT32_MAX) {
+        fprintf(stderr, "Errore: %ld x %ld non rappresentabile nell'header .ds2\n", n, k);
+        exit(1);
     }
-    else{
-        int x = 0;
-        fwrite(&x, 4, 1, fp);
-        fwrite(&x, 4, 1, fp);
+    if (X != NULL) {
+        dims[0] = n;
+        dims[1] = k;
     }
-    fclose(fp);
+
+    int fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Errore: impossibile creare '%s'\n", filename);
+        exit(1);
+    }
+    if (write_exact(fd, dims, sizeof(dims), 0) != 0 ||
+        (X != NULL && parallel_pwrite(fd, X, (size_t)n * k * elem_size, sizeof(dims), filename, 1) != 0) ||
+        close(fd) != 0) {
+        fprintf(stderr, "Errore di scrittura su '%s'\n", filename);
+        exit(1);
+    }
+}
+
+void save_data(char* filename, void* X, int64_t n, int64_t k) {
+    save_raw(filename, X, n, k, sizeof(type));
 }
 
 /*
- * Versione per array di interi (4 byte)
+ * Versione per gli ID (4 byte, 8 byte se compilato con -DID64)
  */
-void save_int_data(char* filename, int* X, int n, int k) {
-    FILE* fp;
-    int i;
-    fp = fopen(filename, "wb");
-    if(X != NULL){
-        fwrite(&n, 4, 1, fp);
-        fwrite(&k, 4, 1, fp);
-        for (i = 0; i < n; i++) {
-            fwrite(X, sizeof(int), k, fp);
-            X += k; 
-        }
-    }
-    else{
-        int x = 0;
-        fwrite(&x, 4, 1, fp);
-        fwrite(&x, 4, 1, fp);
+void save_int_data(char* filename, ID* X, int64_t n, int64_t k) {
+    save_raw(filename, X, n, k, sizeof(ID));
+}
+
+// Valore dell'opzione argv[*i] nell'argomento successivo (avanza *i)
+static const char* option_value(int argc, char** argv, int* i) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Errore: %s richiede un valore\n", argv[*i]);
+        exit(1);
     }
-    fclose(fp);
+    return argv[++*i];
 }
 
 int main(int argc, char** argv) {
@@ -100,7 +135,188 @@ int main(int argc, char** argv) {
     int k = 8;
     int x = 2;
     int silent = 0;
-    
+
+    /*
+     *  Argomenti opzionali, in qualsiasi ordine:
+     *  ./main64omp [opzioni] [dataset query]             file .ds2 o .ds3
+     *  ./main64omp --convert in.ds2 out.ds3 [f16|bf16|f32|f64|i8]
+     *  --stream              fit out-of-core a blocchi
+     *  --disk                come --stream, ma il raffinamento legge i vettori dal
+     *                        file a lotti
+     *  --pivots uniform|random|fft|incremental
+     *  --autotune <recall>   sceglie h, x e r per il recall@k dato
+     *  --exact               K-NN esatti a forza bruta (GEMM), senza usare l'indice
+     *  --half f16|bf16       dopo fit() il raffinamento usa il dataset a 16 bit
+     *  --sq rerank|only      livello int8: filtro prima del raffinamento o al suo posto
+     *  --proj pca|srht[:d[:keep]]
+     *                        filtro sulle distanze in d dimensioni (default 64),
+     *                        keep candidati al raffinamento (default 4k)
+     *  --cascade x:keep,...  livelli fini dopo la scansione, es. 8:200,32:50
+     *  --pq m[:bits[:r]]     indice PQ con m sottospazi (bits 8 o 4, default 8) al posto
+     *                        dei pivot, r candidati raffinati (default 10k)
+     *  --ivf nlist[:nprobe]  indice a pivot diviso in nlist liste invertite, nprobe liste
+     *                        visitate per query (default nlist/16)
+     *  --hnsw M[:efc[:efs]]  grafo HNSW al posto dei pivot (default 16:200:64)
+     *  --vpt leaf            VP-tree con foglie di al più leaf righe al posto della tabella,
+     *                        h distanze dagli antenati per riga
+     *  --mih m[:r]           tabelle hash su m sottostringhe dei codici, candidati entro
+     *                        distanza di Hamming r (default 1) al posto della scansione
+     *  Tra --exact, --pq, --ivf, --hnsw, --vpt e --mih vale l'ultimo.
+     */
+    if (argc >= 4 && strcmp(argv[1], "--convert") == 0) {
+        uint32_t dtype = DS3_F64;
+        if (argc >= 5) {
+            if (strcmp(argv[4], "f16") == 0) dtype = DS3_F16;
+            else if (strcmp(argv[4], "bf16") == 0) dtype = DS3_BF16;
+            else if (strcmp(argv[4], "f32") == 0) dtype = DS3_F32;
+            else if (strcmp(argv[4], "i8") == 0) dtype = DS3_I8;
+        }
+        return convert_ds2(argv[2], DS3_F64, argv[3], dtype) == 0 ? 0 : 1;
+    }
+    int pivot_strategy = PIVOTS_UNIFORM;
+    double tune_recall = 0.0;
+    uint32_t half = 0;
+    int sq_mode = SQ_OFF;
+    int proj_mode = PROJ_OFF, proj_dim = 0, proj_keep = 0;
+    int levels = 0, level_x[CASCADE_MAX], level_keep[CASCADE_MAX];
+    int mode = MODE_PIVOT;
+    int pq_m = 0, pq_bits = 8, pq_r = 0;
+    int ivf_nlist = 0, ivf_nprobe = 0;
+    int hnsw_m = 0, hnsw_efc = 0, hnsw_efs = 0;
+    int vpt_leaf = 0;
+    int mih_m = 0, mih_r = -1;
+    int stream = 0, disk = 0;
+    char* files[2];
+    int nfiles = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        // dataset e query
+        if (strncmp(opt, "--", 2) != 0) {
+            if (nfiles == 2) {
+                fprintf(stderr, "Errore: argomento '%s' di troppo (solo dataset e query)\n", opt);
+                exit(1);
+            }
+            files[nfiles++] = argv[i];
+            continue;
+        }
+        // opzioni senza valore
+        if (strcmp(opt, "--exact") == 0) {
+            mode = MODE_EXACT;
+            continue;
+        }
+        if (strcmp(opt, "--stream") == 0 || strcmp(opt, "--disk") == 0) {
+            stream = 1;
+            disk = strcmp(opt, "--disk") == 0;
+            continue;
+        }
+
+        const char* val;
+        if (strcmp(opt, "--pivots") == 0) {
+            val = option_value(argc, argv, &i);
+            if (strcmp(val, "random") == 0) pivot_strategy = PIVOTS_RANDOM;
+            else if (strcmp(val, "fft") == 0) pivot_strategy = PIVOTS_FFT;
+            else if (strcmp(val, "incremental") == 0) pivot_strategy = PIVOTS_INCREMENTAL;
+            else if (strcmp(val, "uniform") == 0) pivot_strategy = PIVOTS_UNIFORM;
+            else {
+                fprintf(stderr, "Errore: strategia di pivot '%s' sconosciuta\n", val);
+                exit(1);
+            }
+        } else if (strcmp(opt, "--autotune") == 0) {
+            val = option_value(argc, argv, &i);
+            tune_recall = atof(val);
+        } else if (strcmp(opt, "--half") == 0) {
+            val = option_value(argc, argv, &i);
+            if (strcmp(val, "f16") == 0) half = DS3_F16;
+            else if (strcmp(val, "bf16") == 0) half = DS3_BF16;
+            else {
+                fprintf(stderr, "Errore: formato '%s' sconosciuto (f16 o bf16)\n", val);
+                exit(1);
+            }
+        } else if (strcmp(opt, "--sq") == 0) {
+            val = option_value(argc, argv, &i);
+            if (strcmp(val, "rerank") == 0) sq_mode = SQ_RERANK;
+            else if (strcmp(val, "only") == 0) sq_mode = SQ_ONLY;
+            else {
+                fprintf(stderr, "Errore: livello SQ '%s' sconosciuto (rerank o only)\n", val);
+                exit(1);
+            }
+        } else if (strcmp(opt, "--proj") == 0) {
+            val = option_value(argc, argv, &i);
+            char name[8];
+            if (sscanf(val, "%7[a-z]:%d:%d", name, &proj_dim, &proj_keep) < 1) name[0] = '\0';
+            if (strcmp(name, "pca") == 0) proj_mode = PROJ_PCA;
+            else if (strcmp(name, "srht") == 0) proj_mode = PROJ_SRHT;
+            else {
+                fprintf(stderr, "Errore: --proj '%s' non valido (pca|srht[:d[:keep]])\n", val);
+                exit(1);
+            }
+        } else if (strcmp(opt, "--cascade") == 0) {
+            val = option_value(argc, argv, &i);
+            const char* p = val;
+            levels = 0;
+            while (*p) {
+                int len = 0;
+                if (levels < CASCADE_MAX) level_keep[levels] = 0;
+                if (levels == CASCADE_MAX ||
+                    sscanf(p, "%d%n:%d%n", &level_x[levels], &len, &level_keep[levels], &len) < 1) {
+                    fprintf(stderr, "Errore: cascata '%s' non valida (x:keep,..., al più %d livelli)\n",
+                            val, CASCADE_MAX);
+                    exit(1);
+                }
+                levels++;
+                p += len;
+                if (*p == ',') p++;
+            }
+        } else if (strcmp(opt, "--pq") == 0) {
+            val = option_value(argc, argv, &i);
+            if (sscanf(val, "%d:%d:%d", &pq_m, &pq_bits, &pq_r) < 1 || pq_m <= 0) {
+                fprintf(stderr, "Errore: --pq '%s' non valido (m[:bits[:r]])\n", val);
+                return 1;
+            }
+            mode = MODE_PQ;
+        } else if (strcmp(opt, "--ivf") == 0) {
+            val = option_value(argc, argv, &i);
+            if (sscanf(val, "%d:%d", &ivf_nlist, &ivf_nprobe) < 1 || ivf_nlist <= 0) {
+                fprintf(stderr, "Errore: --ivf '%s' non valido (nlist[:nprobe])\n", val);
+                return 1;
+            }
+            mode = MODE_IVF;
+        } else if (strcmp(opt, "--hnsw") == 0) {
+            val = option_value(argc, argv, &i);
+            if (sscanf(val, "%d:%d:%d", &hnsw_m, &hnsw_efc, &hnsw_efs) < 1 || hnsw_m <= 1) {
+                fprintf(stderr, "Errore: --hnsw '%s' non valido (M[:efc[:efs]], M > 1)\n", val);
+                return 1;
+            }
+            mode = MODE_HNSW;
+        } else if (strcmp(opt, "--vpt") == 0) {
+            val = option_value(argc, argv, &i);
+            vpt_leaf = atoi(val);
+            if (vpt_leaf < 2) {
+                fprintf(stderr, "Errore: --vpt '%s' non valido (righe per foglia, almeno 2)\n", val);
+                return 1;
+            }
+            mode = MODE_VPT;
+        } else if (strcmp(opt, "--mih") == 0) {
+            val = option_value(argc, argv, &i);
+            if (sscanf(val, "%d:%d", &mih_m, &mih_r) < 1 || mih_m <= 0) {
+                fprintf(stderr, "Errore: --mih '%s' non valido (m[:r])\n", val);
+                return 1;
+            }
+            mode = MODE_MIH;
+        } else {
+            fprintf(stderr, "Errore: opzione '%s' sconosciuta\n", opt);
+            exit(1);
+        }
+    }
+    if (nfiles == 1) {
+        fprintf(stderr, "Errore: indicare sia il dataset sia le query\n");
+        exit(1);
+    }
+    if (nfiles == 2) {
+        dsfilename = files[0];
+        queryfilename = files[1];
+    }
 
     params* input = malloc(sizeof(params));
 
@@ -108,21 +324,97 @@ int main(int argc, char** argv) {
     input->h = h;
     input->k = k;
     input->x = x;
+    input->r = mode == MODE_PQ ? (pq_r > 0 ? pq_r : 10 * k) : 0;
+    input->plan = PLAN_AUTO;
+    input->mode = mode;
+    input->norms = NULL;
+    input->var_order = 0;
+    input->dim_order = NULL;
+    input->DS_half = NULL;
+    input->half_dtype = 0;
+    input->half_owned = 0;
+    input->sq_mode = sq_mode;
+    input->sq_keep = 0;
+    input->sq_clip = 0.0;
+    input->DS_sq = NULL;
+    input->sq_min = NULL;
+    input->sq_scale = NULL;
+    input->sq_norms = NULL;
+    input->proj_mode = proj_mode;
+    input->proj_dim = proj_dim;
+    input->proj_keep = proj_keep;
+    input->proj_mean = NULL;
+    input->proj_basis = NULL;
+    input->proj_sign = NULL;
+    input->proj_coord = NULL;
+    input->DS_proj = NULL;
+    input->levels = levels;
+    for (int l = 0; l < CASCADE_MAX; l++) {
+        input->level_x[l] = l < levels ? level_x[l] : 0;
+        input->level_keep[l] = l < levels ? level_keep[l] : 0;
+        input->level_vp[l] = NULL;
+        input->level_vm[l] = NULL;
+    }
+    input->pq_m = pq_m;
+    input->pq_bits = pq_bits;
+    input->pq_iters = 0;
+    input->pq_refine = 1;
+    input->pq_centroids = NULL;
+    input->pq_codes = NULL;
+    input->ivf_nlist = ivf_nlist;
+    input->ivf_nprobe = ivf_nprobe;
+    input->ivf_iters = 0;
+    input->ivf_centroids = NULL;
+    input->ivf_norms = NULL;
+    input->ivf_offsets = NULL;
+    input->ivf_ids = NULL;
+    input->hnsw_m = hnsw_m;
+    input->hnsw_ef_construction = hnsw_efc;
+    input->hnsw_ef_search = hnsw_efs;
+    input->hnsw_level = NULL;
+    input->hnsw_link_off = NULL;
+    input->hnsw_links0 = NULL;
+    input->hnsw_links = NULL;
+    input->vpt_leaf = vpt_leaf;
+    input->vpt_nnodes = 0;
+    input->vpt_nodes = NULL;
+    input->vpt_ids = NULL;
+    input->vpt_table = NULL;
+    input->mih_m = mih_m;
+    input->mih_radius = mih_r;
+    input->mih_table = NULL;
+    input->mih_keys = NULL;
+    input->mih_bucket = NULL;
+    input->mih_ids = NULL;
     input->silent = silent;
+    input->pivot_strategy = pivot_strategy;
+    input->seed = 0;
 
-    input->DS = load_data(dsfilename, &input->N, &input->D);
-    input->Q = load_data(queryfilename, &input->nq, &input->D);
+    // in modalità stream il dataset viene letto a blocchi direttamente da fit_file()
+    ds3_mapping ds_map = {NULL, 0}, q_map;
+    input->DS = NULL;
+    if (!stream)
+        input->DS = load_matrix(dsfilename, &input->N, &input->D, &ds_map);
+    input->Q = load_matrix(queryfilename, &input->nq, &input->D, &q_map);
 
-    input->id_nn = _mm_malloc(input->nq*input->k*sizeof(int), align);
+    input->id_nn = _mm_malloc(input->nq*input->k*sizeof(ID), align);
     input->dist_nn = _mm_malloc(input->nq*input->k*sizeof(type), align);
 
     input->P = NULL;
     input->index = NULL;
     input->DS_quantized_plus = NULL;
     input->DS_quantized_minus = NULL;
+    input->P_quantized_plus = NULL;
+    input->P_quantized_minus = NULL;
+    input->shm_base = NULL;
+    input->shm_size = 0;
+    input->ds_base = NULL;
+    input->ds_size = 0;
+    input->ds_fd = -1;
 
-    printf("Dataset caricato: N=%d, D=%d\n", input->N, input->D);
-    printf("Query caricate: nq=%d, D=%d\n", input->nq, input->D);
+    if (!stream)
+        printf("Dataset caricato: N=%ld, D=%ld\n", input->N, input->D);
+    printf("Query caricate: nq=%ld, D=%ld\n", input->nq, input->D);
     printf("Thread OpenMP disponibili: %d\n", omp_get_max_threads());
 
     /*
@@ -130,7 +422,7 @@ int main(int argc, char** argv) {
     *  Verifica che la funzione euclidean_distance_asm dia lo stesso risultato 
     *  della versione C classica
     */
-    if (!input->silent) {
+    if (!input->silent && input->DS != NULL) {
         printf("\nTEST ASSEMBLY\n");
         // prende due vettori reali dal dataset
         type* v1 = &input->DS[0];
@@ -156,11 +448,42 @@ int main(int argc, char** argv) {
     double t;
     
     
+    // AUTOTUNE (sulle prime query, poi fit con la configurazione scelta)
+    if (tune_recall > 0.0 && input->DS != NULL) {
+        qp_tuning best;
+        int64_t nqs = input->nq < 200 ? input->nq : 200;
+        if (autotune(input, input->Q, nqs, input->k, TUNE_RECALL, tune_recall, 0, &best) != 0)
+            exit(1);
+    }
+    
     // FIT
     t = omp_get_wtime();
-    fit(input);
+    if (stream) {
+        if (fit_file(input, dsfilename, 65536, STREAM_PIVOTS_FIRST_PASS, 0) != 0)
+            exit(1);
+        if (disk && open_disk_dataset(input, dsfilename) != 0)
+            exit(1);
+    } else {
+        fit(input);
+    }
     t = omp_get_wtime() - t;
 
+    // dataset a 16 bit: la copia double non serve più
+    if (half && input->DS != NULL) {
+        if (compact_dataset(input, half, stream) != 0)
+            exit(1);
+        if (!stream) {
+            free_ds3(input->DS, &ds_map);
+            input->DS = NULL;
+        }
+    }
+
+    // SQ_ONLY: bastano i codici int8, la copia double non serve più
+    if (sq_mode == SQ_ONLY && !stream && input->DS != NULL) {
+        free_ds3(input->DS, &ds_map);
+        input->DS = NULL;
+    }
+
     if(!input->silent)
         printf("FIT time = %.5f secs\n", t);
     else
@@ -177,6 +500,9 @@ int main(int argc, char** argv) {
     else
         printf("%.3f\n", t);
 
+    if(!input->silent)
+        printf("Picco RSS = %.1f MiB\n", peak_rss() / 1048576.0);
+
     // Salva risultati
     char* outname_id = "out_idnn.ds2";
     char* outname_k = "out_distnn.ds2";
@@ -184,14 +510,14 @@ int main(int argc, char** argv) {
     save_data(outname_k, input->dist_nn, input->nq, input->k);
 
     if(!input->silent){
-        for(int i=0; i<input->nq; i++){
-            printf("ID NN Q%3i: ( ", i);
+        for(int64_t i=0; i<input->nq; i++){
+            printf("ID NN Q%3ld: ( ", i);
             for(int j=0; j<input->k; j++)
-                printf("%i ", input->id_nn[i*input->k + j]);
+                printf("%ld ", (int64_t)input->id_nn[i*input->k + j]);
             printf(")\n");
         }
-        for(int i=0; i<input->nq; i++){
-            printf("Dist NN Q%3i: ( ", i);
+        for(int64_t i=0; i<input->nq; i++){
+            printf("Dist NN Q%3ld: ( ", i);
             for(int j=0; j<input->k; j++)
                 printf("%f ", input->dist_nn[i*input->k + j]);
             printf(")\n");
@@ -199,14 +525,11 @@ int main(int argc, char** argv) {
     }
 
     // Cleanup
-    _mm_free(input->DS);
-    _mm_free(input->Q);
-    if (input->P) _mm_free(input->P);
-    if (input->index) _mm_free(input->index);
+    if (!stream && input->DS != NULL) free_ds3(input->DS, &ds_map);
+    free_ds3(input->Q, &q_map);
+    release_index(input);
     _mm_free(input->id_nn);
     _mm_free(input->dist_nn);
-    if (input->DS_quantized_plus) _mm_free(input->DS_quantized_plus);
-    if (input->DS_quantized_minus) _mm_free(input->DS_quantized_minus);
     free(input);
 
     return 0;
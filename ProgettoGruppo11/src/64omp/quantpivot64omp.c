@@ -4,6 +4,7 @@
 #include <math.h>
 #include <xmmintrin.h>
 #include <immintrin.h>
+#include <omp.h>
 #include "common.h"
 #include <stdint.h>
 
@@ -11,6 +12,10 @@
 extern type euclidean_distance_asm(const type* v, const type* w, int D);
 
 
+// Formato .ds3 e conversione dal .ds2 legacy
+#include "quantpivot64omp_io.c"
+
+
 typedef struct {
     type abs_val;
     int idx;
@@ -24,14 +29,54 @@ int compare_pairs(const void* a, const void* b) {
     // Ordinamento decrescente per valore assoluto
     if (pa->abs_val > pb->abs_val) return -1;
     if (pa->abs_val < pb->abs_val) return 1;
-    return 0;
+    // a parità l'indice minore (risultato indipendente dall'implementazione di qsort)
+    return pa->idx - pb->idx;
 }
 
 
+#define QUANT_TOPX_MAX  64      // oltre questo x si ordina con qsort
+
+
 // QUANTIZE - Trasforma vettore in rappresentazione binaria sparsa
 void quantize(const type* v, int D, int x, 
               uint8_t* v_plus, uint8_t* v_minus) {
     
+    // Inizializza v_plus e v_minus a 0
+    memset(v_plus, 0, D * sizeof(uint8_t));
+    memset(v_minus, 0, D * sizeof(uint8_t));
+    
+    if (x > D) x = D;
+    if (x <= 0) return;
+    
+    if (x <= QUANT_TOPX_MAX) {
+        // Selezione dei top-x |v[i]| in un buffer ordinato sullo stack:
+        // niente malloc né ordinamento completo, O(D) per x piccolo.
+        // A parità di valore vince l'indice minore (come l'ordinamento stabile).
+        type top_val[QUANT_TOPX_MAX];
+        int top_idx[QUANT_TOPX_MAX];
+        int n = 0;
+        
+        for (int i = 0; i < D; i++) {
+            type a = fabs(v[i]);
+            if (n == x && !(a > top_val[x - 1])) continue;
+            int pos = n < x ? n++ : x - 1;
+            while (pos > 0 && a > top_val[pos - 1]) {
+                top_val[pos] = top_val[pos - 1];
+                top_idx[pos] = top_idx[pos - 1];
+                pos--;
+            }
+            top_val[pos] = a;
+            top_idx[pos] = i;
+        }
+        
+        for (int j = 0; j < n; j++) {
+            int idx = top_idx[j];
+            if (v[idx] >= 0) v_plus[idx] = 1;
+            else v_minus[idx] = 1;
+        }
+        return;
+    }
+    
     // Crea array di coppie (|v[i]|, indice)
     pair_t* pairs = malloc(D * sizeof(pair_t));
     if (!pairs) {
@@ -47,12 +92,8 @@ void quantize(const type* v, int D, int x,
     // Trova x elementi con valore assoluto massimo
     qsort(pairs, D, sizeof(pair_t), compare_pairs);
     
-    // Inizializza v_plus e v_minus a 0
-    memset(v_plus, 0, D * sizeof(uint8_t));
-    memset(v_minus, 0, D * sizeof(uint8_t));
-    
     // Setta bit per i primi x elementi
-    for (int j = 0; j < x && j < D; j++) {
+    for (int j = 0; j < x; j++) {
         int idx = pairs[j].idx;
         if (v[idx] >= 0) {
             v_plus[idx] = 1;
@@ -103,12 +144,315 @@ type euclidean_distance(const type* v, const type* w, int D) {
 }
 
 
+#ifdef __AVX__
+// Somme orizzontali di 4 vettori in un colpo solo: {Σa, Σb, Σc, Σd}
+static inline __m256d hsum4(__m256d a, __m256d b, __m256d c, __m256d d) {
+    __m256d ab = _mm256_hadd_pd(a, b);          // a0+a1 b0+b1 a2+a3 b2+b3
+    __m256d cd = _mm256_hadd_pd(c, d);
+    __m256d lo = _mm256_permute2f128_pd(ab, cd, 0x20);
+    __m256d hi = _mm256_permute2f128_pd(ab, cd, 0x31);
+    return _mm256_add_pd(lo, hi);
+}
+#endif
+
+
+// Selezione top-k: array ordinato o heap secondo k
+#include "quantpivot64omp_topk.c"
+
+
+#define REFINE_AHEAD    4       // candidati successivi caricati in cache in anticipo
+
+
+// Prefetch di tutte le linee di cache di una riga di bytes byte
+static inline void prefetch_row(const void* row, size_t bytes) {
+    for (size_t off = 0; off < bytes; off += 64)
+        _mm_prefetch((const char*)row + off, _MM_HINT_T0);
+}
+
+
+/*
+ *  EUCLIDEAN_DISTANCES - Distanze esatte da q alle righe X[ids[i] * D], i < n
+ *  (ids[i] < 0: out[i] = INFINITY). Usata dal raffinamento al posto di una
+ *  chiamata a euclidean_distance() per candidato:
+ *  - 4 candidati alla volta: ogni blocco di q caricato nei registri serve
+ *    4 righe, con 4 accumulatori indipendenti
+ *  - prefetch software delle righe dei REFINE_AHEAD candidati successivi
+ *    (accessi sparsi su DS, il prefetcher hardware non li prevede)
+ *  - riduzione orizzontale e radice dei 4 risultati in un solo vettore
+ */
+void euclidean_distances(const type* q, const type* X, const ID* ids, int n,
+                         int64_t D, type* out) {
+    for (int i = 0; i < n && i < REFINE_AHEAD; i++)
+        if (ids[i] >= 0) prefetch_row(&X[ids[i] * D], D * sizeof(type));
+    
+    for (int i = 0; i < n; i += 4) {
+        // righe del gruppo (le posizioni vuote puntano a q e vengono scartate)
+        const type* r[4];
+        for (int b = 0; b < 4; b++)
+            r[b] = i + b < n && ids[i + b] >= 0 ? &X[ids[i + b] * D] : q;
+        for (int b = i + REFINE_AHEAD; b < i + REFINE_AHEAD + 4 && b < n; b++)
+            if (ids[b] >= 0) prefetch_row(&X[ids[b] * D], D * sizeof(type));
+        
+        type s[4];
+        int64_t d = 0;
+#if defined(__AVX512F__)
+        __m512d acc[4];
+        for (int b = 0; b < 4; b++) acc[b] = _mm512_setzero_pd();
+        for (; d + 8 <= D; d += 8) {
+            __m512d qv = _mm512_loadu_pd(&q[d]);
+            for (int b = 0; b < 4; b++) {
+                __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(&r[b][d]), qv);
+                acc[b] = _mm512_fmadd_pd(diff, diff, acc[b]);
+            }
+        }
+        __m256d half[4];
+        for (int b = 0; b < 4; b++)
+            half[b] = _mm256_add_pd(_mm512_castpd512_pd256(acc[b]), _mm512_extractf64x4_pd(acc[b], 1));
+        _mm256_storeu_pd(s, hsum4(half[0], half[1], half[2], half[3]));
+#elif defined(__AVX2__) && defined(__FMA__)
+        __m256d acc[4];
+        for (int b = 0; b < 4; b++) acc[b] = _mm256_setzero_pd();
+        for (; d + 4 <= D; d += 4) {
+            __m256d qv = _mm256_loadu_pd(&q[d]);
+            for (int b = 0; b < 4; b++) {
+                __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(&r[b][d]), qv);
+                acc[b] = _mm256_fmadd_pd(diff, diff, acc[b]);
+            }
+        }
+        _mm256_storeu_pd(s, hsum4(acc[0], acc[1], acc[2], acc[3]));
+#else
+        for (int b = 0; b < 4; b++) s[b] = 0.0;
+#endif
+        for (; d < D; d++)
+            for (int b = 0; b < 4; b++) {
+                type diff = r[b][d] - q[d];
+                s[b] += diff * diff;
+            }
+        
+        for (int b = 0; b < 4 && i + b < n; b++)
+            out[i + b] = ids[i + b] >= 0 ? sqrt(s[b]) : INFINITY;
+    }
+}
+
+
+#define REFINE_BLOCK    64      // dimensioni tra due controlli della soglia (early abandon)
+#define VAR_ROWS        65536   // righe campionate per la varianza delle dimensioni
+
+
+// Somme parziali dei quadrati delle differenze su [d0, d1) per 4 righe, accumulate in s
+static inline void sqdist_block4(const type* q, const type* const r[4],
+                                 int64_t d0, int64_t d1, type s[4]) {
+    int64_t d = d0;
+#if defined(__AVX512F__)
+    __m512d acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm512_setzero_pd();
+    for (; d + 8 <= d1; d += 8) {
+        __m512d qv = _mm512_loadu_pd(&q[d]);
+        for (int b = 0; b < 4; b++) {
+            __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(&r[b][d]), qv);
+            acc[b] = _mm512_fmadd_pd(diff, diff, acc[b]);
+        }
+    }
+    __m256d half[4];
+    for (int b = 0; b < 4; b++)
+        half[b] = _mm256_add_pd(_mm512_castpd512_pd256(acc[b]), _mm512_extractf64x4_pd(acc[b], 1));
+    _mm256_storeu_pd(s, _mm256_add_pd(_mm256_loadu_pd(s), hsum4(half[0], half[1], half[2], half[3])));
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256d acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm256_setzero_pd();
+    for (; d + 4 <= d1; d += 4) {
+        __m256d qv = _mm256_loadu_pd(&q[d]);
+        for (int b = 0; b < 4; b++) {
+            __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(&r[b][d]), qv);
+            acc[b] = _mm256_fmadd_pd(diff, diff, acc[b]);
+        }
+    }
+    _mm256_storeu_pd(s, _mm256_add_pd(_mm256_loadu_pd(s), hsum4(acc[0], acc[1], acc[2], acc[3])));
+#endif
+    for (; d < d1; d++)
+        for (int b = 0; b < 4; b++) {
+            type diff = r[b][d] - q[d];
+            s[b] += diff * diff;
+        }
+}
+
+
+// Dataset a 16 bit: kernel con conversione al volo e compact_dataset()
+#include "quantpivot64omp_half.c"
+
+
+// VARIANCE_ORDER - Blocchi di REFINE_BLOCK dimensioni in ordine di varianza decrescente
+// (input->dim_order, calcolato su al più VAR_ROWS righe a passo uniforme di DS)
+static void variance_order(params* input) {
+    int64_t D = input->D;
+    int64_t nblk = (D + REFINE_BLOCK - 1) / REFINE_BLOCK;
+    int64_t s = input->N < VAR_ROWS ? input->N : VAR_ROWS;
+    type* var = malloc(D * sizeof(type));
+    pair_t* blk = malloc(nblk * sizeof(pair_t));
+    input->dim_order = malloc(nblk * sizeof(int32_t));
+    if (!var || !blk || !input->dim_order) {
+        fprintf(stderr, "Errore allocazione in variance_order\n");
+        exit(1);
+    }
+    
+    #pragma omp parallel for schedule(static)
+    for (int64_t d = 0; d < D; d++) {
+        type sum = 0.0, sum2 = 0.0;
+        for (int64_t r = 0; r < s; r++) {
+            type v = input->DS[(r * input->N / s) * D + d];
+            sum += v;
+            sum2 += v * v;
+        }
+        var[d] = sum2 / s - (sum / s) * (sum / s);
+    }
+    
+    // stesso ordinamento di quantize(): decrescente, a parità l'indice minore
+    for (int64_t t = 0; t < nblk; t++) {
+        blk[t].abs_val = 0.0;
+        blk[t].idx = t;
+        for (int64_t d = t * REFINE_BLOCK; d < D && d < (t + 1) * REFINE_BLOCK; d++)
+            blk[t].abs_val += var[d];
+    }
+    qsort(blk, nblk, sizeof(pair_t), compare_pairs);
+    for (int64_t t = 0; t < nblk; t++) input->dim_order[t] = blk[t].idx;
+    
+    free(var);
+    free(blk);
+}
+
+
+/*
+ *  REFINE_KNN - I k più vicini a q tra le n righe candidate di X (ids[i] < 0:
+ *  nessun candidato), ordinati per distanza esatta crescente in
+ *  out_ids/out_dists (a parità di distanza l'ID minore, vedi topk_t).
+ *  X è una matrice [* x D] di elementi dtype: DS3_F64 (type) oppure
+ *  DS3_F16 / DS3_BF16 (quantpivot64omp_half.c).
+ *
+ *  Early abandon: si confrontano le distanze al quadrato con la k-esima
+ *  migliore trovata finora e, ogni REFINE_BLOCK dimensioni, un gruppo di 4
+ *  candidati viene abbandonato appena tutte le somme parziali superano la
+ *  soglia. I candidati arrivano in ordine di distanza approssimata, quindi
+ *  la soglia scende presto. La radice si calcola solo per i k risultati.
+ *  order (NULL = naturale) è l'ordine di visita dei blocchi di dimensioni:
+ *  con i blocchi a varianza maggiore per primi l'abbandono arriva prima.
+ */
+void refine_knn(const type* q, const void* X, uint32_t dtype, const ID* ids, int n, int64_t D,
+                const int32_t* order, int k, ID* out_ids, type* out_dists) {
+    int64_t nblk = (D + REFINE_BLOCK - 1) / REFINE_BLOCK;
+    size_t row_bytes = D * ds3_elem_size(dtype);
+    const uint8_t* base = X;
+    
+    topk_t top;
+    topk_init(&top, out_ids, out_dists, k);
+    for (int i = 0; i < n && i < REFINE_AHEAD; i++)
+        if (ids[i] >= 0) prefetch_row(base + ids[i] * row_bytes, row_bytes);
+    
+    for (int i = 0; i < n; i += 4) {
+        // righe del gruppo (le posizioni vuote puntano a q con somma infinita)
+        const void* r[4];
+        type s[4];
+        for (int b = 0; b < 4; b++) {
+            int valid = i + b < n && ids[i + b] >= 0;
+            r[b] = valid ? base + ids[i + b] * row_bytes : (const void*)q;
+            s[b] = valid ? 0.0 : INFINITY;
+        }
+        for (int b = i + REFINE_AHEAD; b < i + REFINE_AHEAD + 4 && b < n; b++)
+            if (ids[b] >= 0) prefetch_row(base + ids[b] * row_bytes, row_bytes);
+        
+        // a parità di distanza può ancora vincere l'ID minore: si abbandona solo oltre la soglia
+        type thr = topk_bound(&top);
+        for (int64_t t = 0; t < nblk; t++) {
+            int64_t d0 = (order ? order[t] : t) * REFINE_BLOCK;
+            int64_t d1 = d0 + REFINE_BLOCK < D ? d0 + REFINE_BLOCK : D;
+            if (dtype == DS3_F64) sqdist_block4(q, (const type* const*)r, d0, d1, s);
+            else sqdist_block4_half(q, (const uint16_t* const*)r, dtype, d0, d1, s);
+            if (s[0] > thr && s[1] > thr && s[2] > thr && s[3] > thr) break;
+        }
+        
+        // i candidati completati entrano se battono la lista corrente
+        for (int b = 0; b < 4 && i + b < n; b++)
+            if (s[b] <= topk_bound(&top)) topk_push(&top, s[b], ids[i + b]);
+    }
+    
+    topk_finish(&top);
+    for (int i = 0; i < k; i++) out_dists[i] = sqrt(out_dists[i]);
+}
+
+
+// POOL_SIZE - Candidati raccolti dalla scansione e raffinati: max(k, r)
+static inline int pool_size(const params* input) {
+    return input->r > input->k ? input->r : input->k;
+}
+
+
+// Cascata di livelli di quantizzazione più fini
+#include "quantpivot64omp_cascade.c"
+
+// Filtro con le distanze in dimensione ridotta (PCA o proiezione casuale)
+#include "quantpivot64omp_proj.c"
+
+// Livello intermedio int8 tra scansione e raffinamento
+#include "quantpivot64omp_sq.c"
+
+
+
+// PEAK_RSS - Picco di memoria residente del processo in byte (getrusage)
+int64_t peak_rss(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return (int64_t)ru.ru_maxrss * 1024;    // Linux: ru_maxrss in KiB
+}
+
+
+// Selezione dei pivot (quantpivot64omp_pivots.c)
+void select_pivots(params* input);
+
+// Motori PQ, HNSW e VP-tree (quantpivot64omp_pq.c, quantpivot64omp_hnsw.c, quantpivot64omp_vpt.c)
+void fit_pq(params* input);
+void predict_pq(params* input);
+void fit_hnsw(params* input);
+void predict_hnsw(params* input);
+int fit_vpt(params* input);
+void predict_vpt(params* input);
+
+// Liste invertite (quantpivot64omp_ivf.c), tabelle hash (quantpivot64omp_mih.c) e
+// K-NN esatti a blocchi (quantpivot64omp_exact.c)
+int ivf_partition(params* input);
+int mih_build(params* input);
+void knn_exact(const type* X, const type* norms, int64_t N, int64_t D,
+               const type* Q, int64_t nq, int k, ID* ids, type* dists);
+
+
+#define FIT_TILE    64      // punti per blocco: codici (2*D byte) + h distanze restano in L1/L2
+
 
 // FIT - Costruzione dell'indice (PARALLELIZZATO)
 void fit(params* input) {
+    // MODE_PQ: solo l'indice PQ, niente pivot né codici a 1 bit
+    if (input->mode == MODE_PQ) {
+        fit_pq(input);
+        return;
+    }
+    // MODE_HNSW: solo il grafo sui vettori completi
+    if (input->mode == MODE_HNSW) {
+        fit_hnsw(input);
+        return;
+    }
+    // MODE_VPT: albero con pivot locali al posto della tabella
+    if (input->mode == MODE_VPT) {
+        if (fit_vpt(input) != 0) exit(1);
+        return;
+    }
+    // MODE_EXACT: predict() legge solo i vettori completi, nessun indice
+    if (input->mode == MODE_EXACT) {
+        if (!input->silent)
+            printf("[FIT] Modalità esatta: nessun indice da costruire\n");
+        return;
+    }
+
     if (!input->silent) {
         printf("[FIT] Inizio costruzione indice...\n");
-        printf("      N=%d, D=%d, h=%d, x=%d\n", 
+        printf("      N=%ld, D=%ld, h=%d, x=%d\n", 
                input->N, input->D, input->h, input->x);
     }
     
@@ -117,220 +461,426 @@ void fit(params* input) {
         fprintf(stderr, "Errore: N < h\n");
         exit(1);
     }
+    if (input->N > ID_MAX) {
+        fprintf(stderr, "Errore: N=%ld non rappresentabile negli ID, ricompilare con -DID64\n",
+                input->N);
+        exit(1);
+    }
     
     // Alloca array pivot (solo indici)
-    input->P = _mm_malloc(input->h * sizeof(int), align);
+    input->P = _mm_malloc(input->h * sizeof(ID), align);
     if (!input->P) {
         fprintf(stderr, "Errore allocazione pivot\n");
         exit(1);
     }
     
-    // Seleziona h pivot (campionamento uniforme)
-    int step = input->N / input->h;
-    if (!input->silent) printf("[FIT] Selezione pivot (step=%d)...\n", step);
-    
-    for (int j = 0; j < input->h; j++) {
-        int pivot_idx = step * j;
-        if (pivot_idx >= input->N) pivot_idx = input->N - 1;
-        input->P[j] = pivot_idx;
-    }
-    
-    // Alloca indice [N x h]
-    input->index = _mm_malloc(input->N * input->h * sizeof(type), align);
-    if (!input->index) {
-        fprintf(stderr, "Errore allocazione indice\n");
+    // Seleziona h pivot (strategia in input->pivot_strategy)
+    select_pivots(input);
+
+    // MODE_IVF: righe ordinate per lista, tabella e codici costruiti in quell'ordine
+    if (input->mode == MODE_IVF && ivf_partition(input) != 0)
         exit(1);
-    }
+    const ID* row_ids = input->ivf_ids;
     
-    // Alloca array per vettori quantizzati
+    // Alloca indice [N x h] e codici direttamente nella loro sede finale
+    // (nessun buffer temporaneo da copiare: 2*N*D byte di codici in tutto)
     if (!input->silent) printf("[FIT] Allocazione vettori quantizzati...\n");
-    uint8_t* DS_vp = malloc(input->N * input->D * sizeof(uint8_t));
-    uint8_t* DS_vm = malloc(input->N * input->D * sizeof(uint8_t));
-    uint8_t* P_vp = malloc(input->h * input->D * sizeof(uint8_t));
-    uint8_t* P_vm = malloc(input->h * input->D * sizeof(uint8_t));
+    input->index = _mm_malloc(input->N * input->h * sizeof(type), align);
+    input->DS_quantized_plus = _mm_malloc(input->N * input->D * sizeof(uint8_t), align);
+    input->DS_quantized_minus = _mm_malloc(input->N * input->D * sizeof(uint8_t), align);
+    // codici dei pivot: restano nell'indice e vengono riusati da ogni predict()
+    uint8_t* P_vp = input->P_quantized_plus = _mm_malloc(input->h * input->D * sizeof(uint8_t), align);
+    uint8_t* P_vm = input->P_quantized_minus = _mm_malloc(input->h * input->D * sizeof(uint8_t), align);
     
-    if (!DS_vp || !DS_vm || !P_vp || !P_vm) {
+    if (!input->index || !input->DS_quantized_plus || !input->DS_quantized_minus || !P_vp || !P_vm) {
         fprintf(stderr, "Errore allocazione in fit\n");
         exit(1);
     }
     
-    // Quantizza tutti i punti del dataset (PARALLELIZZATO)
-    if (!input->silent) printf("[FIT] Quantizzazione dataset (%d punti)...\n", input->N);
-    // schedule(static): costo uniforme per ogni iterazione
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < input->N; i++) {
-        quantize(&input->DS[i * input->D], input->D, input->x,
-                 &DS_vp[i * input->D], &DS_vm[i * input->D]);
-    }
-    
-    // Quantizza tutti i pivot (sequenziale, h piccolo)
+    // Quantizza prima i pivot (h piccolo): servono al passo fuso sottostante
     if (!input->silent) printf("[FIT] Quantizzazione pivot (%d pivot)...\n", input->h);
+    #pragma omp parallel for schedule(static)
     for (int j = 0; j < input->h; j++) {
-        int pivot_idx = input->P[j];
+        int64_t pivot_idx = input->P[j];
         quantize(&input->DS[pivot_idx * input->D], input->D, input->x,
                  &P_vp[j * input->D], &P_vm[j * input->D]);
     }
     
-    // Costruisci indice: per ogni punto DS, calcola distanza a ogni pivot (PARALLELIZZATO)
-    if (!input->silent) printf("[FIT] Costruzione indice [%d x %d]...\n", input->N, input->h);
-    // collapse(2): unisce i due loop per bilanciare meglio il carico
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < input->N; i++) {
+    // Passo unico a blocchi (PARALLELIZZATO): ogni blocco di FIT_TILE punti viene
+    // quantizzato e subito confrontato con gli h pivot finché i codici sono in cache
+    if (!input->silent)
+        printf("[FIT] Quantizzazione e indice [%ld x %d] (blocchi da %d punti)...\n",
+               input->N, input->h, FIT_TILE);
+    int64_t ntiles = (input->N + FIT_TILE - 1) / FIT_TILE;
+    // schedule(static): costo uniforme per ogni blocco
+    #pragma omp parallel for schedule(static)
+    for (int64_t t = 0; t < ntiles; t++) {
+        int64_t first = t * FIT_TILE;
+        int64_t last = first + FIT_TILE < input->N ? first + FIT_TILE : input->N;
+        
+        for (int64_t i = first; i < last; i++)
+            quantize(&input->DS[(row_ids ? row_ids[i] : i) * input->D], input->D, input->x,
+                     &input->DS_quantized_plus[i * input->D],
+                     &input->DS_quantized_minus[i * input->D]);
+        
+        // pivot nel loop esterno: i codici di un pivot si riusano su tutto il blocco
         for (int j = 0; j < input->h; j++) {
-            input->index[i * input->h + j] = 
-                approx_distance(&DS_vp[i * input->D], &DS_vm[i * input->D],
-                               &P_vp[j * input->D], &P_vm[j * input->D],
-                               input->D);
+            for (int64_t i = first; i < last; i++) {
+                input->index[i * input->h + j] =
+                    approx_distance(&input->DS_quantized_plus[i * input->D],
+                                    &input->DS_quantized_minus[i * input->D],
+                                    &P_vp[j * input->D], &P_vm[j * input->D],
+                                    input->D);
+            }
         }
     }
     
-    // SALVA dataset quantizzato per predict
-    input->DS_quantized_plus = _mm_malloc(input->N * input->D * sizeof(uint8_t), align);
-    input->DS_quantized_minus = _mm_malloc(input->N * input->D * sizeof(uint8_t), align);
-    memcpy(input->DS_quantized_plus, DS_vp, input->N * input->D * sizeof(uint8_t));
-    memcpy(input->DS_quantized_minus, DS_vm, input->N * input->D * sizeof(uint8_t));
+    // Livelli opzionali per il filtro dei candidati: cascata, proiezione e int8
+    if (input->levels > 0 && cascade_build(input) != 0)
+        exit(1);
+    if (input->proj_mode != PROJ_OFF && proj_train(input) != 0)
+        exit(1);
+    if (input->sq_mode != SQ_OFF && sq_train(input) != 0)
+        exit(1);
+
+    // MODE_MIH: tabelle hash sulle sottostringhe dei codici appena costruiti
+    if (input->mode == MODE_MIH && mih_build(input) != 0)
+        exit(1);
+    
+    if (!input->silent) {
+        printf("[FIT] Completato! Picco RSS: %.1f MiB\n", peak_rss() / 1048576.0);
+    }
+}
+
+
+#define SCAN_QBLOCK         16              // query per blocco della scansione
+#define SCAN_TILE_BYTES     (256 * 1024)    // righe di tabella + codici per tile (~L2)
+
+
+/*
+ *  SCAN_ROWS - Righe [t0, t1) dell'indice per una query (codici vp/vm,
+ *  distanze dai pivot qp): bound sui pivot se use_bounds, poi
+ *  approx_distance() e inserimento in top. row_ids (NULL = identità) dà
+ *  l'ID della riga in ogni posizione. Restituisce le righe scartate.
+ */
+static inline int64_t scan_rows(const params* input, const uint8_t* vp, const uint8_t* vm,
+                                const type* qp, topk_t* top, int64_t t0, int64_t t1,
+                                int use_bounds, const ID* row_ids) {
+    const uint8_t* DS_vp = input->DS_quantized_plus;
+    const uint8_t* DS_vm = input->DS_quantized_minus;
+    int64_t D = input->D;
+    int h = input->h;
+    int64_t pruned = 0;
+    type d_max_k = topk_bound(top);     // cambia solo dopo un inserimento
+    
+    for (int64_t i = t0; i < t1; i++) {
+        
+        if (use_bounds) {
+            // Calcola bound triangolare (max su tutti i pivot)
+            type max_bound = 0.0;
+            for (int j = 0; j < h; j++) {
+                type bound = fabs(input->index[i * h + j] - qp[j]);
+                if (bound > max_bound) max_bound = bound;
+            }
+            
+            // Pruning: se bound >= m-esimo candidato, skip
+            if (max_bound >= d_max_k) {
+                pruned++;
+                continue;
+            }
+        }
+        
+        // Calcola distanza approssimata effettiva
+        type dist_approx = approx_distance(vp, vm, &DS_vp[i * D], &DS_vm[i * D], D);
+        
+        // Se migliore del k-esimo, inserisci (le righe arrivano in ordine di
+        // ID crescente: a parità di distanza non vincono mai)
+        if (dist_approx < d_max_k) {
+            topk_push(top, dist_approx, row_ids ? row_ids[i] : i);
+            d_max_k = topk_bound(top);
+        }
+    }
+    return pruned;
+}
+
+
+// Liste invertite: scansione limitata alle liste più vicine (modalità MODE_IVF)
+#include "quantpivot64omp_ivf.c"
+
+// Tabelle hash sui codici: candidati dai bucket vicini (modalità MODE_MIH)
+#include "quantpivot64omp_mih.c"
+
+
+/*
+ *  SCAN_BLOCK - Scansione con pruning per un blocco di nb query Q[nb x D]:
+ *  pool_size() candidati (distanza approssimata) per ogni query
+ *  (use_bounds = 0: forza bruta, nessun bound). Restituisce le righe scartate.
+ *
+ *  Le righe sono visitate a tile di SCAN_TILE_BYTES (tabella [tile x h] e
+ *  codici [tile x 2D]): ogni tile viene letto dalla memoria una volta e
+ *  scansionato da tutte le query del blocco mentre è in cache. Ogni query
+ *  ha la propria lista e visita le righe nello stesso ordine della
+ *  scansione singola, quindi il risultato non dipende da nb.
+ *
+ *  Buffer per query, contigui: q_vp/q_vm [nb x D], q_to_pivots [nb x h],
+ *  knn_ids/knn_dists [nb x pool_size()], nb <= SCAN_QBLOCK. Ogni lista esce
+ *  ordinata per distanza approssimata crescente.
+ */
+static int64_t scan_block(const params* input, const type* Q, int64_t nb,
+                          const uint8_t* P_vp, const uint8_t* P_vm,
+                          uint8_t* q_vp, uint8_t* q_vm, type* q_to_pivots,
+                          ID* knn_ids, type* knn_dists, int use_bounds) {
+    // indice costruito con le liste invertite: solo le liste più vicine
+    if (input->ivf_offsets != NULL)
+        return ivf_scan_block(input, Q, nb, P_vp, P_vm, q_vp, q_vm, q_to_pivots,
+                              knn_ids, knn_dists, use_bounds);
+    // tabelle hash sui codici: solo le righe dei bucket vicini
+    if (input->mih_keys != NULL)
+        return mih_scan_block(input, Q, nb, P_vp, P_vm, q_vp, q_vm, q_to_pivots,
+                              knn_ids, knn_dists, use_bounds);
+
+    int64_t D = input->D;
+    int h = input->h;
+    int m = pool_size(input);
+    topk_t lists[SCAN_QBLOCK];
+    
+    for (int64_t b = 0; b < nb; b++) {
+        // Quantizza query
+        quantize(&Q[b * D], D, input->x, &q_vp[b * D], &q_vm[b * D]);
+        
+        // Calcola distanze query → pivot
+        for (int j = 0; use_bounds && j < h; j++) {
+            q_to_pivots[b * h + j] = approx_distance(&q_vp[b * D], &q_vm[b * D],
+                                                     &P_vp[j * D], &P_vm[j * D], D);
+        }
+        
+        // Inizializza lista K-NN
+        topk_init(&lists[b], &knn_ids[b * m], &knn_dists[b * m], m);
+    }
     
-    // Cleanup
-    free(DS_vp); 
-    free(DS_vm);
-    free(P_vp); 
-    free(P_vm);
+    int64_t tile = SCAN_TILE_BYTES / (h * sizeof(type) + 2 * D);
+    if (tile < 64) tile = 64;
     
-    if (!input->silent) printf("[FIT] Completato!\n");
+    // Scansione dataset con pruning, tile per tile
+    int64_t pruned = 0;
+    for (int64_t t0 = 0; t0 < input->N; t0 += tile) {
+        int64_t t1 = t0 + tile < input->N ? t0 + tile : input->N;
+        
+        for (int64_t b = 0; b < nb; b++)
+            pruned += scan_rows(input, &q_vp[b * D], &q_vm[b * D], &q_to_pivots[b * h], &lists[b],
+                                t0, t1, use_bounds, NULL);
+    }
+    
+    // liste ordinate per distanza approssimata: il raffinamento le visita in quest'ordine
+    for (int64_t b = 0; b < nb; b++) topk_finish(&lists[b]);
+    
+    return pruned;
+}
+
+
+// Raffinamento con dataset su disco (quantpivot64omp_disk.c)
+void predict_disk(params* input, const uint8_t* P_vp, const uint8_t* P_vm);
+static void predict_memory(params* input, const uint8_t* P_vp, const uint8_t* P_vm);
+int read_rows(const params* input, const ID* ids, int64_t n, type* dst);
+
+
+// QUANTIZE_PIVOTS - Codici degli h pivot dai vettori completi (in memoria, a 16 bit o su disco)
+static void quantize_pivots(const params* input, uint8_t* P_vp, uint8_t* P_vm) {
+    if (input->DS != NULL) {
+        for (int j = 0; j < input->h; j++) {
+            int64_t pivot_idx = input->P[j];
+            quantize(&input->DS[pivot_idx * input->D], input->D, input->x,
+                     &P_vp[j * input->D], &P_vm[j * input->D]);
+        }
+    } else {
+        // dataset a 16 bit o su disco: converte o legge solo le h righe dei pivot
+        type* pivots = _mm_malloc(input->h * input->D * sizeof(type), align);
+        if (pivots && input->DS_half != NULL && input->ds_fd < 0)
+            half_rows(input, input->P, input->h, pivots);
+        else if (!pivots || read_rows(input, input->P, input->h, pivots) != 0) {
+            fprintf(stderr, "Errore lettura dei pivot dal disco\n");
+            exit(1);
+        }
+        for (int j = 0; j < input->h; j++)
+            quantize(&pivots[j * input->D], input->D, input->x,
+                     &P_vp[j * input->D], &P_vm[j * input->D]);
+        _mm_free(pivots);
+    }
 }
 
 
+// Planner pruning / forza bruta per lotto di query
+#include "quantpivot64omp_plan.c"
+
+// Forza bruta esatta a blocchi (modalità MODE_EXACT)
+#include "quantpivot64omp_exact.c"
+
+
 // PREDICT - Ricerca K-NN con pruning (PARALLELIZZATO)
 void predict(params* input) {
     if (!input->silent) {
         printf("[PREDICT] Inizio ricerca K-NN...\n");
-        printf("          nq=%d, k=%d\n", input->nq, input->k);
+        printf("          nq=%ld, k=%d\n", input->nq, input->k);
+    }
+
+    if (input->mode == MODE_EXACT) {
+        double t = omp_get_wtime();
+        predict_exact(input);
+        if (!input->silent)
+            printf("[PREDICT] Completato (esatta, GEMM) in %.3f s\n", omp_get_wtime() - t);
+        return;
+    }
+    if (input->mode == MODE_PQ) {
+        double t = omp_get_wtime();
+        predict_pq(input);
+        if (!input->silent)
+            printf("[PREDICT] Completato (PQ%s) in %.3f s\n",
+                   input->pq_refine ? " + raffinamento" : "", omp_get_wtime() - t);
+        return;
+    }
+    if (input->mode == MODE_HNSW) {
+        double t = omp_get_wtime();
+        predict_hnsw(input);
+        if (!input->silent)
+            printf("[PREDICT] Completato (HNSW) in %.3f s\n", omp_get_wtime() - t);
+        return;
+    }
+    if (input->mode == MODE_VPT) {
+        double t = omp_get_wtime();
+        predict_vpt(input);
+        if (!input->silent)
+            printf("[PREDICT] Completato (VP-tree) in %.3f s, righe scartate: %.2f%%\n",
+                   omp_get_wtime() - t, 100.0 * input->stats.rows_pruned / input->stats.rows_scanned);
+        return;
+    }
+
+    memset(&input->stats, 0, sizeof(input->stats));
+    input->stats.rows_scanned = input->nq * input->N;
+
+    // cascata, proiezione e codici int8 costruiti qui se il dataset è stato fornito
+    // dopo fit() (es. fit_stream)
+    if (input->levels > 0 && input->level_vp[input->levels - 1] == NULL && cascade_build(input) != 0)
+        exit(1);
+    if (input->proj_mode != PROJ_OFF && input->DS_proj == NULL && proj_train(input) != 0)
+        exit(1);
+    if (input->sq_mode != SQ_OFF && input->DS_sq == NULL && sq_train(input) != 0)
+        exit(1);
+
+    // Il raffinamento finale usa i vettori a piena precisione (in memoria o su disco),
+    // con SQ_ONLY bastano i codici int8
+    if (input->DS == NULL && input->DS_half == NULL && input->ds_fd < 0 &&
+        !(input->sq_mode == SQ_ONLY && input->DS_sq != NULL)) {
+        fprintf(stderr, "Errore: dataset non disponibile per il raffinamento\n");
+        exit(1);
     }
     
-    // Quantizza pivot (sequenziale, h piccolo)
-    uint8_t* P_vp = malloc(input->h * input->D * sizeof(uint8_t));
-    uint8_t* P_vm = malloc(input->h * input->D * sizeof(uint8_t));
-    
-    for (int j = 0; j < input->h; j++) {
-        int pivot_idx = input->P[j];
-        quantize(&input->DS[pivot_idx * input->D], input->D, input->x,
-                 &P_vp[j * input->D], &P_vm[j * input->D]);
+    // Codici dei pivot salvati da fit(); ricalcolati solo per indici che non li contengono
+    const uint8_t* P_vp = input->P_quantized_plus;
+    const uint8_t* P_vm = input->P_quantized_minus;
+    uint8_t* own_vp = NULL;
+    uint8_t* own_vm = NULL;
+    if (P_vp == NULL || P_vm == NULL) {
+        own_vp = malloc(input->h * input->D * sizeof(uint8_t));
+        own_vm = malloc(input->h * input->D * sizeof(uint8_t));
+        quantize_pivots(input, own_vp, own_vm);
+        P_vp = own_vp;
+        P_vm = own_vm;
+    }
+
+    // ordine dei blocchi di dimensioni per l'early abandon, calcolato una volta
+    if (input->var_order && input->dim_order == NULL && input->DS != NULL)
+        variance_order(input);
+
+    if (input->ds_fd >= 0) {
+        predict_disk(input, P_vp, P_vm);
+    } else {
+        predict_memory(input, P_vp, P_vm);
     }
     
-    // Usa dataset pre-quantizzato da fit()
-    uint8_t* DS_vp = input->DS_quantized_plus;
-    uint8_t* DS_vm = input->DS_quantized_minus;
-        
-    // PARALLELIZZAZIONE su query (schedule(dynamic) per pruning disuguale)
+    // Cleanup globale
+    free(own_vp); 
+    free(own_vm);
+   
+    if (!input->silent) {
+        printf("[PREDICT] Completato! Lotti con pruning: %ld, a forza bruta: %ld, "
+               "righe scartate: %.1f%% (stima %.1f%%)\n",
+               input->stats.batches_pruned, input->stats.batches_brute,
+               100.0 * input->stats.rows_pruned / input->stats.rows_scanned,
+               100.0 * input->stats.est_prune_rate);
+    }
+}
+
+
+// PREDICT_MEMORY - Scansione e raffinamento con il dataset in memoria
+static void predict_memory(params* input, const uint8_t* P_vp, const uint8_t* P_vm) {
+    // PARALLELIZZAZIONE su blocchi di query (schedule(dynamic) per pruning disuguale)
+    // Le query sono elaborate a lotti di PLAN_BATCH: per ogni lotto il planner
+    // sceglie tra pruning e forza bruta
     // Ogni thread ha i propri buffer privati
-    #pragma omp parallel
+    int64_t pruned_total = 0;
+    int batch_plan = PLAN_PRUNE;
+    // vettori per il raffinamento: copia a 16 bit se presente, altrimenti DS
+    const void* refine_src = input->DS_half ? input->DS_half : (const void*)input->DS;
+    uint32_t refine_dtype = input->DS_half ? input->half_dtype : DS3_F64;
+    #pragma omp parallel reduction(+:pruned_total)
     {
         /*
         *  Alllocazione dentro la regione parallela -> ogni thread allora i 
         *  suoi buffer personali, altrimenti scriverebbero tutti nello stesso buffer
         */
-        uint8_t* q_vp = malloc(input->D * sizeof(uint8_t));
-        uint8_t* q_vm = malloc(input->D * sizeof(uint8_t));
-        type* q_to_pivots = malloc(input->h * sizeof(type));
-        int* knn_ids = malloc(input->k * sizeof(int));
-        type* knn_dists = malloc(input->k * sizeof(type));
+        int m = pool_size(input);
+        uint8_t* q_vp = malloc(SCAN_QBLOCK * input->D * sizeof(uint8_t));
+        uint8_t* q_vm = malloc(SCAN_QBLOCK * input->D * sizeof(uint8_t));
+        type* q_to_pivots = malloc(SCAN_QBLOCK * input->h * sizeof(type));
+        ID* knn_ids = malloc(SCAN_QBLOCK * m * sizeof(ID));
+        type* knn_dists = malloc(SCAN_QBLOCK * m * sizeof(type));
+        filter_buf fb;
+        filter_buf_init(input, &fb);
         
-        // Loop parallelo sulle query (schedule dinamico qui)
-        #pragma omp for schedule(dynamic)
-        for (int qi = 0; qi < input->nq; qi++) {
-            
-            if (!input->silent && ((qi + 1) % 100 == 0 || qi == 0)) {
-                // printf in parallelo può sovrapporsi ma è accettabile per debug
-                #pragma omp critical
-                {
-                    printf(" Query %d/%d (thread %d)\n", qi+1, input->nq, omp_get_thread_num());
-                }
-            }
+        for (int64_t first = 0; first < input->nq; first += PLAN_BATCH) {
+            int64_t last = first + PLAN_BATCH < input->nq ? first + PLAN_BATCH : input->nq;
             
-            type* q = &input->Q[qi * input->D];
+            // un solo thread pianifica, la barriera implicita la rende visibile a tutti
+            #pragma omp single
+            batch_plan = plan_batch(input, &input->Q[first * input->D], last - first, P_vp, P_vm);
+            int use_bounds = batch_plan == PLAN_PRUNE;
             
-            // Quantizza query
-            quantize(q, input->D, input->x, q_vp, q_vm);
+            // blocchi di query più piccoli se non bastano a occupare tutti i thread
+            int64_t bs = (last - first + omp_get_num_threads() - 1) / omp_get_num_threads();
+            if (bs > SCAN_QBLOCK) bs = SCAN_QBLOCK;
             
-            // Calcola distanze query → pivot
-            for (int j = 0; j < input->h; j++) {
-                q_to_pivots[j] = approx_distance(q_vp, q_vm,
-                                                 &P_vp[j * input->D],
-                                                 &P_vm[j * input->D],
-                                                 input->D);
-            }
-            
-            // Inizializza lista K-NN
-            for (int i = 0; i < input->k; i++) {
-                knn_ids[i] = -1;
-                knn_dists[i] = INFINITY;
-            }
-            
-            // Scansione dataset con pruning
-            int pruned = 0;
-            for (int i = 0; i < input->N; i++) {
-                // Calcola bound triangolare (max su tutti i pivot)
-                type max_bound = 0.0;
-                for (int j = 0; j < input->h; j++) {
-                    type bound = fabs(input->index[i * input->h + j] - q_to_pivots[j]);
-                    if (bound > max_bound) max_bound = bound;
-                }
+            // Loop parallelo sui blocchi di query (schedule dinamico qui)
+            #pragma omp for schedule(dynamic)
+            for (int64_t q0 = first; q0 < last; q0 += bs) {
+                int64_t nb = last - q0 < bs ? last - q0 : bs;
                 
-                // Pruning: se bound >= k-esimo vicino, skip
-                type d_max_k = knn_dists[input->k - 1];
-                if (max_bound >= d_max_k) {
-                    pruned++;
-                    continue;
+                if (!input->silent && ((q0 + nb) / 100 > q0 / 100 || q0 == 0)) {
+                    // printf in parallelo può sovrapporsi ma è accettabile per debug
+                    #pragma omp critical
+                    {
+                        printf(" Query %ld/%ld (thread %d)\n", q0 + nb, input->nq, omp_get_thread_num());
+                    }
                 }
                 
-                // Calcola distanza approssimata effettiva
-                type dist_approx = approx_distance(q_vp, q_vm,
-                                                   &DS_vp[i * input->D],
-                                                   &DS_vm[i * input->D],
-                                                   input->D);
+                pruned_total += scan_block(input, &input->Q[q0 * input->D], nb, P_vp, P_vm,
+                                           q_vp, q_vm, q_to_pivots, knn_ids, knn_dists, use_bounds);
                 
-                // Se migliore del k-esimo, inserisci in lista ordinata
-                if (dist_approx < d_max_k) {
-                    // Trova posizione e shifta elementi
-                    int pos = input->k - 1;
-                    while (pos > 0 && dist_approx < knn_dists[pos - 1]) {
-                        knn_dists[pos] = knn_dists[pos - 1];
-                        knn_ids[pos] = knn_ids[pos - 1];
-                        pos--;
-                    }
-                    knn_dists[pos] = dist_approx;
-                    knn_ids[pos] = i;
+                for (int64_t b = 0; b < nb; b++) {
+                    int64_t qi = q0 + b;
+                    type* q = &input->Q[qi * input->D];
+                    ID* out_ids = &input->id_nn[qi * input->k];
+                    type* out_dists = &input->dist_nn[qi * input->k];
+                    // cascata e filtro int8 (con SQ_ONLY scrivono già i risultati)
+                    int n = filter_candidates(input, q, &fb, &knn_ids[b * m], m, out_ids, out_dists);
+                    if (input->sq_mode == SQ_ONLY)
+                        continue;
+                    // Raffinamento: distanza euclidea esatta sui candidati, i k migliori
+                    // direttamente nei risultati (thread-safe: ogni thread ha un blocco univoco
+                    // grazie a #pragma omp for)
+                    refine_knn(q, refine_src, refine_dtype, &knn_ids[b * m], n, input->D,
+                               input->dim_order, input->k, out_ids, out_dists);
                 }
             }
-            
-            // Raffinamento: distanza euclidea esatta sui K candidati
-            for (int idx = 0; idx < input->k; idx++) {
-                if (knn_ids[idx] >= 0) {
-                    knn_dists[idx] = euclidean_distance(q,
-                                                        &input->DS[knn_ids[idx] * input->D],
-                                                        input->D);
-                }
-            }
-            
-            // Riordina dopo raffinamento (bubble sort per k piccolo)
-            for (int pass = 0; pass < input->k - 1; pass++) {
-                for (int j = 0; j < input->k - 1 - pass; j++) {
-                    if (knn_dists[j] > knn_dists[j + 1]) {
-                        // Swap distanze
-                        type tmp_d = knn_dists[j];
-                        knn_dists[j] = knn_dists[j + 1];
-                        knn_dists[j + 1] = tmp_d;
-                        // Swap ID
-                        int tmp_id = knn_ids[j];
-                        knn_ids[j] = knn_ids[j + 1];
-                        knn_ids[j + 1] = tmp_id;
-                    }
-                }
-            }
-            
-            // Salva risultati (thread-safe: ogni thread ha un qi univoco grazie  a #pragma omp for)
-            memcpy(&input->id_nn[qi * input->k], knn_ids, input->k * sizeof(int));
-            memcpy(&input->dist_nn[qi * input->k], knn_dists, input->k * sizeof(type));
         }
         
         // Cleanup dei buffer 
@@ -339,11 +889,150 @@ void predict(params* input) {
         free(q_to_pivots);
         free(knn_ids); 
         free(knn_dists);
+        filter_buf_free(&fb);
     }
-    
-    // Cleanup globale
-    free(P_vp); 
-    free(P_vm);
-   
-    if (!input->silent) printf("[PREDICT] Completato!\n");
-}
\ No newline at end of file
+    input->stats.rows_pruned = pruned_total;
+}
+
+
+// Strategie di selezione dei pivot
+#include "quantpivot64omp_pivots.c"
+
+// Indice condiviso tra processi (segmento shm / file mappato)
+#include "quantpivot64omp_shm.c"
+
+// Fit out-of-core a blocchi (file o iteratore)
+#include "quantpivot64omp_stream.c"
+
+// Vettori a piena precisione su disco, raffinamento a lotti
+#include "quantpivot64omp_disk.c"
+
+// Quantizzazione a prodotto con tabelle ADC (modalità MODE_PQ)
+#include "quantpivot64omp_pq.c"
+
+// Grafo HNSW (modalità MODE_HNSW)
+#include "quantpivot64omp_hnsw.c"
+
+// VP-tree (modalità MODE_VPT), usa le distanze di quantpivot64omp_hnsw.c
+#include "quantpivot64omp_vpt.c"
+
+
+// RELEASE_INDEX - Libera le strutture costruite da fit() o mappate da attach_index()
+void release_index(params* input) {
+    if (input->shm_base != NULL) {
+        // gli array puntano dentro la mappatura: basta smapparla
+        detach_index(input);
+    } else {
+        if (input->P) _mm_free(input->P);
+        if (input->index) _mm_free(input->index);
+        if (input->DS_quantized_plus) _mm_free(input->DS_quantized_plus);
+        if (input->DS_quantized_minus) _mm_free(input->DS_quantized_minus);
+        if (input->P_quantized_plus) _mm_free(input->P_quantized_plus);
+        if (input->P_quantized_minus) _mm_free(input->P_quantized_minus);
+        if (input->ivf_centroids) _mm_free(input->ivf_centroids);
+        if (input->ivf_norms) _mm_free(input->ivf_norms);
+        free(input->ivf_offsets);
+        if (input->ivf_ids) _mm_free(input->ivf_ids);
+        free(input->mih_table);
+        free(input->mih_keys);
+        free(input->mih_bucket);
+        free(input->mih_ids);
+    }
+    input->P = NULL;
+    input->index = NULL;
+    input->DS_quantized_plus = NULL;
+    input->DS_quantized_minus = NULL;
+    input->P_quantized_plus = NULL;
+    input->P_quantized_minus = NULL;
+    input->ivf_centroids = NULL;
+    input->ivf_norms = NULL;
+    input->ivf_offsets = NULL;
+    input->ivf_ids = NULL;
+    input->mih_table = NULL;
+    input->mih_keys = NULL;
+    input->mih_bucket = NULL;
+    input->mih_ids = NULL;
+
+    // norme della modalità esatta e ordine delle dimensioni: sempre privati,
+    // anche con indice condiviso
+    if (input->norms) _mm_free(input->norms);
+    input->norms = NULL;
+    free(input->dim_order);
+    input->dim_order = NULL;
+
+    // dataset a 16 bit: copia di compact_dataset() o payload del file mappato sotto
+    if (input->DS_half != NULL && input->half_owned) _mm_free(input->DS_half);
+    input->DS_half = NULL;
+    input->half_owned = 0;
+
+    // codici della cascata e int8 (sempre privati)
+    for (int l = 0; l < CASCADE_MAX; l++) {
+        _mm_free(input->level_vp[l]);
+        _mm_free(input->level_vm[l]);
+        input->level_vp[l] = NULL;
+        input->level_vm[l] = NULL;
+    }
+    _mm_free(input->DS_sq);
+    _mm_free(input->sq_min);
+    _mm_free(input->sq_scale);
+    _mm_free(input->sq_norms);
+    input->DS_sq = NULL;
+    input->sq_min = NULL;
+    input->sq_scale = NULL;
+    input->sq_norms = NULL;
+
+    // proiezione e vettori ridotti (sempre privati)
+    _mm_free(input->proj_mean);
+    _mm_free(input->proj_basis);
+    free(input->proj_sign);
+    free(input->proj_coord);
+    _mm_free(input->DS_proj);
+    input->proj_mean = NULL;
+    input->proj_basis = NULL;
+    input->proj_sign = NULL;
+    input->proj_coord = NULL;
+    input->DS_proj = NULL;
+
+    // indice PQ (sempre privato)
+    _mm_free(input->pq_centroids);
+    _mm_free(input->pq_codes);
+    input->pq_centroids = NULL;
+    input->pq_codes = NULL;
+
+    // grafo HNSW (sempre privato)
+    free(input->hnsw_level);
+    free(input->hnsw_link_off);
+    _mm_free(input->hnsw_links0);
+    _mm_free(input->hnsw_links);
+    input->hnsw_level = NULL;
+    input->hnsw_link_off = NULL;
+    input->hnsw_links0 = NULL;
+    input->hnsw_links = NULL;
+
+    // VP-tree (sempre privato)
+    free(input->vpt_nodes);
+    _mm_free(input->vpt_ids);
+    _mm_free(input->vpt_table);
+    input->vpt_nodes = NULL;
+    input->vpt_ids = NULL;
+    input->vpt_table = NULL;
+    input->vpt_nnodes = 0;
+
+    // dataset su disco (open_disk_dataset)
+    if (input->ds_fd >= 0) {
+        close(input->ds_fd);
+        input->ds_fd = -1;
+    }
+
+    // dataset mappato da fit_file()
+    if (input->ds_base != NULL) {
+        munmap(input->ds_base, input->ds_size);
+        input->ds_base = NULL;
+        input->ds_size = 0;
+        input->DS = NULL;
+    }
+}
+
+
+// Auto-tuning di h, x e rerank su un sottocampione
+#include "quantpivot64omp_tune.c"
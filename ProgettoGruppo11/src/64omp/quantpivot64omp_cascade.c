@@ -0,0 +1,125 @@
+/*
+ *  Cascata di livelli di quantizzazione
+ *
+ *  Un solo x impone un compromesso: x piccolo rende approx_distance()
+ *  economica ma grossolana, x grande è precisa ma rallenta la scansione.
+ *  Con la cascata la scansione (pivot, pruning) resta al livello input->x e
+ *  fit() costruisce i codici di input->levels livelli più fini (level_x,
+ *  es. 8 e 32 sopra x = 2). In predict() i candidati della scansione
+ *  vengono riordinati livello per livello con code_distance() (distanza
+ *  euclidea al quadrato tra i codici ternari fini) e a ogni livello ne
+ *  sopravvivono level_keep; solo gli ultimi arrivano alla proiezione e al
+ *  filtro int8 (se attivi) e al raffinamento esatto.
+ *
+ *  filter_candidates() (quantpivot64omp_sq.c) applica in ordine cascata,
+ *  proiezione e filtro int8.
+ */
+
+
+// LEVEL_KEEP - Candidati che sopravvivono al livello l: level_keep[l]
+// (<= 0: un quarto del livello precedente), tra k e il livello precedente
+static inline int level_keep(const params* input, int l) {
+    int keep = pool_size(input);
+    for (int i = 0; i <= l; i++) {
+        int want = input->level_keep[i] > 0 ? input->level_keep[i] : keep / 4;
+        if (want < input->k) want = input->k;
+        if (want < keep) keep = want;
+    }
+    return keep;
+}
+
+// CASCADE_POOL - Candidati all'uscita della cascata (pool_size() senza livelli)
+static inline int cascade_pool(const params* input) {
+    return input->levels > 0 ? level_keep(input, input->levels - 1) : pool_size(input);
+}
+
+
+/*
+ *  CASCADE_BUILD - Codici dei livelli fini di tutte le righe dai vettori in
+ *  memoria (DS o DS_half). Restituisce 0 se ok, -1 in caso di errore.
+ */
+int cascade_build(params* input) {
+    int64_t N = input->N, D = input->D;
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore cascade_build: dataset in memoria non disponibile\n");
+        return -1;
+    }
+    if (input->levels < 0 || input->levels > CASCADE_MAX) {
+        fprintf(stderr, "Errore cascade_build: %d livelli (al più %d)\n", input->levels, CASCADE_MAX);
+        return -1;
+    }
+
+    for (int l = 0; l < input->levels; l++) {
+        if (input->level_x[l] <= 0) {
+            fprintf(stderr, "Errore cascade_build: x=%d non valido al livello %d\n",
+                    input->level_x[l], l);
+            return -1;
+        }
+        uint8_t* vp = _mm_malloc(N * D * sizeof(uint8_t), align);
+        uint8_t* vm = _mm_malloc(N * D * sizeof(uint8_t), align);
+        if (!vp || !vm) {
+            fprintf(stderr, "Errore allocazione in cascade_build\n");
+            exit(1);
+        }
+
+        #pragma omp parallel
+        {
+            type* buf = malloc(D * sizeof(type));
+            #pragma omp for schedule(static)
+            for (int64_t i = 0; i < N; i++)
+                quantize(dataset_row(input, i, buf), D, input->level_x[l], &vp[i * D], &vm[i * D]);
+            free(buf);
+        }
+
+        _mm_free(input->level_vp[l]);
+        _mm_free(input->level_vm[l]);
+        input->level_vp[l] = vp;
+        input->level_vm[l] = vm;
+    }
+
+    if (!input->silent) {
+        printf("[CASCATA] x=%d (scansione, %d candidati)", input->x, pool_size(input));
+        for (int l = 0; l < input->levels; l++)
+            printf(" -> x=%d (%d)", input->level_x[l], level_keep(input, l));
+        printf("\n");
+    }
+    return 0;
+}
+
+
+// Distanza euclidea al quadrato tra i vettori ternari (v+ - v-) e (w+ - w-).
+// approx_distance() ne è il prodotto scalare: come stima della distanza
+// ordina i candidati al contrario, la forma qui sotto no.
+static inline type code_distance(const uint8_t* vp, const uint8_t* vm,
+                                 const uint8_t* wp, const uint8_t* wm, int64_t D) {
+    int s = 0;
+    for (int64_t i = 0; i < D; i++) {
+        int a = (vp[i] - vm[i]) - (wp[i] - wm[i]);
+        s += a * a;
+    }
+    return (type)s;
+}
+
+
+// I keep migliori tra gli n candidati ids per code_distance() al livello l
+// (q_vp, q_vm: buffer [D] per i codici della query)
+static void level_rerank(const params* input, int l, const type* q, uint8_t* q_vp, uint8_t* q_vm,
+                         const ID* ids, int n, int keep, ID* out_ids, type* out_dists) {
+    int64_t D = input->D;
+    const uint8_t* vp = input->level_vp[l];
+    const uint8_t* vm = input->level_vm[l];
+    quantize(q, D, input->level_x[l], q_vp, q_vm);
+
+    topk_t top;
+    topk_init(&top, out_ids, out_dists, keep);
+    for (int i = 0; i < n; i++) {
+        if (ids[i] < 0) continue;
+        if (i + REFINE_AHEAD < n && ids[i + REFINE_AHEAD] >= 0) {
+            prefetch_row(&vp[ids[i + REFINE_AHEAD] * D], D);
+            prefetch_row(&vm[ids[i + REFINE_AHEAD] * D], D);
+        }
+        type d = code_distance(q_vp, q_vm, &vp[ids[i] * D], &vm[ids[i] * D], D);
+        if (d <= topk_bound(&top)) topk_push(&top, d, ids[i]);
+    }
+    topk_finish(&top);
+}
@@ -0,0 +1,309 @@
+/*
+ *  Dataset su disco
+ *
+ *  Con open_disk_dataset() i vettori a piena precisione restano nel file:
+ *  in memoria ci sono solo l'indice (codici e tabella [N x h]) e, durante
+ *  predict(), le righe candidate del lotto di query corrente.
+ *
+ *  predict_disk() elabora le query a lotti di DISK_BATCH:
+ *  1. scansione (pruning o forza bruta secondo plan_batch(), parallela sui
+ *     blocchi di query) → pool_size() candidati per query; la cascata e il
+ *     filtro int8 in memoria ne tengono solo refine_pool() (nessuno con SQ_ONLY)
+ *  2. insieme ordinato e senza duplicati delle righe candidate del lotto
+ *  3. posix_fadvise(WILLNEED) su quelle righe: il kernel avvia la lettura
+ *     in modo asincrono mentre i thread scansionano il lotto successivo
+ *  4. pread parallele delle righe (run contigue unite in una richiesta)
+ *     e raffinamento con la distanza euclidea esatta
+ *  Il raffinamento del lotto b avviene quindi dopo la scansione del lotto
+ *  b+1, così il tempo di I/O si sovrappone al calcolo.
+ */
+
+#define DISK_BATCH      1024        // query per lotto
+
+
+typedef struct {
+    int64_t nq;                 // query nel lotto
+    int64_t first;              // indice della prima query
+    ID* knn_ids;                // [nq x m] candidati dalla scansione
+    type* knn_dists;            // [nq x m]
+    ID* rows;                   // righe candidate distinte, ordinate
+    int64_t nrows;
+} disk_batch;
+
+
+// Posizione di id in rows[0..n) (presente per costruzione)
+static int64_t find_row(const ID* rows, int64_t n, ID id) {
+    int64_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int64_t mid = (lo + hi) / 2;
+        if (rows[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+
+/*
+ *  OPEN_DISK_DATASET - Usa il file come sorgente dei vettori per il raffinamento
+ *
+ *  Accetta .ds2 (double) o .ds3 di qualsiasi dtype numerico; se l'indice è
+ *  già costruito le dimensioni devono coincidere. Il file resta aperto fino
+ *  a release_index(); da qui in poi predict() legge i vettori dal file anche
+ *  se input->DS è impostato. Restituisce 0 se ok, -1 in caso di errore.
+ */
+int open_disk_dataset(params* input, const char* filename) {
+    uint32_t dtype;
+    off_t offset;
+    int64_t rows, cols;
+
+    int fd = open_data_file(filename, &dtype, &offset, &rows, &cols);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < offset + (size_t)rows * cols * ds3_elem_size(dtype)) {
+        fprintf(stderr, "Errore open_disk_dataset: '%s' troncato\n", filename);
+        close(fd);
+        return -1;
+    }
+    if ((input->index != NULL || input->pq_codes != NULL) && (rows != input->N || cols != input->D)) {
+        fprintf(stderr, "Errore open_disk_dataset: '%s' è %ld x %ld, l'indice %ld x %ld\n",
+                filename, rows, cols, input->N, input->D);
+        close(fd);
+        return -1;
+    }
+
+    if (input->ds_fd >= 0) close(input->ds_fd);
+    // la mappatura creata da fit_file() non serve più
+    if (input->ds_base != NULL) {
+        munmap(input->ds_base, input->ds_size);
+        input->ds_base = NULL;
+        input->ds_size = 0;
+        input->DS = NULL;
+        if (!input->half_owned) input->DS_half = NULL;
+    }
+    input->ds_fd = fd;
+    input->ds_offset = offset;
+    input->ds_dtype = dtype;
+    input->N = rows;
+    input->D = cols;
+
+    // accesso sparso: niente readahead sequenziale oltre le righe richieste
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    if (!input->silent)
+        printf("[DISK] Dataset '%s' su disco: N=%ld, D=%ld, dtype=%u\n",
+               filename, rows, cols, dtype);
+    return 0;
+}
+
+
+/*
+ *  READ_ROWS - Legge n righe (indici qualsiasi) dal dataset su disco in dst
+ *  [n x D] type. Righe consecutive in ids vengono lette con una sola pread.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int read_rows(const params* input, const ID* ids, int64_t n, type* dst) {
+    size_t esize = ds3_elem_size(input->ds_dtype);
+    size_t row_bytes = input->D * esize;
+    int failed = 0;
+
+    #pragma omp parallel
+    {
+        // buffer di conversione per dtype diversi da type (una run alla volta)
+        void* raw = NULL;
+        int64_t raw_rows = 0;
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int64_t i = 0; i < n; i++) {
+            // solo l'inizio di ogni run fa la lettura
+            if (i > 0 && ids[i] == ids[i - 1] + 1) continue;
+            int64_t len = 1;
+            while (i + len < n && ids[i + len] == ids[i + len - 1] + 1) len++;
+
+            void* buf = &dst[i * input->D];
+            if (input->ds_dtype != DS3_F64) {
+                if (len > raw_rows) {
+                    free(raw);
+                    raw = malloc(len * row_bytes);
+                    raw_rows = raw ? len : 0;
+                }
+                if (raw == NULL) {
+                    #pragma omp atomic write
+                    failed = 1;
+                    continue;
+                }
+                buf = raw;
+            }
+
+            off_t off = input->ds_offset + (off_t)ids[i] * row_bytes;
+            if (read_exact(input->ds_fd, buf, len * row_bytes, off) != 0) {
+                #pragma omp atomic write
+                failed = 1;
+            } else if (buf == raw) {
+                ds3_convert(raw, input->ds_dtype, &dst[i * input->D], len * input->D);
+            }
+        }
+        free(raw);
+    }
+
+    return failed ? -1 : 0;
+}
+
+
+// Fase 2-3: righe candidate distinte del lotto e readahead asincrono
+static void disk_collect_rows(const params* input, disk_batch* b) {
+    int m = pool_size(input);
+
+    // righe distinte ordinate per offset crescente
+    int64_t n = 0;
+    for (int64_t i = 0; i < b->nq * m; i++)
+        if (b->knn_ids[i] >= 0) b->rows[n++] = b->knn_ids[i];
+    qsort(b->rows, n, sizeof(ID), cmp_id);
+    int64_t u = 0;
+    for (int64_t i = 0; i < n; i++)
+        if (u == 0 || b->rows[i] != b->rows[u - 1]) b->rows[u++] = b->rows[i];
+    b->nrows = u;
+
+    // lettura asincrona: fadvise ritorna subito, il kernel carica la page cache
+    size_t row_bytes = input->D * ds3_elem_size(input->ds_dtype);
+    for (int64_t i = 0; i < u; ) {
+        int64_t len = 1;
+        while (i + len < u && b->rows[i + len] == b->rows[i + len - 1] + 1) len++;
+        posix_fadvise(input->ds_fd, input->ds_offset + (off_t)b->rows[i] * row_bytes,
+                      len * row_bytes, POSIX_FADV_WILLNEED);
+        i += len;
+    }
+}
+
+
+// Fase 1: scansione del lotto (poi fasi 2-3)
+static void disk_scan_batch(params* input, disk_batch* b, const uint8_t* P_vp, const uint8_t* P_vm) {
+    int m = pool_size(input);
+    int use_bounds = plan_batch(input, &input->Q[b->first * input->D], b->nq, P_vp, P_vm) == PLAN_PRUNE;
+    int64_t pruned = 0;
+
+    #pragma omp parallel reduction(+:pruned)
+    {
+        uint8_t* q_vp = malloc(SCAN_QBLOCK * input->D * sizeof(uint8_t));
+        uint8_t* q_vm = malloc(SCAN_QBLOCK * input->D * sizeof(uint8_t));
+        type* q_to_pivots = malloc(SCAN_QBLOCK * input->h * sizeof(type));
+        filter_buf fb;
+        filter_buf_init(input, &fb);
+
+        // blocchi di query più piccoli se non bastano a occupare tutti i thread
+        int64_t bs = (b->nq + omp_get_num_threads() - 1) / omp_get_num_threads();
+        if (bs > SCAN_QBLOCK) bs = SCAN_QBLOCK;
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t q0 = 0; q0 < b->nq; q0 += bs) {
+            int64_t nb = b->nq - q0 < bs ? b->nq - q0 : bs;
+            pruned += scan_block(input, &input->Q[(b->first + q0) * input->D], nb, P_vp, P_vm,
+                                 q_vp, q_vm, q_to_pivots, &b->knn_ids[q0 * m], &b->knn_dists[q0 * m],
+                                 use_bounds);
+
+            // cascata, proiezione e filtro int8: dal disco si leggono solo le righe
+            // sopravvissute (nessuna con SQ_ONLY)
+            for (int64_t qi = q0; qi < q0 + nb && (input->levels > 0 || input->proj_mode != PROJ_OFF ||
+                                                   input->sq_mode != SQ_OFF); qi++) {
+                int64_t q_idx = b->first + qi;
+                filter_candidates(input, &input->Q[q_idx * input->D], &fb, &b->knn_ids[qi * m], m,
+                                  &input->id_nn[q_idx * input->k], &input->dist_nn[q_idx * input->k]);
+            }
+        }
+
+        free(q_vp);
+        free(q_vm);
+        free(q_to_pivots);
+        filter_buf_free(&fb);
+    }
+    input->stats.rows_pruned += pruned;
+    disk_collect_rows(input, b);
+}
+
+
+// Fase 4: lettura delle righe e raffinamento esatto dei primi n candidati
+// di ogni query (dopo cascata e filtro int8 i sopravvissuti sono in testa)
+static void disk_refine_batch(params* input, disk_batch* b, type* rows_buf, int n) {
+    int k = input->k;
+    int m = pool_size(input);
+
+    if (read_rows(input, b->rows, b->nrows, rows_buf) != 0) {
+        fprintf(stderr, "Errore lettura del dataset su disco\n");
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        ID* pos = malloc(m * sizeof(ID));
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t qi = 0; qi < b->nq; qi++) {
+            int64_t q_idx = b->first + qi;
+            type* q = &input->Q[q_idx * input->D];
+            ID* knn_ids = &b->knn_ids[qi * m];
+
+            // posizioni dei candidati in rows_buf
+            for (int idx = 0; idx < n; idx++)
+                pos[idx] = knn_ids[idx] >= 0 ? find_row(b->rows, b->nrows, knn_ids[idx]) : -1;
+
+            ID* out_ids = &input->id_nn[q_idx * k];
+            refine_knn(q, rows_buf, DS3_F64, pos, n, input->D, input->dim_order, k,
+                       out_ids, &input->dist_nn[q_idx * k]);
+            for (int i = 0; i < k; i++)
+                if (out_ids[i] >= 0) out_ids[i] = b->rows[out_ids[i]];
+        }
+
+        free(pos);
+    }
+}
+
+
+// PREDICT_DISK - Ricerca K-NN con raffinamento a lotti dal dataset su disco
+void predict_disk(params* input, const uint8_t* P_vp, const uint8_t* P_vm) {
+    int64_t cap = DISK_BATCH * (int64_t)pool_size(input);
+    disk_batch batch[2];
+    for (int s = 0; s < 2; s++) {
+        batch[s].knn_ids = malloc(cap * sizeof(ID));
+        batch[s].knn_dists = malloc(cap * sizeof(type));
+        batch[s].rows = malloc(cap * sizeof(ID));
+    }
+    type* rows_buf = _mm_malloc(cap * input->D * sizeof(type), align);
+    if (!rows_buf || !batch[0].rows || !batch[1].rows) {
+        fprintf(stderr, "Errore allocazione in predict_disk\n");
+        exit(1);
+    }
+
+    int64_t nbatches = (input->nq + DISK_BATCH - 1) / DISK_BATCH;
+    int64_t rows_read = 0;
+
+    // pipeline: scansione del lotto b, poi raffinamento del lotto b-1
+    for (int64_t bi = 0; bi <= nbatches; bi++) {
+        if (bi < nbatches) {
+            disk_batch* cur = &batch[bi % 2];
+            cur->first = bi * DISK_BATCH;
+            cur->nq = input->nq - cur->first < DISK_BATCH ? input->nq - cur->first : DISK_BATCH;
+            disk_scan_batch(input, cur, P_vp, P_vm);
+        }
+        if (bi > 0) {
+            disk_batch* prev = &batch[(bi - 1) % 2];
+            // SQ_ONLY: risultati già scritti dalla scansione
+            if (input->sq_mode != SQ_ONLY)
+                disk_refine_batch(input, prev, rows_buf, refine_pool(input));
+            rows_read += prev->nrows;
+            if (!input->silent)
+                printf(" Lotto %ld/%ld: %ld righe lette dal disco\n", bi, nbatches, prev->nrows);
+        }
+    }
+
+    if (!input->silent)
+        printf("[PREDICT] %ld righe lette dal disco per %ld query\n", rows_read, input->nq);
+
+    for (int s = 0; s < 2; s++) {
+        free(batch[s].knn_ids);
+        free(batch[s].knn_dists);
+        free(batch[s].rows);
+    }
+    _mm_free(rows_buf);
+}
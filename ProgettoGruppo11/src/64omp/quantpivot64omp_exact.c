@@ -0,0 +1,264 @@
+/*
+ *  Motore esatto a forza bruta (GEMM)
+ *
+ *  ||q - x||^2 = ||q||^2 + ||x||^2 - 2 q·x
+ *
+ *  Le norme delle righe del dataset si calcolano una volta (input->norms),
+ *  i prodotti q·x per blocchi di EXACT_QT query x EXACT_XT righe con un
+ *  micro-kernel 4x4 che tiene 16 accumulatori vettoriali nei registri
+ *  (AVX-512 o AVX2+FMA, fallback scalare). La dimensione D è a sua volta
+ *  divisa in blocchi di EXACT_KC elementi, così le righe del tile restano
+ *  in L2 per tutte le query del blocco.
+ *
+ *  La selezione dei k migliori è fusa con il calcolo: ogni tile aggiorna
+ *  subito le liste delle sue query, la matrice delle distanze non esiste
+ *  mai per intero. Il lavoro è parallelo su (tile di query) x (fetta del
+ *  dataset): se le query sono poche il dataset viene diviso tra i thread e
+ *  le liste parziali vengono fuse alla fine.
+ *
+ *  Le k distanze finali sono ricalcolate con euclidean_distances() per non
+ *  ereditare la cancellazione numerica della forma espansa.
+ */
+
+#define EXACT_QT    32          // query per tile
+#define EXACT_XT    256         // righe del dataset per tile
+#define EXACT_KC    512         // elementi di D per blocco
+
+
+// ROW_NORMS - ||x_i||^2 per ogni riga
+static void row_norms(const type* X, int64_t n, int64_t D, type* norms) {
+    #pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < n; i++) {
+        type s = 0.0;
+        for (int64_t d = 0; d < D; d++) s += X[i * D + d] * X[i * D + d];
+        norms[i] = s;
+    }
+}
+
+
+#if defined(__AVX512F__)
+
+// 4 query x 4 righe, len elementi: out[a][b] += q_a · x_b
+static inline void dot_4x4(const type* q, const type* x, int64_t D, int64_t len, type out[4][4]) {
+    __m512d acc[4][4];
+    for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++) acc[a][b] = _mm512_setzero_pd();
+    int64_t d = 0;
+    for (; d + 8 <= len; d += 8) {
+        __m512d xv[4];
+        for (int b = 0; b < 4; b++) xv[b] = _mm512_loadu_pd(&x[b * D + d]);
+        for (int a = 0; a < 4; a++) {
+            __m512d qv = _mm512_loadu_pd(&q[a * D + d]);
+            for (int b = 0; b < 4; b++) acc[a][b] = _mm512_fmadd_pd(qv, xv[b], acc[a][b]);
+        }
+    }
+    for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++) {
+            type s = _mm512_reduce_add_pd(acc[a][b]);
+            for (int64_t t = d; t < len; t++) s += q[a * D + t] * x[b * D + t];
+            out[a][b] += s;
+        }
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+static inline void dot_4x4(const type* q, const type* x, int64_t D, int64_t len, type out[4][4]) {
+    __m256d acc[4][4];
+    for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++) acc[a][b] = _mm256_setzero_pd();
+    int64_t d = 0;
+    for (; d + 4 <= len; d += 4) {
+        __m256d xv[4];
+        for (int b = 0; b < 4; b++) xv[b] = _mm256_loadu_pd(&x[b * D + d]);
+        for (int a = 0; a < 4; a++) {
+            __m256d qv = _mm256_loadu_pd(&q[a * D + d]);
+            for (int b = 0; b < 4; b++) acc[a][b] = _mm256_fmadd_pd(qv, xv[b], acc[a][b]);
+        }
+    }
+    for (int a = 0; a < 4; a++) {
+        type s[4];
+        _mm256_storeu_pd(s, hsum4(acc[a][0], acc[a][1], acc[a][2], acc[a][3]));
+        for (int b = 0; b < 4; b++) {
+            for (int64_t t = d; t < len; t++) s[b] += q[a * D + t] * x[b * D + t];
+            out[a][b] += s[b];
+        }
+    }
+}
+
+#else
+
+static inline void dot_4x4(const type* q, const type* x, int64_t D, int64_t len, type out[4][4]) {
+    for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++) {
+            type s = 0.0;
+            for (int64_t t = 0; t < len; t++) s += q[a * D + t] * x[b * D + t];
+            out[a][b] += s;
+        }
+}
+
+#endif
+
+
+// Prodotto scalare singolo (bordi dei tile)
+static inline type dot_1x1(const type* q, const type* x, int64_t len) {
+    type s = 0.0;
+    for (int64_t t = 0; t < len; t++) s += q[t] * x[t];
+    return s;
+}
+
+
+// TILE_DOTS - dots[a * xn + b] = Q[a] · X[b] per un tile qn x xn
+static void tile_dots(const type* Q, int64_t qn, const type* X, int64_t xn, int64_t D, type* dots) {
+    memset(dots, 0, qn * xn * sizeof(type));
+    for (int64_t d0 = 0; d0 < D; d0 += EXACT_KC) {
+        int64_t len = D - d0 < EXACT_KC ? D - d0 : EXACT_KC;
+        int64_t a = 0;
+        for (; a + 4 <= qn; a += 4) {
+            int64_t b = 0;
+            for (; b + 4 <= xn; b += 4) {
+                type out[4][4];
+                for (int i = 0; i < 4; i++)
+                    for (int j = 0; j < 4; j++) out[i][j] = dots[(a + i) * xn + b + j];
+                dot_4x4(&Q[a * D + d0], &X[b * D + d0], D, len, out);
+                for (int i = 0; i < 4; i++)
+                    for (int j = 0; j < 4; j++) dots[(a + i) * xn + b + j] = out[i][j];
+            }
+            for (; b < xn; b++)
+                for (int i = 0; i < 4; i++)
+                    dots[(a + i) * xn + b] += dot_1x1(&Q[(a + i) * D + d0], &X[b * D + d0], len);
+        }
+        for (; a < qn; a++)
+            for (int64_t b = 0; b < xn; b++)
+                dots[a * xn + b] += dot_1x1(&Q[a * D + d0], &X[b * D + d0], len);
+    }
+}
+
+
+/*
+ *  KNN_EXACT - K-NN esatti di Q[nq x D] in X[N x D]
+ *
+ *  norms: ||x_i||^2 già calcolate (NULL = calcolate qui).
+ *  ids/dists [nq x k]: vicini ordinati per distanza euclidea crescente.
+ */
+void knn_exact(const type* X, const type* norms, int64_t N, int64_t D,
+               const type* Q, int64_t nq, int k, ID* ids, type* dists) {
+    type* own_norms = NULL;
+    if (norms == NULL) {
+        own_norms = _mm_malloc(N * sizeof(type), align);
+        if (!own_norms) {
+            fprintf(stderr, "Errore allocazione in knn_exact\n");
+            exit(1);
+        }
+        row_norms(X, N, D, own_norms);
+        norms = own_norms;
+    }
+
+    // lavoro: tile di query x fette del dataset (fette solo se le query non bastano)
+    int64_t qtiles = (nq + EXACT_QT - 1) / EXACT_QT;
+    int64_t nchunks = (omp_get_max_threads() + qtiles - 1) / qtiles;
+    int64_t max_chunks = (N + EXACT_XT - 1) / EXACT_XT;
+    if (nchunks > max_chunks) nchunks = max_chunks;
+    if (nchunks < 1) nchunks = 1;
+    int64_t chunk_rows = (N + nchunks - 1) / nchunks;
+
+    // liste parziali [chunk][nq x k]; con una sola fetta si scrive direttamente nell'output
+    ID* part_ids = nchunks > 1 ? malloc(nchunks * nq * k * sizeof(ID)) : ids;
+    type* part_d = nchunks > 1 ? malloc(nchunks * nq * k * sizeof(type)) : dists;
+    if (!part_ids || !part_d) {
+        fprintf(stderr, "Errore allocazione in knn_exact\n");
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        type* dots = _mm_malloc(EXACT_QT * EXACT_XT * sizeof(type), align);
+        type* qnorm = malloc(EXACT_QT * sizeof(type));
+        topk_t lists[EXACT_QT];
+
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int64_t qt = 0; qt < qtiles; qt++) {
+            for (int64_t c = 0; c < nchunks; c++) {
+                int64_t q0 = qt * EXACT_QT;
+                int64_t qn = nq - q0 < EXACT_QT ? nq - q0 : EXACT_QT;
+                int64_t x0 = c * chunk_rows;
+                int64_t x1 = x0 + chunk_rows < N ? x0 + chunk_rows : N;
+                ID* out_ids = &part_ids[(c * nq + q0) * k];
+                type* out_d = &part_d[(c * nq + q0) * k];
+
+                for (int64_t a = 0; a < qn; a++) {
+                    qnorm[a] = dot_1x1(&Q[(q0 + a) * D], &Q[(q0 + a) * D], D);
+                    topk_init(&lists[a], &out_ids[a * k], &out_d[a * k], k);
+                }
+
+                for (int64_t b0 = x0; b0 < x1; b0 += EXACT_XT) {
+                    int64_t xn = x1 - b0 < EXACT_XT ? x1 - b0 : EXACT_XT;
+                    tile_dots(&Q[q0 * D], qn, &X[b0 * D], xn, D, dots);
+
+                    // selezione fusa: distanze al quadrato del tile nelle liste delle query
+                    for (int64_t a = 0; a < qn; a++) {
+                        topk_t* top = &lists[a];
+                        type bound = topk_bound(top);
+                        for (int64_t b = 0; b < xn; b++) {
+                            type d2 = qnorm[a] + norms[b0 + b] - 2.0 * dots[a * xn + b];
+                            if (d2 < bound) {
+                                topk_push(top, d2, b0 + b);
+                                bound = topk_bound(top);
+                            }
+                        }
+                    }
+                }
+
+                for (int64_t a = 0; a < qn; a++) topk_finish(&lists[a]);
+            }
+        }
+
+        _mm_free(dots);
+        free(qnorm);
+    }
+
+    // fusione delle liste parziali e distanze finali esatte
+    #pragma omp parallel for schedule(static)
+    for (int64_t qi = 0; qi < nq; qi++) {
+        ID* li = &ids[qi * k];
+        type* ld = &dists[qi * k];
+        if (nchunks > 1) {
+            topk_t top;
+            topk_init(&top, li, ld, k);
+            for (int64_t c = 0; c < nchunks; c++)
+                for (int i = 0; i < k; i++)
+                    if (part_ids[(c * nq + qi) * k + i] >= 0)
+                        topk_push(&top, part_d[(c * nq + qi) * k + i], part_ids[(c * nq + qi) * k + i]);
+            topk_finish(&top);
+        }
+        euclidean_distances(&Q[qi * D], X, li, k, D, ld);
+        sort_knn(li, ld, k);
+    }
+
+    if (nchunks > 1) {
+        free(part_ids);
+        free(part_d);
+    }
+    _mm_free(own_norms);
+}
+
+
+// PREDICT_EXACT - Modalità esatta di predict(): forza bruta GEMM sul dataset in memoria
+void predict_exact(params* input) {
+    if (input->DS == NULL) {
+        fprintf(stderr, "Errore: la modalità esatta richiede il dataset in memoria\n");
+        exit(1);
+    }
+
+    // norme delle righe calcolate alla prima predict esatta e tenute nell'indice
+    if (input->norms == NULL) {
+        input->norms = _mm_malloc(input->N * sizeof(type), align);
+        if (!input->norms) {
+            fprintf(stderr, "Errore allocazione norme\n");
+            exit(1);
+        }
+        row_norms(input->DS, input->N, input->D, input->norms);
+    }
+
+    knn_exact(input->DS, input->norms, input->N, input->D, input->Q, input->nq,
+              input->k, input->id_nn, input->dist_nn);
+}
@@ -0,0 +1,133 @@
+/*
+ *  Dataset a mezza precisione (FP16 / BF16) per il raffinamento
+ *
+ *  I vettori completi servono solo al raffinamento finale: tenerli a 16 bit
+ *  riduce la memoria del dataset di 4 volte rispetto ai double. Il kernel
+ *  converte le righe al volo (F16C per FP16, shift di 16 bit per BF16),
+ *  sottrae la query in double e accumula in double. L'errore è quindi solo
+ *  quello di arrotondamento del dato memorizzato: 11 bit di mantissa per
+ *  FP16 (range ±65504), 8 per BF16 (range del float).
+ *
+ *  Due modi per ottenerlo:
+ *  - compact_dataset(): converte input->DS dopo fit() e, se richiesto, lo
+ *    rilascia
+ *  - fit_file() su un .ds3 f16/bf16: input->DS_half punta al payload mappato,
+ *    senza copie
+ */
+
+
+// Somme parziali su [d0, d1) per 4 righe a 16 bit (dtype DS3_F16 o DS3_BF16), accumulate in s
+static inline void sqdist_block4_half(const type* q, const uint16_t* const r[4], uint32_t dtype,
+                                      int64_t d0, int64_t d1, type s[4]) {
+    int64_t d = d0;
+    int bf16 = dtype == DS3_BF16;
+#if defined(__AVX512F__) && defined(__F16C__)
+    __m512d acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm512_setzero_pd();
+    for (; d + 8 <= d1; d += 8) {
+        __m512d qv = _mm512_loadu_pd(&q[d]);
+        for (int b = 0; b < 4; b++) {
+            __m128i raw = _mm_loadu_si128((const __m128i*)&r[b][d]);
+            __m256 f = bf16 ? _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16))
+                            : _mm256_cvtph_ps(raw);
+            __m512d diff = _mm512_sub_pd(_mm512_cvtps_pd(f), qv);
+            acc[b] = _mm512_fmadd_pd(diff, diff, acc[b]);
+        }
+    }
+    __m256d half[4];
+    for (int b = 0; b < 4; b++)
+        half[b] = _mm256_add_pd(_mm512_castpd512_pd256(acc[b]), _mm512_extractf64x4_pd(acc[b], 1));
+    _mm256_storeu_pd(s, _mm256_add_pd(_mm256_loadu_pd(s), hsum4(half[0], half[1], half[2], half[3])));
+#elif defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+    __m256d acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm256_setzero_pd();
+    for (; d + 4 <= d1; d += 4) {
+        __m256d qv = _mm256_loadu_pd(&q[d]);
+        for (int b = 0; b < 4; b++) {
+            __m128i raw = _mm_loadl_epi64((const __m128i*)&r[b][d]);
+            __m128 f = bf16 ? _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepu16_epi32(raw), 16))
+                            : _mm_cvtph_ps(raw);
+            __m256d diff = _mm256_sub_pd(_mm256_cvtps_pd(f), qv);
+            acc[b] = _mm256_fmadd_pd(diff, diff, acc[b]);
+        }
+    }
+    _mm256_storeu_pd(s, _mm256_add_pd(_mm256_loadu_pd(s), hsum4(acc[0], acc[1], acc[2], acc[3])));
+#endif
+    for (; d < d1; d++)
+        for (int b = 0; b < 4; b++) {
+            type v = bf16 ? bf16_to_float(r[b][d]) : half_to_float(r[b][d]);
+            type diff = v - q[d];
+            s[b] += diff * diff;
+        }
+}
+
+
+// HALF_ROWS - Converte in type le n righe ids di input->DS_half (es. i pivot)
+static void half_rows(const params* input, const ID* ids, int64_t n, type* dst) {
+    const uint16_t* H = input->DS_half;
+    for (int64_t i = 0; i < n; i++)
+        for (int64_t d = 0; d < input->D; d++) {
+            uint16_t v = H[ids[i] * input->D + d];
+            dst[i * input->D + d] = input->half_dtype == DS3_BF16 ? bf16_to_float(v) : half_to_float(v);
+        }
+}
+
+
+// DATASET_ROW - Riga i come type: in DS o convertita da DS_half in buf [D]
+static inline const type* dataset_row(const params* input, int64_t i, type* buf) {
+    if (input->DS != NULL) return &input->DS[i * input->D];
+    ID id = i;
+    half_rows(input, &id, 1, buf);
+    return buf;
+}
+
+
+/*
+ *  COMPACT_DATASET - Copia input->DS in input->DS_half (dtype DS3_F16 o
+ *  DS3_BF16); da qui in poi il raffinamento usa la copia a 16 bit.
+ *  Con release != 0 input->DS viene scollegato (e smappato se proviene da
+ *  fit_file()): il chiamante può liberarlo. La modalità esatta e autotune()
+ *  richiedono DS e non sono più disponibili.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int compact_dataset(params* input, uint32_t dtype, int release) {
+    if (dtype != DS3_F16 && dtype != DS3_BF16) {
+        fprintf(stderr, "Errore compact_dataset: dtype %u non supportato (solo f16 o bf16)\n", dtype);
+        return -1;
+    }
+    if (input->DS == NULL) {
+        fprintf(stderr, "Errore compact_dataset: dataset in memoria non disponibile\n");
+        return -1;
+    }
+
+    size_t count = (size_t)input->N * input->D;
+    uint16_t* H = _mm_malloc(count * sizeof(uint16_t), align);
+    if (!H) {
+        fprintf(stderr, "Errore allocazione in compact_dataset\n");
+        exit(1);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; i++)
+        H[i] = dtype == DS3_BF16 ? float_to_bf16((float)input->DS[i]) : float_to_half((float)input->DS[i]);
+
+    if (input->DS_half != NULL && input->half_owned) _mm_free(input->DS_half);
+    input->DS_half = H;
+    input->half_dtype = dtype;
+    input->half_owned = 1;
+
+    if (release) {
+        if (input->ds_base != NULL) {
+            munmap(input->ds_base, input->ds_size);
+            input->ds_base = NULL;
+            input->ds_size = 0;
+        }
+        input->DS = NULL;
+    }
+
+    if (!input->silent)
+        printf("[HALF] Dataset a 16 bit (%s): %.1f MiB invece di %.1f MiB\n",
+               dtype == DS3_BF16 ? "bf16" : "f16",
+               count * sizeof(uint16_t) / 1048576.0, count * sizeof(type) / 1048576.0);
+    return 0;
+}
@@ -0,0 +1,450 @@
+/*
+ *  Motore HNSW: grafo di prossimità gerarchico
+ *
+ *  La scansione dell'indice a pivot è lineare in N. Con mode = MODE_HNSW
+ *  fit() costruisce invece un grafo a livelli (Malkov & Yashunin): ogni
+ *  punto riceve un livello casuale con probabilità geometrica, al livello 0
+ *  ha al più 2*hnsw_m vicini, sopra al più hnsw_m. predict() scende dal
+ *  punto d'ingresso con una ricerca greedy fino al livello 1 e al livello 0
+ *  esplora i ef = max(hnsw_ef_search, pool_size()) candidati migliori:
+ *  il costo per query è circa logaritmico in N.
+ *
+ *  Layout compatto delle adiacenze, una riga per nodo:
+ *  - livello 0: hnsw_links0 [N x (2M + 1)], posizione 0 = numero di vicini
+ *  - livelli >= 1: hnsw_links, blocchi di (M + 1) a partire da
+ *    hnsw_link_off[i] (solo per i nodi con livello > 0)
+ *  Le distanze sono quelle del raffinamento (sqdist_block4, 4 righe per
+ *  volta, sul dataset double o a 16 bit) e al quadrato fino al risultato.
+ *
+ *  La costruzione inserisce i punti in parallelo: ogni nodo ha un lock che
+ *  protegge la sua lista di vicini (copiata sotto lock durante le ricerche),
+ *  il punto d'ingresso cambia in una sezione critica.
+ */
+
+#define HNSW_M_DEFAULT      16      // vicini per livello >= 1 (2M al livello 0)
+#define HNSW_EFC_DEFAULT    200     // candidati esplorati durante l'inserimento
+#define HNSW_EFS_DEFAULT    64      // candidati esplorati in predict()
+#define HNSW_MAX_LEVEL      32      // livello massimo (irraggiungibile in pratica)
+
+
+// Vicini massimi e lista del nodo i al livello l
+static inline int hnsw_max_degree(const params* input, int l) {
+    return l == 0 ? 2 * input->hnsw_m : input->hnsw_m;
+}
+
+static inline ID* hnsw_list(const params* input, ID i, int l) {
+    if (l == 0) return &input->hnsw_links0[(int64_t)i * (2 * input->hnsw_m + 1)];
+    return &input->hnsw_links[input->hnsw_link_off[i] + (int64_t)(l - 1) * (input->hnsw_m + 1)];
+}
+
+
+// Distanze al quadrato da q alle righe ids[0..n) del dataset (DS o DS_half)
+static void hnsw_dists(const params* input, const type* q, const ID* ids, int n, type* out) {
+    int64_t D = input->D;
+    int half = input->DS == NULL;
+    const uint8_t* base = half ? (const uint8_t*)input->DS_half : (const uint8_t*)input->DS;
+    size_t row_bytes = D * (half ? sizeof(uint16_t) : sizeof(type));
+
+    for (int i = 0; i < n && i < REFINE_AHEAD; i++)
+        prefetch_row(base + ids[i] * row_bytes, row_bytes);
+    for (int i = 0; i < n; i += 4) {
+        const void* r[4];
+        type s[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int b = 0; b < 4; b++)
+            r[b] = i + b < n ? base + ids[i + b] * row_bytes : (const void*)q;
+        for (int b = i + REFINE_AHEAD; b < i + REFINE_AHEAD + 4 && b < n; b++)
+            prefetch_row(base + ids[b] * row_bytes, row_bytes);
+        if (half) sqdist_block4_half(q, (const uint16_t* const*)r, input->half_dtype, 0, D, s);
+        else sqdist_block4(q, (const type* const*)r, 0, D, s);
+        for (int b = 0; b < 4 && i + b < n; b++) out[i + b] = s[b];
+    }
+}
+
+
+// Stato di ricerca di un thread: nodi visitati (marcati con un'epoca) e code
+typedef struct {
+    uint16_t* visited;          // [N], visitato se == epoch
+    uint16_t epoch;
+    ID* cand_ids;               // min-heap dei candidati da espandere
+    type* cand_d;
+    int cand_cap;
+    ID* nbr;                    // vicini da valutare [2M]
+    type* nbr_d;
+    ID* w_ids;                  // insieme dei risultati (topk_t) [ef]
+    type* w_d;
+    type* row;                  // riga convertita da DS_half [D]
+} hnsw_ctx;
+
+static void hnsw_ctx_init(const params* input, hnsw_ctx* c, int ef) {
+    c->visited = calloc(input->N, sizeof(uint16_t));
+    c->epoch = 0;
+    c->cand_cap = ef + 2 * input->hnsw_m + 1;
+    c->cand_ids = malloc(c->cand_cap * sizeof(ID));
+    c->cand_d = malloc(c->cand_cap * sizeof(type));
+    c->nbr = malloc(2 * input->hnsw_m * sizeof(ID));
+    c->nbr_d = malloc(2 * input->hnsw_m * sizeof(type));
+    c->w_ids = malloc(ef * sizeof(ID));
+    c->w_d = malloc(ef * sizeof(type));
+    c->row = malloc(input->D * sizeof(type));
+    if (!c->visited || !c->cand_ids || !c->cand_d || !c->nbr || !c->nbr_d ||
+        !c->w_ids || !c->w_d || !c->row) {
+        fprintf(stderr, "Errore allocazione in hnsw_ctx_init\n");
+        exit(1);
+    }
+}
+
+static void hnsw_ctx_free(hnsw_ctx* c) {
+    free(c->visited);
+    free(c->cand_ids);
+    free(c->cand_d);
+    free(c->nbr);
+    free(c->nbr_d);
+    free(c->w_ids);
+    free(c->w_d);
+    free(c->row);
+}
+
+// Nuova epoca: azzera i visitati solo quando il contatore ricomincia
+static inline void hnsw_new_epoch(const params* input, hnsw_ctx* c) {
+    if (++c->epoch == 0) {
+        memset(c->visited, 0, input->N * sizeof(uint16_t));
+        c->epoch = 1;
+    }
+}
+
+
+// Min-heap dei candidati (distanza crescente), cresce se serve
+static inline void cand_push(hnsw_ctx* c, int* n, type d, ID id) {
+    if (*n == c->cand_cap) {
+        c->cand_cap *= 2;
+        c->cand_ids = realloc(c->cand_ids, c->cand_cap * sizeof(ID));
+        c->cand_d = realloc(c->cand_d, c->cand_cap * sizeof(type));
+        if (!c->cand_ids || !c->cand_d) {
+            fprintf(stderr, "Errore allocazione in cand_push\n");
+            exit(1);
+        }
+    }
+    int i = (*n)++;
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (c->cand_d[p] <= d) break;
+        c->cand_d[i] = c->cand_d[p];
+        c->cand_ids[i] = c->cand_ids[p];
+        i = p;
+    }
+    c->cand_d[i] = d;
+    c->cand_ids[i] = id;
+}
+
+static inline void cand_pop(hnsw_ctx* c, int* n) {
+    type d = c->cand_d[--(*n)];
+    ID id = c->cand_ids[*n];
+    int i = 0;
+    for (;;) {
+        int ch = 2 * i + 1;
+        if (ch >= *n) break;
+        if (ch + 1 < *n && c->cand_d[ch + 1] < c->cand_d[ch]) ch++;
+        if (d <= c->cand_d[ch]) break;
+        c->cand_d[i] = c->cand_d[ch];
+        c->cand_ids[i] = c->cand_ids[ch];
+        i = ch;
+    }
+    c->cand_d[i] = d;
+    c->cand_ids[i] = id;
+}
+
+
+// Copia della lista del nodo id al livello l (sotto lock durante la costruzione)
+static inline int hnsw_read_list(const params* input, omp_lock_t* locks, ID id, int l, ID* dst) {
+    if (locks) omp_set_lock(&locks[id]);
+    const ID* list = hnsw_list(input, id, l);
+    int n = list[0];
+    memcpy(dst, &list[1], n * sizeof(ID));
+    if (locks) omp_unset_lock(&locks[id]);
+    return n;
+}
+
+
+/*
+ *  HNSW_SEARCH_LAYER - I ef nodi più vicini a q al livello l partendo dai
+ *  nep punti (ep_ids, ep_d). Risultato in c->w_ids/w_d, ordinato per
+ *  distanza crescente; restituisce quanti sono.
+ */
+static int hnsw_search_layer(const params* input, omp_lock_t* locks, hnsw_ctx* c, const type* q,
+                             const ID* ep_ids, const type* ep_d, int nep, int ef, int l) {
+    topk_t w;
+    int ncand = 0;
+    topk_init(&w, c->w_ids, c->w_d, ef);
+    hnsw_new_epoch(input, c);
+    for (int i = 0; i < nep; i++) {
+        c->visited[ep_ids[i]] = c->epoch;
+        cand_push(c, &ncand, ep_d[i], ep_ids[i]);
+        topk_push(&w, ep_d[i], ep_ids[i]);
+    }
+
+    while (ncand > 0) {
+        type d = c->cand_d[0];
+        ID id = c->cand_ids[0];
+        if (d > topk_bound(&w)) break;
+        cand_pop(c, &ncand);
+
+        // vicini non ancora visitati, distanze calcolate insieme (4 righe per volta)
+        int n = hnsw_read_list(input, locks, id, l, c->nbr);
+        int u = 0;
+        for (int j = 0; j < n; j++)
+            if (c->visited[c->nbr[j]] != c->epoch) {
+                c->visited[c->nbr[j]] = c->epoch;
+                c->nbr[u++] = c->nbr[j];
+            }
+        hnsw_dists(input, q, c->nbr, u, c->nbr_d);
+        for (int j = 0; j < u; j++) {
+            if (c->nbr_d[j] < topk_bound(&w)) {
+                cand_push(c, &ncand, c->nbr_d[j], c->nbr[j]);
+                topk_push(&w, c->nbr_d[j], c->nbr[j]);
+            }
+        }
+    }
+    topk_finish(&w);
+    return w.n;
+}
+
+
+// Discesa greedy (ef = 1) dal livello top al livello stop + 1
+static ID hnsw_greedy(const params* input, omp_lock_t* locks, hnsw_ctx* c, const type* q,
+                      ID ep, type* ep_d, int top, int stop) {
+    for (int l = top; l > stop; l--) {
+        int changed = 1;
+        while (changed) {
+            changed = 0;
+            int n = hnsw_read_list(input, locks, ep, l, c->nbr);
+            hnsw_dists(input, q, c->nbr, n, c->nbr_d);
+            for (int j = 0; j < n; j++)
+                if (c->nbr_d[j] < *ep_d) {
+                    *ep_d = c->nbr_d[j];
+                    ep = c->nbr[j];
+                    changed = 1;
+                }
+        }
+    }
+    return ep;
+}
+
+
+/*
+ *  Euristica di selezione dei vicini: tra i candidati (distanza crescente
+ *  da q) si tiene e solo se è più vicino a q che a ogni vicino già scelto,
+ *  così le liste coprono direzioni diverse. Al più max_n, in place;
+ *  restituisce quanti.
+ */
+static int hnsw_select(const params* input, hnsw_ctx* c, ID* ids, type* d, int n, int max_n) {
+    int kept = 0;
+    type dr;
+    for (int i = 0; i < n && kept < max_n; i++) {
+        const type* e = dataset_row(input, ids[i], c->row);
+        int good = 1;
+        for (int j = 0; j < kept && good; j++) {
+            hnsw_dists(input, e, &ids[j], 1, &dr);
+            if (dr < d[i]) good = 0;
+        }
+        if (good) {
+            ids[kept] = ids[i];
+            d[kept++] = d[i];
+        }
+    }
+    return kept;
+}
+
+
+// Aggiunge il collegamento nb -> id al livello l (lista piena: nuova selezione)
+static void hnsw_connect(const params* input, omp_lock_t* locks, hnsw_ctx* c, ID nb, ID id,
+                         type d, int l, ID* tmp_ids, type* tmp_d) {
+    int max_n = hnsw_max_degree(input, l);
+    omp_set_lock(&locks[nb]);
+    ID* list = hnsw_list(input, nb, l);
+    if (list[0] < max_n) {
+        list[1 + list[0]++] = id;
+    } else {
+        // vicini attuali più il nuovo, ordinati per distanza da nb
+        const type* r = dataset_row(input, nb, c->row);
+        memcpy(tmp_ids, &list[1], max_n * sizeof(ID));
+        tmp_ids[max_n] = id;
+        hnsw_dists(input, r, tmp_ids, max_n, tmp_d);
+        tmp_d[max_n] = d;
+        sort_knn(tmp_ids, tmp_d, max_n + 1);
+        list[0] = hnsw_select(input, c, tmp_ids, tmp_d, max_n + 1, max_n);
+        memcpy(&list[1], tmp_ids, list[0] * sizeof(ID));
+    }
+    omp_unset_lock(&locks[nb]);
+}
+
+
+/*
+ *  FIT_HNSW - Costruisce il grafo su DS (o DS_half). Livelli estratti in
+ *  sequenza dal seme input->seed (deterministici), inserimenti in parallelo.
+ */
+void fit_hnsw(params* input) {
+    int64_t N = input->N;
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore fit_hnsw: dataset in memoria non disponibile\n");
+        exit(1);
+    }
+    if (N > ID_MAX) {
+        fprintf(stderr, "Errore: N=%ld non rappresentabile negli ID, ricompilare con -DID64\n", N);
+        exit(1);
+    }
+    if (input->hnsw_m <= 1) input->hnsw_m = HNSW_M_DEFAULT;
+    if (input->hnsw_ef_construction <= 0) input->hnsw_ef_construction = HNSW_EFC_DEFAULT;
+    int M = input->hnsw_m;
+    int efc = input->hnsw_ef_construction > M ? input->hnsw_ef_construction : M;
+
+    // livelli: floor(-ln(U) / ln(M)), offset delle liste superiori
+    input->hnsw_level = malloc(N * sizeof(uint8_t));
+    input->hnsw_link_off = malloc(N * sizeof(int64_t));
+    if (!input->hnsw_level || !input->hnsw_link_off) {
+        fprintf(stderr, "Errore allocazione in fit_hnsw\n");
+        exit(1);
+    }
+    uint64_t state = input->seed;
+    double ml = 1.0 / log((double)M);
+    int64_t upper = 0;
+    for (int64_t i = 0; i < N; i++) {
+        int l = (int)(-log(rand_unit(&state)) * ml);
+        input->hnsw_level[i] = l < HNSW_MAX_LEVEL ? l : HNSW_MAX_LEVEL;
+        input->hnsw_link_off[i] = upper;
+        upper += (int64_t)input->hnsw_level[i] * (M + 1);
+    }
+
+    input->hnsw_links0 = _mm_malloc(N * (2 * M + 1) * sizeof(ID), align);
+    input->hnsw_links = _mm_malloc((upper > 0 ? upper : 1) * sizeof(ID), align);
+    omp_lock_t* locks = malloc(N * sizeof(omp_lock_t));
+    if (!input->hnsw_links0 || !input->hnsw_links || !locks) {
+        fprintf(stderr, "Errore allocazione in fit_hnsw\n");
+        exit(1);
+    }
+    for (int64_t i = 0; i < N; i++) {
+        input->hnsw_links0[i * (2 * M + 1)] = 0;
+        for (int l = 1; l <= input->hnsw_level[i]; l++) hnsw_list(input, i, l)[0] = 0;
+        omp_init_lock(&locks[i]);
+    }
+
+    if (!input->silent)
+        printf("[FIT] Grafo HNSW: N=%ld, M=%d, efConstruction=%d, %.1f MiB di adiacenze\n",
+               N, M, efc, (N * (2 * M + 1) + upper) * sizeof(ID) / 1048576.0);
+
+    input->hnsw_entry = 0;
+    input->hnsw_max_level = input->hnsw_level[0];
+
+    #pragma omp parallel
+    {
+        hnsw_ctx c;
+        hnsw_ctx_init(input, &c, efc);
+        type* q_buf = malloc(input->D * sizeof(type));
+        ID* sel_ids = malloc((efc + 1) * sizeof(ID));
+        type* sel_d = malloc((efc + 1) * sizeof(type));
+        ID* tmp_ids = malloc((2 * M + 1) * sizeof(ID));
+        type* tmp_d = malloc((2 * M + 1) * sizeof(type));
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int64_t i = 1; i < N; i++) {
+            const type* q = dataset_row(input, i, q_buf);
+            int li = input->hnsw_level[i];
+            ID ep;
+            int top;
+            #pragma omp critical(hnsw_entry)
+            {
+                ep = input->hnsw_entry;
+                top = input->hnsw_max_level;
+            }
+
+            type ep_d;
+            hnsw_dists(input, q, &ep, 1, &ep_d);
+            ep = hnsw_greedy(input, locks, &c, q, ep, &ep_d, top, li);
+
+            // dal livello min(li, top) in giù: ef candidati, poi i vicini scelti
+            ID* eps = &ep;
+            type* eps_d = &ep_d;
+            int nep = 1;
+            for (int l = li < top ? li : top; l >= 0; l--) {
+                int n = hnsw_search_layer(input, locks, &c, q, eps, eps_d, nep, efc, l);
+                memcpy(sel_ids, c.w_ids, n * sizeof(ID));
+                memcpy(sel_d, c.w_d, n * sizeof(type));
+                int kept = hnsw_select(input, &c, sel_ids, sel_d, n, M);
+
+                omp_set_lock(&locks[i]);
+                ID* list = hnsw_list(input, i, l);
+                list[0] = kept;
+                memcpy(&list[1], sel_ids, kept * sizeof(ID));
+                omp_unset_lock(&locks[i]);
+                for (int j = 0; j < kept; j++)
+                    hnsw_connect(input, locks, &c, sel_ids[j], i, sel_d[j], l, tmp_ids, tmp_d);
+
+                // i risultati di questo livello sono i punti d'ingresso del successivo
+                memcpy(sel_ids, c.w_ids, n * sizeof(ID));
+                memcpy(sel_d, c.w_d, n * sizeof(type));
+                eps = sel_ids;
+                eps_d = sel_d;
+                nep = n;
+            }
+
+            if (li > top) {
+                #pragma omp critical(hnsw_entry)
+                if (li > input->hnsw_max_level) {
+                    input->hnsw_max_level = li;
+                    input->hnsw_entry = i;
+                }
+            }
+        }
+
+        hnsw_ctx_free(&c);
+        free(q_buf);
+        free(sel_ids);
+        free(sel_d);
+        free(tmp_ids);
+        free(tmp_d);
+    }
+
+    for (int64_t i = 0; i < N; i++) omp_destroy_lock(&locks[i]);
+    free(locks);
+
+    if (!input->silent)
+        printf("[FIT] Completato! Livelli: %d, picco RSS: %.1f MiB\n",
+               input->hnsw_max_level + 1, peak_rss() / 1048576.0);
+}
+
+
+// PREDICT_HNSW - Modalità HNSW di predict(): discesa greedy e ricerca al livello 0
+void predict_hnsw(params* input) {
+    if (input->hnsw_links0 == NULL) {
+        fprintf(stderr, "Errore: grafo HNSW non costruito, chiamare fit() con mode = MODE_HNSW\n");
+        exit(1);
+    }
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore: la modalità HNSW richiede il dataset in memoria\n");
+        exit(1);
+    }
+    int k = input->k;
+    int ef = input->hnsw_ef_search > 0 ? input->hnsw_ef_search : HNSW_EFS_DEFAULT;
+    if (ef < pool_size(input)) ef = pool_size(input);
+
+    #pragma omp parallel
+    {
+        hnsw_ctx c;
+        hnsw_ctx_init(input, &c, ef);
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t qi = 0; qi < input->nq; qi++) {
+            const type* q = &input->Q[qi * input->D];
+            ID ep = input->hnsw_entry;
+            type ep_d;
+            hnsw_dists(input, q, &ep, 1, &ep_d);
+            ep = hnsw_greedy(input, NULL, &c, q, ep, &ep_d, input->hnsw_max_level, 0);
+            int n = hnsw_search_layer(input, NULL, &c, q, &ep, &ep_d, 1, ef, 0);
+            for (int i = 0; i < k; i++) {
+                input->id_nn[qi * k + i] = i < n ? c.w_ids[i] : -1;
+                input->dist_nn[qi * k + i] = i < n ? sqrt(c.w_d[i]) : INFINITY;
+            }
+        }
+
+        hnsw_ctx_free(&c);
+    }
+}
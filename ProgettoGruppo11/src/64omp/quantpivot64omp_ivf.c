@@ -0,0 +1,228 @@
+/*
+ *  Motore IVF: liste invertite sopra l'indice a pivot
+ *
+ *  La scansione di predict() visita tutte le N righe della tabella dei
+ *  pivot per ogni query. Con mode = MODE_IVF fit() addestra prima ivf_nlist
+ *  centroidi grossolani (k-means sul campione, assegnamenti con il GEMM di
+ *  knn_exact()) e ordina le righe per lista: tabella [N x h] e codici sono
+ *  costruiti in quest'ordine, quindi ogni lista è un intervallo contiguo
+ *  [ivf_offsets[c], ivf_offsets[c+1]) e ivf_ids riporta la posizione
+ *  all'ID originale.
+ *
+ *  In predict() ogni query sceglie le ivf_nprobe liste con il centroide più
+ *  vicino (norme dei centroidi ivf_norms calcolate da fit()) e dentro ognuna esegue la stessa scansione di scan_block() (bound
+ *  sui pivot e approx_distance()): il costo scende da N a circa
+ *  N * nprobe / nlist righe per query. Cascata, filtro int8 e raffinamento
+ *  ricevono gli ID originali e non cambiano.
+ */
+
+#define IVF_TRAIN_PER_LIST  64          // righe di addestramento per lista
+#define IVF_ITERS           10          // iterazioni di k-means predefinite
+
+static void row_norms(const type* X, int64_t n, int64_t D, type* norms);     // quantpivot64omp_exact.c
+
+// Liste visitate per query: ivf_nprobe (<= 0: 1/16 delle liste), tra 1 e ivf_nlist
+static inline int ivf_nprobe(const params* input) {
+    int p = input->ivf_nprobe > 0 ? input->ivf_nprobe : input->ivf_nlist / 16;
+    if (p < 1) p = 1;
+    return p < input->ivf_nlist ? p : input->ivf_nlist;
+}
+
+
+/*
+ *  IVF_PARTITION - Centroidi grossolani e ordinamento delle righe per lista
+ *  (ivf_centroids, ivf_norms, ivf_offsets, ivf_ids). Richiede input->DS; fit() usa poi
+ *  ivf_ids per costruire tabella e codici lista per lista.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int ivf_partition(params* input) {
+    int64_t N = input->N, D = input->D;
+    int nlist = input->ivf_nlist;
+    if (input->DS == NULL) {
+        fprintf(stderr, "Errore ivf_partition: dataset in memoria non disponibile\n");
+        return -1;
+    }
+    if (nlist <= 0 || nlist > N) {
+        fprintf(stderr, "Errore ivf_partition: ivf_nlist=%d non valido (1..N=%ld)\n", nlist, N);
+        return -1;
+    }
+    int iters = input->ivf_iters > 0 ? input->ivf_iters : IVF_ITERS;
+    int64_t s = (int64_t)IVF_TRAIN_PER_LIST * nlist;
+    if (s > N) s = N;
+
+    if (!input->silent)
+        printf("[IVF] %d liste, k-means con %d iterazioni su %ld righe...\n", nlist, iters, s);
+
+    type* C = _mm_malloc((size_t)nlist * D * sizeof(type), align);
+    type* sample = _mm_malloc(s * D * sizeof(type), align);
+    int64_t* count = malloc((nlist + 1) * sizeof(int64_t));
+    int64_t* first = malloc((nlist + 1) * sizeof(int64_t));
+    int64_t* order = malloc(s * sizeof(int64_t));
+    ID* assign = malloc(N * sizeof(ID));
+    type* dist = malloc(N * sizeof(type));
+    if (!C || !sample || !count || !first || !order || !assign || !dist) {
+        fprintf(stderr, "Errore allocazione in ivf_partition\n");
+        exit(1);
+    }
+
+    // campione a passo uniforme, centroidi iniziali a passo uniforme nel campione
+    #pragma omp parallel for schedule(static)
+    for (int64_t r = 0; r < s; r++)
+        memcpy(&sample[r * D], &input->DS[(r * N / s) * D], D * sizeof(type));
+    for (int c = 0; c < nlist; c++)
+        memcpy(&C[c * D], &sample[(c * s / nlist) * D], D * sizeof(type));
+
+    for (int it = 0; it < iters; it++) {
+        // assegnamento: centroide più vicino con il GEMM della modalità esatta
+        knn_exact(C, NULL, nlist, D, sample, s, 1, assign, dist);
+
+        // righe del campione raggruppate per lista (O(s)), in ordine crescente in ogni lista
+        memset(first, 0, (nlist + 1) * sizeof(int64_t));
+        for (int64_t r = 0; r < s; r++) first[assign[r] + 1]++;
+        for (int c = 0; c < nlist; c++) first[c + 1] += first[c];
+        memcpy(count, first, nlist * sizeof(int64_t));
+        for (int64_t r = 0; r < s; r++) order[count[assign[r]]++] = r;
+
+        // aggiornamento O(s x D) in parallelo sulle liste: ogni centroide è la somma
+        // delle sue righe nello stesso ordine della versione sequenziale, quindi
+        // lo stesso risultato con qualsiasi numero di thread
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < nlist; c++) {
+            count[c] = first[c + 1] - first[c];
+            if (count[c] == 0) continue;
+            type* cv = &C[c * D];
+            memset(cv, 0, D * sizeof(type));
+            for (int64_t t = first[c]; t < first[c + 1]; t++)
+                for (int64_t d = 0; d < D; d++) cv[d] += sample[order[t] * D + d];
+            for (int64_t d = 0; d < D; d++) cv[d] /= count[c];
+        }
+
+        // liste vuote: metà della lista più numerosa, con il centroide spostato di poco
+        for (int c = 0; c < nlist; c++) {
+            if (count[c] > 0) continue;
+            int big = 0;
+            for (int b = 1; b < nlist; b++)
+                if (count[b] > count[big]) big = b;
+            for (int64_t d = 0; d < D; d++) {
+                type v = C[big * D + d];
+                C[c * D + d] = v * (1.0 + 1.0 / 1024) + (d % 2 ? 1e-7 : -1e-7);
+                C[big * D + d] = v * (1.0 - 1.0 / 1024);
+            }
+            count[c] = count[big] / 2;
+            count[big] -= count[c];
+        }
+    }
+    _mm_free(sample);
+    free(first);
+    free(order);
+
+    // norme dei centroidi finali: servono qui e a ogni query di predict()
+    type* norms = _mm_malloc(nlist * sizeof(type), align);
+    if (!norms) {
+        fprintf(stderr, "Errore allocazione in ivf_partition\n");
+        exit(1);
+    }
+    row_norms(C, nlist, D, norms);
+
+    // tutte le righe nelle liste, poi ordinamento per conteggio (stabile: ID crescenti in ogni lista)
+    knn_exact(C, norms, nlist, D, input->DS, N, 1, assign, dist);
+    free(dist);
+
+    int64_t* offsets = malloc((nlist + 1) * sizeof(int64_t));
+    ID* ids = _mm_malloc(N * sizeof(ID), align);
+    if (!offsets || !ids) {
+        fprintf(stderr, "Errore allocazione in ivf_partition\n");
+        exit(1);
+    }
+    memset(count, 0, (nlist + 1) * sizeof(int64_t));
+    for (int64_t i = 0; i < N; i++) count[assign[i] + 1]++;
+    for (int c = 0; c < nlist; c++) count[c + 1] += count[c];
+    memcpy(offsets, count, (nlist + 1) * sizeof(int64_t));
+    for (int64_t i = 0; i < N; i++) ids[count[assign[i]]++] = i;
+    free(count);
+    free(assign);
+
+    input->ivf_centroids = C;
+    input->ivf_norms = norms;
+    input->ivf_offsets = offsets;
+    input->ivf_ids = ids;
+
+    if (!input->silent) {
+        int64_t largest = 0;
+        for (int c = 0; c < nlist; c++)
+            if (offsets[c + 1] - offsets[c] > largest) largest = offsets[c + 1] - offsets[c];
+        printf("[IVF] Liste: media %.1f righe, massima %ld\n", (double)N / nlist, largest);
+    }
+    return 0;
+}
+
+
+/*
+ *  IVF_PROBE - Le nprobe liste con il centroide più vicino a q, in ordine di
+ *  distanza (||q||^2 + ||c||^2 - 2 q·c con le norme di fit()). Gira nel
+ *  thread del chiamante: nlist x D operazioni, poche rispetto alla scansione.
+ */
+static void ivf_probe(const params* input, const type* q, int nprobe, ID* probe, type* probe_d) {
+    int64_t D = input->D;
+    type qn = 0.0;
+    for (int64_t d = 0; d < D; d++) qn += q[d] * q[d];
+
+    topk_t top;
+    topk_init(&top, probe, probe_d, nprobe);
+    for (int c = 0; c < input->ivf_nlist; c++) {
+        const type* cv = &input->ivf_centroids[c * D];
+        type dot = 0.0;
+        for (int64_t d = 0; d < D; d++) dot += q[d] * cv[d];
+        type d2 = qn + input->ivf_norms[c] - 2.0 * dot;
+        if (d2 < topk_bound(&top)) topk_push(&top, d2, c);
+    }
+    topk_finish(&top);
+}
+
+
+/*
+ *  IVF_SCAN_BLOCK - Come scan_block(), ma ogni query visita solo le righe
+ *  delle sue ivf_nprobe liste più vicine. Le liste sono diverse per ogni
+ *  query: niente tile condivisi, ogni lista è già un intervallo contiguo.
+ */
+static int64_t ivf_scan_block(const params* input, const type* Q, int64_t nb,
+                              const uint8_t* P_vp, const uint8_t* P_vm,
+                              uint8_t* q_vp, uint8_t* q_vm, type* q_to_pivots,
+                              ID* knn_ids, type* knn_dists, int use_bounds) {
+    int64_t D = input->D;
+    int h = input->h;
+    int m = pool_size(input);
+    int nprobe = ivf_nprobe(input);
+    ID* probe = malloc(nprobe * sizeof(ID));
+    type* probe_d = malloc(nprobe * sizeof(type));
+    if (!probe || !probe_d) {
+        fprintf(stderr, "Errore allocazione in ivf_scan_block\n");
+        exit(1);
+    }
+
+    // le righe delle liste non visitate contano come scartate
+    int64_t pruned = nb * input->N;
+    for (int64_t b = 0; b < nb; b++) {
+        ivf_probe(input, &Q[b * D], nprobe, probe, probe_d);
+        const uint8_t* vp = &q_vp[b * D];
+        const uint8_t* vm = &q_vm[b * D];
+        quantize(&Q[b * D], D, input->x, &q_vp[b * D], &q_vm[b * D]);
+        for (int j = 0; use_bounds && j < h; j++)
+            q_to_pivots[b * h + j] = approx_distance(vp, vm, &P_vp[j * D], &P_vm[j * D], D);
+
+        topk_t top;
+        topk_init(&top, &knn_ids[b * m], &knn_dists[b * m], m);
+        for (int p = 0; p < nprobe; p++) {
+            ID c = probe[p];
+            pruned -= input->ivf_offsets[c + 1] - input->ivf_offsets[c];
+            pruned += scan_rows(input, vp, vm, &q_to_pivots[b * h], &top,
+                                input->ivf_offsets[c], input->ivf_offsets[c + 1],
+                                use_bounds, input->ivf_ids);
+        }
+        topk_finish(&top);
+    }
+
+    free(probe);
+    free(probe_d);
+    return pruned;
+}
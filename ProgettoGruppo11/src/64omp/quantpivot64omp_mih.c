@@ -0,0 +1,261 @@
+/*
+ *  Motore MIH: multi-index hashing sui codici quantizzati
+ *
+ *  I codici (v+, v-) di ogni riga sono una stringa di 2D bit. Con mode =
+ *  MODE_MIH fit() la divide in mih_m sottostringhe di al più 32 dimensioni
+ *  (64 bit: bit 2t = v+, bit 2t+1 = v- della dimensione t della
+ *  sottostringa) e per ognuna costruisce una tabella hash: chiavi distinte
+ *  ordinate e, per chiave, il bucket delle righe che la contengono.
+ *
+ *  In predict() ogni query sonda, per ogni sottostringa, le chiavi a
+ *  distanza di Hamming 0, 1, ... mih_radius dalla propria e raccoglie le
+ *  righe dei bucket, fermandosi al primo raggio che dà almeno pool_size()
+ *  candidati. I candidati passano dallo stesso bound sui pivot e da
+ *  approx_distance() come in scan_rows(), poi cascata, filtro int8 e
+ *  raffinamento non cambiano. Con meno di k candidati anche al raggio
+ *  massimo la query torna alla scansione completa.
+ *
+ *  Le chiavi nulle (nessuna dimensione della sottostringa tra le x scelte)
+ *  non sono indicizzate: con codici sparsi quel bucket conterrebbe quasi
+ *  tutte le righe senza dire nulla sulla vicinanza.
+ */
+
+#define MIH_SUB_MAX         32      // dimensioni per sottostringa (chiave a 64 bit)
+#define MIH_RADIUS_DEFAULT  1       // raggio di Hamming massimo predefinito
+
+
+// Dimensioni per sottostringa e raggio massimo (mih_radius < 0: predefinito)
+static inline int64_t mih_sub(const params* input) {
+    return (input->D + input->mih_m - 1) / input->mih_m;
+}
+
+static inline int mih_radius(const params* input) {
+    return input->mih_radius >= 0 ? input->mih_radius : MIH_RADIUS_DEFAULT;
+}
+
+
+// Chiave della sottostringa j dei codici vp/vm
+static inline uint64_t mih_key(const params* input, const uint8_t* vp, const uint8_t* vm, int j) {
+    int64_t sub = mih_sub(input);
+    int64_t d0 = j * sub, d1 = d0 + sub < input->D ? d0 + sub : input->D;
+    uint64_t key = 0;
+    for (int64_t d = d0; d < d1; d++)
+        key |= ((uint64_t)vp[d] << (2 * (d - d0))) | ((uint64_t)vm[d] << (2 * (d - d0) + 1));
+    return key;
+}
+
+
+// Chiave e ID di una riga durante la costruzione di una tabella
+typedef struct {
+    uint64_t key;
+    ID id;
+} mih_pair;
+
+static int cmp_mih_pair(const void* a, const void* b) {
+    const mih_pair* x = a;
+    const mih_pair* y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+
+/*
+ *  MIH_BUILD - Tabelle delle mih_m sottostringhe dai codici già costruiti
+ *  (mih_table, mih_keys, mih_bucket, mih_ids), una tabella dopo l'altra.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int mih_build(params* input) {
+    int64_t N = input->N;
+    int m = input->mih_m;
+    if (input->DS_quantized_plus == NULL) {
+        fprintf(stderr, "Errore mih_build: codici quantizzati non disponibili\n");
+        return -1;
+    }
+    if (m <= 0 || mih_sub(input) > MIH_SUB_MAX) {
+        fprintf(stderr, "Errore mih_build: mih_m=%d non valido (almeno %ld sottostringhe per D=%ld)\n",
+                m, (input->D + MIH_SUB_MAX - 1) / MIH_SUB_MAX, input->D);
+        return -1;
+    }
+    double t = omp_get_wtime();
+
+    mih_pair* pairs = malloc(N * sizeof(mih_pair));
+    int64_t* table = malloc((m + 1) * sizeof(int64_t));
+    uint64_t* keys = NULL;
+    int64_t* bucket = NULL;
+    ID* ids = NULL;
+    if (!pairs || !table) {
+        fprintf(stderr, "Errore allocazione in mih_build\n");
+        exit(1);
+    }
+    int64_t nkeys = 0, nids = 0;
+
+    for (int j = 0; j < m; j++) {
+        int64_t n = 0;
+        #pragma omp parallel for schedule(static) reduction(+:n)
+        for (int64_t i = 0; i < N; i++) {
+            pairs[i].key = mih_key(input, &input->DS_quantized_plus[i * input->D],
+                                   &input->DS_quantized_minus[i * input->D], j);
+            pairs[i].id = i;
+            n += pairs[i].key != 0;
+        }
+        qsort(pairs, N, sizeof(mih_pair), cmp_mih_pair);
+
+        // chiavi nulle in testa: restano fuori dalla tabella
+        const mih_pair* p = &pairs[N - n];
+        int64_t distinct = 0;
+        for (int64_t i = 0; i < n; i++) distinct += i == 0 || p[i].key != p[i - 1].key;
+
+        // almeno un elemento: realloc(p, 0) può restituire NULL anche senza errore
+        keys = realloc(keys, (nkeys + distinct > 0 ? nkeys + distinct : 1) * sizeof(uint64_t));
+        bucket = realloc(bucket, (nkeys + distinct + 1) * sizeof(int64_t));
+        ids = realloc(ids, (nids + n > 0 ? nids + n : 1) * sizeof(ID));
+        if (!keys || !bucket || !ids) {
+            fprintf(stderr, "Errore allocazione in mih_build\n");
+            exit(1);
+        }
+        table[j] = nkeys;
+        for (int64_t i = 0; i < n; i++) {
+            if (i == 0 || p[i].key != p[i - 1].key) {
+                keys[nkeys] = p[i].key;
+                bucket[nkeys++] = nids + i;
+            }
+            ids[nids + i] = p[i].id;
+        }
+        nids += n;
+    }
+    table[m] = nkeys;
+    bucket[nkeys] = nids;
+    free(pairs);
+
+    input->mih_table = table;
+    input->mih_keys = keys;
+    input->mih_bucket = bucket;
+    input->mih_ids = ids;
+
+    if (!input->silent)
+        printf("[MIH] %d tabelle da %ld dimensioni: %ld chiavi, %.1f righe per bucket, %.3f s\n",
+               m, mih_sub(input), nkeys, nkeys > 0 ? (double)nids / nkeys : 0.0, omp_get_wtime() - t);
+    return 0;
+}
+
+
+// Candidati di una query in ordine di arrivo (con doppioni tra tabelle diverse)
+typedef struct {
+    ID* ids;
+    int64_t n, cap;
+} mih_cands;
+
+static inline void mih_add_bucket(const params* input, int j, uint64_t key, mih_cands* c) {
+    if (key == 0) return;
+    int64_t lo = input->mih_table[j], hi = input->mih_table[j + 1];
+    while (lo < hi) {
+        int64_t mid = (lo + hi) / 2;
+        if (input->mih_keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == input->mih_table[j + 1] || input->mih_keys[lo] != key) return;
+
+    int64_t b0 = input->mih_bucket[lo], b1 = input->mih_bucket[lo + 1];
+    if (c->n + (b1 - b0) > c->cap) {
+        while (c->n + (b1 - b0) > c->cap) c->cap = c->cap ? 2 * c->cap : 1024;
+        c->ids = realloc(c->ids, c->cap * sizeof(ID));
+        if (!c->ids) {
+            fprintf(stderr, "Errore allocazione in mih_add_bucket\n");
+            exit(1);
+        }
+    }
+    memcpy(&c->ids[c->n], &input->mih_ids[b0], (b1 - b0) * sizeof(ID));
+    c->n += b1 - b0;
+}
+
+// Ordina i candidati per ID e toglie i doppioni (la stessa riga da più tabelle)
+static void mih_unique(mih_cands* c) {
+    if (c->n < 2) return;
+    qsort(c->ids, c->n, sizeof(ID), cmp_id);
+    int64_t u = 0;
+    for (int64_t t = 0; t < c->n; t++)
+        if (u == 0 || c->ids[t] != c->ids[u - 1]) c->ids[u++] = c->ids[t];
+    c->n = u;
+}
+
+// Chiavi a distanza esattamente r da key (bit da first in poi) nella tabella j
+static void mih_probe(const params* input, int j, uint64_t key, int bits, int first, int r,
+                      mih_cands* c) {
+    if (r == 0) {
+        mih_add_bucket(input, j, key, c);
+        return;
+    }
+    for (int b = first; b <= bits - r; b++)
+        mih_probe(input, j, key ^ (1ULL << b), bits, b + 1, r - 1, c);
+}
+
+
+/*
+ *  MIH_SCAN_BLOCK - Come scan_block(), ma ogni query esamina solo le righe
+ *  raccolte dalle tabelle hash (tutte se sono meno di k).
+ */
+static int64_t mih_scan_block(const params* input, const type* Q, int64_t nb,
+                              const uint8_t* P_vp, const uint8_t* P_vm,
+                              uint8_t* q_vp, uint8_t* q_vm, type* q_to_pivots,
+                              ID* knn_ids, type* knn_dists, int use_bounds) {
+    int64_t D = input->D;
+    int h = input->h;
+    int m = pool_size(input);
+    int64_t sub = mih_sub(input);
+    int radius = mih_radius(input);
+    mih_cands c = { NULL, 0, 0 };
+
+    int64_t pruned = 0;
+    for (int64_t b = 0; b < nb; b++) {
+        const uint8_t* vp = &q_vp[b * D];
+        const uint8_t* vm = &q_vm[b * D];
+        quantize(&Q[b * D], D, input->x, &q_vp[b * D], &q_vm[b * D]);
+        const type* qp = &q_to_pivots[b * h];
+        for (int j = 0; use_bounds && j < h; j++)
+            q_to_pivots[b * h + j] = approx_distance(vp, vm, &P_vp[j * D], &P_vm[j * D], D);
+
+        // raggio crescente finché i candidati distinti non bastano
+        c.n = 0;
+        for (int r = 0; r <= radius && c.n < m; r++) {
+            for (int j = 0; j < input->mih_m; j++) {
+                int64_t d0 = j * sub, len = d0 + sub < D ? sub : D - d0;
+                mih_probe(input, j, mih_key(input, vp, vm, j), 2 * len, 0, r, &c);
+            }
+            mih_unique(&c);
+        }
+
+        topk_t top;
+        topk_init(&top, &knn_ids[b * m], &knn_dists[b * m], m);
+        if (c.n < input->k) {
+            pruned += scan_rows(input, vp, vm, qp, &top, 0, input->N, use_bounds, NULL);
+        } else {
+            // in ordine di ID come la scansione: a parità di distanza vince l'ID minore
+            pruned += input->N - c.n;
+            type d_max_k = topk_bound(&top);
+            for (int64_t t = 0; t < c.n; t++) {
+                int64_t i = c.ids[t];
+                if (use_bounds) {
+                    type max_bound = 0.0;
+                    for (int j = 0; j < h; j++) {
+                        type bound = fabs(input->index[i * h + j] - qp[j]);
+                        if (bound > max_bound) max_bound = bound;
+                    }
+                    if (max_bound >= d_max_k) {
+                        pruned++;
+                        continue;
+                    }
+                }
+                type dist_approx = approx_distance(vp, vm, &input->DS_quantized_plus[i * D],
+                                                   &input->DS_quantized_minus[i * D], D);
+                if (dist_approx < d_max_k) {
+                    topk_push(&top, dist_approx, i);
+                    d_max_k = topk_bound(&top);
+                }
+            }
+        }
+        topk_finish(&top);
+    }
+
+    free(c.ids);
+    return pruned;
+}
@@ -0,0 +1,253 @@
+/*
+ *  Selezione dei pivot
+ *
+ *  select_pivots() riempie input->P secondo input->pivot_strategy:
+ *  - PIVOTS_UNIFORM:     righe a passo N/h (comportamento storico di fit())
+ *  - PIVOTS_RANDOM:      h righe distinte estratte con il seme input->seed
+ *  - PIVOTS_FFT:         farthest-first traversal (distanza euclidea) su un
+ *                        campione: ogni nuovo pivot è il punto più lontano da
+ *                        quelli già scelti
+ *  - PIVOTS_INCREMENTAL: selezione incrementale (Bustos et al.): a ogni passo
+ *                        tra PIVOT_CANDIDATES candidati si sceglie quello che
+ *                        massimizza la media, su PIVOT_PAIRS coppie del
+ *                        campione, del lower bound max_j |d(a,p_j) - d(b,p_j)|
+ *                        calcolato con approx_distance, cioè lo stesso bound
+ *                        usato da predict() per il pruning
+ *
+ *  Le strategie non uniformi lavorano su un campione casuale di al più
+ *  PIVOT_SAMPLE righe e sono parallele sui punti del campione (o sui
+ *  candidati): il costo non dipende da N.
+ */
+
+#define PIVOTS_UNIFORM          0
+#define PIVOTS_RANDOM           1
+#define PIVOTS_FFT              2
+#define PIVOTS_INCREMENTAL      3
+
+#define PIVOT_SAMPLE            4096    // righe del campione
+#define PIVOT_CANDIDATES        64      // candidati valutati per ogni pivot (incrementale)
+#define PIVOT_PAIRS             2048    // coppie su cui si stima il bound medio
+
+
+// Generatore pseudo-casuale splitmix64 (deterministico dato il seme)
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Uniforme in (0, 1)
+static double rand_unit(uint64_t* state) {
+    return ((splitmix64(state) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  SAMPLE_ROWS - s indici distinti e ordinati in [0, N)
+ *  Per s vicino a N selezione sequenziale (algoritmo S di Knuth),
+ *  altrimenti estrazione con rigetto dei duplicati.
+ */
+static void sample_rows(int64_t N, int64_t s, uint64_t* state, int64_t* out) {
+    if (2 * s >= N) {
+        int64_t n = 0;
+        for (int64_t i = 0; i < N && n < s; i++)
+            if ((N - i) * rand_unit(state) < s - n) out[n++] = i;
+        return;
+    }
+
+    int64_t n = 0;
+    while (n < s) {
+        while (n < s) out[n++] = splitmix64(state) % N;
+        qsort(out, n, sizeof(int64_t), cmp_int64);
+        int64_t u = 0;
+        for (int64_t i = 0; i < n; i++)
+            if (u == 0 || out[i] != out[u - 1]) out[u++] = out[i];
+        n = u;
+    }
+}
+
+
+// Farthest-first traversal sul campione (indici in sample[0..s))
+static void pivots_fft(params* input, const int64_t* sample, int64_t s, uint64_t* state) {
+    int64_t D = input->D;
+    type* min_dist = malloc(s * sizeof(type));
+    if (!min_dist) {
+        fprintf(stderr, "Errore allocazione in pivots_fft\n");
+        exit(1);
+    }
+    for (int64_t i = 0; i < s; i++) min_dist[i] = INFINITY;
+
+    // primo pivot casuale, poi sempre il punto più lontano dai pivot scelti
+    int64_t next = splitmix64(state) % s;
+    for (int j = 0; j < input->h; j++) {
+        input->P[j] = sample[next];
+        const type* p = &input->DS[sample[next] * D];
+
+        int64_t best = 0;
+        type best_dist = -1.0;
+        #pragma omp parallel
+        {
+            int64_t t_best = 0;
+            type t_dist = -1.0;
+            #pragma omp for schedule(static)
+            for (int64_t i = 0; i < s; i++) {
+                type d = euclidean_distance(&input->DS[sample[i] * D], p, D);
+                if (d < min_dist[i]) min_dist[i] = d;
+                if (min_dist[i] > t_dist) {
+                    t_dist = min_dist[i];
+                    t_best = i;
+                }
+            }
+            #pragma omp critical
+            {
+                if (t_dist > best_dist || (t_dist == best_dist && t_best < best)) {
+                    best_dist = t_dist;
+                    best = t_best;
+                }
+            }
+        }
+        next = best;
+    }
+
+    free(min_dist);
+}
+
+
+// Selezione incrementale: massimizza il lower bound medio su coppie del campione
+static void pivots_incremental(params* input, const int64_t* sample, int64_t s, uint64_t* state) {
+    int64_t D = input->D;
+    int h = input->h;
+    // almeno 2h candidati (s >= h garantisce che ne bastino sempre)
+    int64_t nc = PIVOT_CANDIDATES > 2 * h ? PIVOT_CANDIDATES : 2 * h;
+    if (nc > s) nc = s;
+    int64_t np = PIVOT_PAIRS;
+
+    int64_t* cand = malloc(nc * sizeof(int64_t));          // posizioni nel campione
+    int64_t* pair_a = malloc(np * sizeof(int64_t));
+    int64_t* pair_b = malloc(np * sizeof(int64_t));
+    uint8_t* S_vp = _mm_malloc(s * D, align);
+    uint8_t* S_vm = _mm_malloc(s * D, align);
+    type* cand_dist = malloc(nc * s * sizeof(type));       // approx_distance candidato → campione
+    type* bound = malloc(np * sizeof(type));               // bound corrente di ogni coppia
+    type* gain = malloc(nc * sizeof(type));
+    uint8_t* used = calloc(nc, 1);
+    if (!cand || !pair_a || !pair_b || !S_vp || !S_vm || !cand_dist || !bound || !gain || !used) {
+        fprintf(stderr, "Errore allocazione in pivots_incremental\n");
+        exit(1);
+    }
+
+    sample_rows(s, nc, state, cand);
+    for (int64_t a = 0; a < np; a++) {
+        pair_a[a] = splitmix64(state) % s;
+        pair_b[a] = splitmix64(state) % s;
+        bound[a] = 0.0;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < s; i++)
+        quantize(&input->DS[sample[i] * D], D, input->x, &S_vp[i * D], &S_vm[i * D]);
+
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int64_t c = 0; c < nc; c++)
+        for (int64_t i = 0; i < s; i++)
+            cand_dist[c * s + i] = approx_distance(&S_vp[cand[c] * D], &S_vm[cand[c] * D],
+                                                   &S_vp[i * D], &S_vm[i * D], D);
+
+    for (int j = 0; j < h; j++) {
+        #pragma omp parallel for schedule(static)
+        for (int64_t c = 0; c < nc; c++) {
+            type sum = 0.0;
+            const type* dc = &cand_dist[c * s];
+            for (int64_t a = 0; a < np; a++) {
+                type b = fabs(dc[pair_a[a]] - dc[pair_b[a]]);
+                sum += b > bound[a] ? b : bound[a];
+            }
+            gain[c] = used[c] ? -1.0 : sum / np;
+        }
+
+        int64_t best = 0;
+        for (int64_t c = 1; c < nc; c++)
+            if (gain[c] > gain[best]) best = c;
+        used[best] = 1;
+        input->P[j] = sample[cand[best]];
+
+        const type* dc = &cand_dist[best * s];
+        for (int64_t a = 0; a < np; a++) {
+            type b = fabs(dc[pair_a[a]] - dc[pair_b[a]]);
+            if (b > bound[a]) bound[a] = b;
+        }
+    }
+
+    if (!input->silent) {
+        type mean = 0.0;
+        for (int64_t a = 0; a < np; a++) mean += bound[a];
+        printf("[FIT] Lower bound medio sul campione: %.3f\n", mean / np);
+    }
+
+    free(cand); free(pair_a); free(pair_b);
+    _mm_free(S_vp); _mm_free(S_vm);
+    free(cand_dist); free(bound); free(gain); free(used);
+}
+
+
+// SELECT_PIVOTS - Riempie input->P (già allocato, h elementi) secondo input->pivot_strategy
+void select_pivots(params* input) {
+    int64_t N = input->N;
+    int h = input->h;
+    uint64_t state = input->seed;
+
+    if (input->pivot_strategy == PIVOTS_UNIFORM) {
+        int64_t step = N / h;
+        if (!input->silent) printf("[FIT] Selezione pivot (step=%ld)...\n", step);
+        for (int j = 0; j < h; j++) {
+            int64_t pivot_idx = step * j;
+            if (pivot_idx >= N) pivot_idx = N - 1;
+            input->P[j] = pivot_idx;
+        }
+        return;
+    }
+
+    if (input->pivot_strategy == PIVOTS_RANDOM) {
+        if (!input->silent) printf("[FIT] Selezione pivot casuale (seme=%lu)...\n", input->seed);
+        int64_t* rows = malloc(h * sizeof(int64_t));
+        if (!rows) {
+            fprintf(stderr, "Errore allocazione in select_pivots\n");
+            exit(1);
+        }
+        sample_rows(N, h, &state, rows);
+        for (int j = 0; j < h; j++) input->P[j] = rows[j];
+        free(rows);
+        return;
+    }
+
+    if (input->pivot_strategy != PIVOTS_FFT && input->pivot_strategy != PIVOTS_INCREMENTAL) {
+        fprintf(stderr, "Errore: strategia di selezione dei pivot %d sconosciuta\n",
+                input->pivot_strategy);
+        exit(1);
+    }
+
+    int64_t s = N < PIVOT_SAMPLE ? N : PIVOT_SAMPLE;
+    if (s < h) s = h;
+    int64_t* sample = malloc(s * sizeof(int64_t));
+    if (!sample) {
+        fprintf(stderr, "Errore allocazione in select_pivots\n");
+        exit(1);
+    }
+    sample_rows(N, s, &state, sample);
+
+    if (input->pivot_strategy == PIVOTS_FFT) {
+        if (!input->silent) printf("[FIT] Selezione pivot farthest-first (campione di %ld)...\n", s);
+        pivots_fft(input, sample, s, &state);
+    } else {
+        if (!input->silent) printf("[FIT] Selezione pivot incrementale (campione di %ld)...\n", s);
+        pivots_incremental(input, sample, s, &state);
+    }
+
+    free(sample);
+}
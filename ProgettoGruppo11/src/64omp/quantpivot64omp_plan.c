@@ -0,0 +1,124 @@
+/*
+ *  Planner: pruning sui pivot o forza bruta, per lotto di query
+ *
+ *  Il pruning conviene solo se il bound scarta abbastanza righe da ripagare
+ *  il suo costo (h confronti per riga, anche per le righe poi non scartate).
+ *  Con N piccolo, k (o r) grande, o query i cui bound sono deboli, la
+ *  scansione a forza bruta (solo approx_distance, nessun bound) è più veloce.
+ *
+ *  plan_batch() stima, per il lotto:
+ *  - p: frazione di righe scartate, simulando scan_block() su PLAN_ROWS righe
+ *    a passo uniforme per PLAN_QUERIES query del lotto, con una lista di
+ *    candidati ridotta in proporzione (m * PLAN_ROWS / N). La simulazione
+ *    include il riempimento iniziale della lista, durante il quale non si
+ *    scarta nulla (decisivo quando m è una frazione grande di N).
+ *  - c_b, c_a: costo per riga del bound e di approx_distance da un modello
+ *    a conteggi: h confronti per il bound, D / PLAN_APPROX_WIDTH passi più
+ *    PLAN_APPROX_CALL per approx_distance (tarato sui tempi misurati).
+ *  e sceglie il pruning se c_b + (1 - p) * c_a < c_a. Nel caso peggiore
+ *  (p stimato male) il costo resta quindi vicino a quello della forza bruta.
+ *
+ *  Stima e scelta dipendono solo da dati e parametri, non da tempi misurati:
+ *  i due piani non danno gli stessi candidati (il bound sui pivot non è un
+ *  lower bound esatto di approx_distance) e la stessa predict() deve dare
+ *  sempre lo stesso risultato. La scelta però vale per tutto il lotto: i
+ *  vicini di una query possono cambiare con le altre query del lotto (Q
+ *  riordinato o diviso). Con input->plan = PLAN_PRUNE o PLAN_BRUTE il
+ *  risultato di ogni query non dipende dal lotto.
+ *  La stima è sequenziale: predict_memory() la chiama da un solo thread
+ *  (omp single) dentro la sua regione parallela.
+ */
+
+#define PLAN_BATCH      256         // query per lotto (predict in memoria)
+#define PLAN_ROWS       256         // righe campionate per la stima
+#define PLAN_QUERIES    4           // query campionate per lotto
+#define PLAN_APPROX_WIDTH   8       // dimensioni per passo di approx_distance (modello)
+#define PLAN_APPROX_CALL    40      // costo fisso di approx_distance, in passi (modello)
+
+
+// PLAN_BATCH - Sceglie PLAN_PRUNE o PLAN_BRUTE per le query Q[0..nq) e aggiorna input->stats
+int plan_batch(params* input, const type* Q, int64_t nq,
+               const uint8_t* P_vp, const uint8_t* P_vm) {
+    if (input->plan != PLAN_AUTO) {
+        if (input->plan == PLAN_PRUNE) input->stats.batches_pruned++;
+        else input->stats.batches_brute++;
+        return input->plan;
+    }
+
+    int64_t D = input->D;
+    int h = input->h;
+    int64_t s = input->N < PLAN_ROWS ? input->N : PLAN_ROWS;
+    int64_t nqs = nq < PLAN_QUERIES ? nq : PLAN_QUERIES;
+    int m = pool_size(input);
+
+    // lista dei candidati scalata sul campione
+    int64_t ms = (int64_t)((double)m * s / input->N + 0.5);
+    if (ms < 1) ms = 1;
+    if (ms > s) ms = s;
+
+    double pruned = 0.0;
+    uint8_t* q_vp = malloc(D);
+    uint8_t* q_vm = malloc(D);
+    type* q_to_pivots = malloc(h * sizeof(type));
+    type* bounds = malloc(s * sizeof(type));
+    type* dists = malloc(s * sizeof(type));
+    type* top = malloc(ms * sizeof(type));
+
+    for (int64_t c = 0; c < nqs; c++) {
+        const type* q = &Q[(c * nq / nqs) * D];
+
+        quantize(q, D, input->x, q_vp, q_vm);
+        for (int j = 0; j < h; j++)
+            q_to_pivots[j] = approx_distance(q_vp, q_vm, &P_vp[j * D], &P_vm[j * D], D);
+
+        for (int64_t r = 0; r < s; r++) {
+            int64_t i = r * input->N / s;
+            type max_bound = 0.0;
+            for (int j = 0; j < h; j++) {
+                type b = fabs(input->index[i * h + j] - q_to_pivots[j]);
+                if (b > max_bound) max_bound = b;
+            }
+            bounds[r] = max_bound;
+        }
+        for (int64_t r = 0; r < s; r++) {
+            int64_t i = r * input->N / s;
+            dists[r] = approx_distance(q_vp, q_vm, &input->DS_quantized_plus[i * D],
+                                       &input->DS_quantized_minus[i * D], D);
+        }
+
+        // stessa logica di scan_block() sul campione
+        int64_t cut = 0;
+        for (int64_t i = 0; i < ms; i++) top[i] = INFINITY;
+        for (int64_t r = 0; r < s; r++) {
+            if (bounds[r] >= top[ms - 1]) {
+                cut++;
+                continue;
+            }
+            if (dists[r] < top[ms - 1]) {
+                int64_t pos = ms - 1;
+                while (pos > 0 && dists[r] < top[pos - 1]) {
+                    top[pos] = top[pos - 1];
+                    pos--;
+                }
+                top[pos] = dists[r];
+            }
+        }
+
+        pruned += (double)cut / s;
+    }
+    free(q_vp); free(q_vm); free(q_to_pivots); free(bounds); free(dists); free(top);
+
+    double p = pruned / nqs;
+    double c_b = h;
+    double c_a = (double)D / PLAN_APPROX_WIDTH + PLAN_APPROX_CALL;
+    int choice = c_b + (1.0 - p) * c_a < c_a ? PLAN_PRUNE : PLAN_BRUTE;
+
+    // media mobile della stima su tutti i lotti della predict()
+    int64_t done = input->stats.batches_pruned + input->stats.batches_brute;
+    input->stats.est_prune_rate = (input->stats.est_prune_rate * done + p) / (done + 1);
+    input->stats.cost_ratio = c_a > 0.0 ? c_b / c_a : 0.0;
+    if (choice == PLAN_PRUNE) input->stats.batches_pruned++;
+    else input->stats.batches_brute++;
+
+    return choice;
+}
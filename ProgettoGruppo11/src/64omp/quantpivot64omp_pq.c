@@ -0,0 +1,504 @@
+/*
+ *  Motore PQ: quantizzazione a prodotto con tabelle di distanza asimmetriche
+ *
+ *  Per dataset che non entrano in memoria nemmeno come codici a 1 bit
+ *  (2*D byte per punto) l'indice a pivot non basta. Il motore PQ divide D
+ *  in pq_m sottospazi di D/pq_m dimensioni e per ognuno addestra con
+ *  k-means 2^pq_bits centroidi: ogni punto diventa pq_m codici (pq_m byte
+ *  con 8 bit, pq_m/2 con 4 bit).
+ *
+ *  In predict() ogni query costruisce la tabella T[j][c] = ||q_j - C_j,c||^2
+ *  (ADC, distanza asimmetrica: la query non viene quantizzata) e la
+ *  distanza approssimata di un punto è Σ_j T[j][codice_j]:
+ *  - 8 bit: tabella in double [pq_m x 256], una lettura per codice
+ *  - 4 bit (fast-scan): tabella quantizzata a uint8 [pq_m x 16], che sta in
+ *    un registro per sottospazio; i codici sono memorizzati a blocchi di
+ *    PQ_BLOCK punti trasposti per sottospazio e vpshufb legge 32 (AVX2) o
+ *    64 (AVX-512BW) voci della tabella per istruzione, accumulate in uint16
+ *  I pool_size() candidati migliori vengono poi riordinati con la tabella in
+ *  double (4 bit) oppure, con pq_refine, raffinati con la distanza esatta
+ *  (refine_knn() sul dataset in memoria, a 16 bit o su disco).
+ *
+ *  Con mode = MODE_PQ fit() costruisce solo l'indice PQ (niente pivot né
+ *  codici a 1 bit): con pq_m = 16 e 8 bit 10^8 punti occupano 1.6 GB.
+ */
+
+#define PQ_BLOCK            32          // punti per blocco fast-scan (4 bit)
+#define PQ_TRAIN_PER_C      64          // righe di addestramento per centroide
+#define PQ_TRAIN_MIN        4096        // righe di addestramento minime
+#define PQ_QBLOCK           8           // query per blocco della scansione
+#define PQ_TILE_BYTES       (256 * 1024)    // codici per tile (~L2)
+
+
+// Sottospazi allineati al registro dei 4 bit (sottospazi vuoti: tabella a zero)
+static inline int pq_mpad(const params* input) {
+    return input->pq_bits == 4 ? (input->pq_m + 3) / 4 * 4 : input->pq_m;
+}
+
+// Codice del punto i nel sottospazio j
+static inline int pq_code(const params* input, int64_t i, int j) {
+    if (input->pq_bits == 8) return input->pq_codes[i * input->pq_m + j];
+    uint8_t byte = input->pq_codes[((i / PQ_BLOCK) * pq_mpad(input) + j) * 16 + (i % 16)];
+    return i % PQ_BLOCK < 16 ? byte & 15 : byte >> 4;
+}
+
+
+// dist[c] = ||x - C_c||^2 per i ksub centroidi C [dsub x ksub] (trasposti: il
+// ciclo interno scorre i centroidi ed è vettorizzato dal compilatore)
+static inline void pq_sub_dists(const type* x, const type* C, int dsub, int ksub, type* dist) {
+    for (int c = 0; c < ksub; c++) dist[c] = 0.0;
+    for (int d = 0; d < dsub; d++) {
+        type xd = x[d];
+        const type* row = &C[d * ksub];
+        for (int c = 0; c < ksub; c++) {
+            type diff = xd - row[c];
+            dist[c] += diff * diff;
+        }
+    }
+}
+
+// Centroide più vicino (a parità l'indice minore)
+static inline int pq_nearest(const type* x, const type* C, int dsub, int ksub, type* dist) {
+    pq_sub_dists(x, C, dsub, ksub, dist);
+    int best = 0;
+    for (int c = 1; c < ksub; c++)
+        if (dist[c] < dist[best]) best = c;
+    return best;
+}
+
+
+// K-means su s vettori X [s x dsub]: centroidi in C [dsub x ksub]
+static void pq_kmeans(const type* X, int64_t s, int dsub, int ksub, int iters, type* C) {
+    int* assign = malloc(s * sizeof(int));
+    int64_t* count = malloc(ksub * sizeof(int64_t));
+    type* sum = malloc(ksub * dsub * sizeof(type));
+    type* dist = malloc(ksub * sizeof(type));
+    if (!assign || !count || !sum || !dist) {
+        fprintf(stderr, "Errore allocazione in pq_kmeans\n");
+        exit(1);
+    }
+
+    // inizializzazione: righe del campione a passo uniforme
+    for (int c = 0; c < ksub; c++)
+        for (int d = 0; d < dsub; d++)
+            C[d * ksub + c] = X[(c * s / ksub) * dsub + d];
+
+    for (int it = 0; it < iters; it++) {
+        memset(count, 0, ksub * sizeof(int64_t));
+        memset(sum, 0, ksub * dsub * sizeof(type));
+        for (int64_t i = 0; i < s; i++) {
+            int c = assign[i] = pq_nearest(&X[i * dsub], C, dsub, ksub, dist);
+            count[c]++;
+            for (int d = 0; d < dsub; d++) sum[c * dsub + d] += X[i * dsub + d];
+        }
+
+        for (int c = 0; c < ksub; c++)
+            for (int d = 0; d < dsub && count[c] > 0; d++)
+                C[d * ksub + c] = sum[c * dsub + d] / count[c];
+
+        // cluster vuoti: metà del cluster più numeroso, con il centroide spostato di poco
+        for (int c = 0; c < ksub; c++) {
+            if (count[c] > 0) continue;
+            int big = 0;
+            for (int b = 1; b < ksub; b++)
+                if (count[b] > count[big]) big = b;
+            for (int d = 0; d < dsub; d++) {
+                type v = C[d * ksub + big];
+                C[d * ksub + c] = v * (1.0 + 1.0 / 1024) + (d % 2 ? 1e-7 : -1e-7);
+                C[d * ksub + big] = v * (1.0 - 1.0 / 1024);
+            }
+            count[c] = count[big] / 2;
+            count[big] -= count[c];
+        }
+    }
+
+    free(assign);
+    free(count);
+    free(sum);
+    free(dist);
+}
+
+
+/*
+ *  FIT_PQ - Addestra i centroidi (k-means per sottospazio, in parallelo sui
+ *  sottospazi) su un campione a passo uniforme e codifica tutte le righe.
+ */
+void fit_pq(params* input) {
+    int64_t N = input->N, D = input->D;
+    int M = input->pq_m;
+    if (M <= 0 || D % M != 0) {
+        fprintf(stderr, "Errore fit_pq: pq_m=%d deve dividere D=%ld\n", M, D);
+        exit(1);
+    }
+    if (input->pq_bits != 4 && input->pq_bits != 8) {
+        fprintf(stderr, "Errore fit_pq: pq_bits=%d (4 o 8)\n", input->pq_bits);
+        exit(1);
+    }
+    if (input->pq_bits == 4 && M > 256) {
+        fprintf(stderr, "Errore fit_pq: con 4 bit pq_m <= 256 (accumulo a 16 bit)\n");
+        exit(1);
+    }
+    int dsub = D / M;
+    int ksub = 1 << input->pq_bits;
+    if (N < ksub) {
+        fprintf(stderr, "Errore fit_pq: N=%ld < %d centroidi\n", N, ksub);
+        exit(1);
+    }
+    if (N > ID_MAX) {
+        fprintf(stderr, "Errore: N=%ld non rappresentabile negli ID, ricompilare con -DID64\n", N);
+        exit(1);
+    }
+    int iters = input->pq_iters > 0 ? input->pq_iters : 20;
+    int64_t s = (int64_t)PQ_TRAIN_PER_C * ksub;
+    if (s < PQ_TRAIN_MIN) s = PQ_TRAIN_MIN;
+    if (s > N) s = N;
+
+    if (!input->silent) {
+        printf("[FIT] Indice PQ: N=%ld, D=%ld, %d sottospazi x %d centroidi, %d iterazioni su %ld righe\n",
+               N, D, M, ksub, iters, s);
+    }
+
+    // campione a passo uniforme
+    type* sample = malloc(s * D * sizeof(type));
+    input->pq_centroids = _mm_malloc((size_t)M * dsub * ksub * sizeof(type), align);
+    if (!sample || !input->pq_centroids) {
+        fprintf(stderr, "Errore allocazione in fit_pq\n");
+        exit(1);
+    }
+    #pragma omp parallel
+    {
+        type* buf = malloc(D * sizeof(type));
+        #pragma omp for schedule(static)
+        for (int64_t r = 0; r < s; r++)
+            memcpy(&sample[r * D], dataset_row(input, r * N / s, buf), D * sizeof(type));
+        free(buf);
+    }
+
+    // k-means indipendenti, uno per sottospazio
+    #pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < M; j++) {
+        type* X = malloc(s * dsub * sizeof(type));
+        for (int64_t r = 0; r < s; r++)
+            memcpy(&X[r * dsub], &sample[r * D + j * dsub], dsub * sizeof(type));
+        pq_kmeans(X, s, dsub, ksub, iters, &input->pq_centroids[(size_t)j * dsub * ksub]);
+        free(X);
+    }
+    free(sample);
+
+    // codifica: 8 bit riga per riga, 4 bit a blocchi di PQ_BLOCK punti
+    int mpad = pq_mpad(input);
+    int64_t nblocks = (N + PQ_BLOCK - 1) / PQ_BLOCK;
+    size_t bytes = input->pq_bits == 8 ? (size_t)N * M : (size_t)nblocks * mpad * 16;
+    input->pq_codes = _mm_malloc(bytes, align);
+    if (!input->pq_codes) {
+        fprintf(stderr, "Errore allocazione in fit_pq\n");
+        exit(1);
+    }
+    memset(input->pq_codes, 0, bytes);
+
+    #pragma omp parallel
+    {
+        type* buf = malloc(D * sizeof(type));
+        type* dist = malloc(ksub * sizeof(type));
+        // un blocco intero per iterazione: due punti condividono ogni byte dei 4 bit
+        #pragma omp for schedule(static)
+        for (int64_t blk = 0; blk < nblocks; blk++) {
+            for (int64_t i = blk * PQ_BLOCK; i < (blk + 1) * PQ_BLOCK && i < N; i++) {
+                const type* x = dataset_row(input, i, buf);
+                for (int j = 0; j < M; j++) {
+                    int c = pq_nearest(&x[j * dsub], &input->pq_centroids[(size_t)j * dsub * ksub],
+                                       dsub, ksub, dist);
+                    if (input->pq_bits == 8)
+                        input->pq_codes[i * M + j] = c;
+                    else
+                        input->pq_codes[(blk * mpad + j) * 16 + i % 16] |= i % PQ_BLOCK < 16 ? c : c << 4;
+                }
+            }
+        }
+        free(buf);
+        free(dist);
+    }
+
+    if (!input->silent)
+        printf("[FIT] Completato! Codici PQ: %.1f MiB, picco RSS: %.1f MiB\n",
+               bytes / 1048576.0, peak_rss() / 1048576.0);
+}
+
+
+// PQ_TABLE - T[j * ksub + c] = ||q_j - C_j,c||^2 (tabella ADC della query)
+static void pq_table(const params* input, const type* q, type* T) {
+    int M = input->pq_m;
+    int dsub = input->D / M;
+    int ksub = 1 << input->pq_bits;
+    for (int j = 0; j < M; j++)
+        pq_sub_dists(&q[j * dsub], &input->pq_centroids[(size_t)j * dsub * ksub], dsub, ksub, &T[j * ksub]);
+}
+
+// Tabella dei 4 bit quantizzata a uint8 [mpad x 16]: passo comune a tutti i
+// sottospazi, così la somma dei valori quantizzati è monotona nella distanza
+static void pq_table_u8(const params* input, const type* T, uint8_t* T8) {
+    int M = input->pq_m;
+    type span = 0.0;
+    type tmin[256];
+    for (int j = 0; j < M; j++) {
+        tmin[j] = T[j * 16];
+        type tmax = T[j * 16];
+        for (int c = 1; c < 16; c++) {
+            if (T[j * 16 + c] < tmin[j]) tmin[j] = T[j * 16 + c];
+            if (T[j * 16 + c] > tmax) tmax = T[j * 16 + c];
+        }
+        if (tmax - tmin[j] > span) span = tmax - tmin[j];
+    }
+    type inv = span > 0.0 ? 255.0 / span : 0.0;
+    memset(T8, 0, (size_t)pq_mpad(input) * 16);
+    for (int j = 0; j < M; j++)
+        for (int c = 0; c < 16; c++)
+            T8[j * 16 + c] = (uint8_t)lrint((T[j * 16 + c] - tmin[j]) * inv);
+}
+
+
+// Fast-scan: distanze quantizzate dei PQ_BLOCK punti di un blocco
+static inline void pq_scan_block4(const uint8_t* codes, const uint8_t* T8, int mpad, uint16_t out[PQ_BLOCK]) {
+#if defined(__AVX512BW__)
+    // 4 sottospazi per registro, uno per corsia di 128 bit
+    __m512i mask = _mm512_set1_epi8(15), zero = _mm512_setzero_si512();
+    __m512i acc[4];
+    for (int a = 0; a < 4; a++) acc[a] = _mm512_setzero_si512();
+    for (int j = 0; j < mpad; j += 4) {
+        __m512i c = _mm512_loadu_si512(&codes[j * 16]);
+        __m512i t = _mm512_loadu_si512(&T8[j * 16]);
+        __m512i lo = _mm512_shuffle_epi8(t, _mm512_and_si512(c, mask));
+        __m512i hi = _mm512_shuffle_epi8(t, _mm512_and_si512(_mm512_srli_epi16(c, 4), mask));
+        acc[0] = _mm512_add_epi16(acc[0], _mm512_unpacklo_epi8(lo, zero));     // punti 0-7
+        acc[1] = _mm512_add_epi16(acc[1], _mm512_unpackhi_epi8(lo, zero));     // 8-15
+        acc[2] = _mm512_add_epi16(acc[2], _mm512_unpacklo_epi8(hi, zero));     // 16-23
+        acc[3] = _mm512_add_epi16(acc[3], _mm512_unpackhi_epi8(hi, zero));     // 24-31
+    }
+    for (int a = 0; a < 4; a++) {
+        __m128i s = _mm_add_epi16(_mm_add_epi16(_mm512_extracti32x4_epi32(acc[a], 0),
+                                                _mm512_extracti32x4_epi32(acc[a], 1)),
+                                  _mm_add_epi16(_mm512_extracti32x4_epi32(acc[a], 2),
+                                                _mm512_extracti32x4_epi32(acc[a], 3)));
+        _mm_storeu_si128((__m128i*)&out[a * 8], s);
+    }
+#elif defined(__AVX2__)
+    // 2 sottospazi per registro
+    __m256i mask = _mm256_set1_epi8(15), zero = _mm256_setzero_si256();
+    __m256i acc[4];
+    for (int a = 0; a < 4; a++) acc[a] = _mm256_setzero_si256();
+    for (int j = 0; j < mpad; j += 2) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)&codes[j * 16]);
+        __m256i t = _mm256_loadu_si256((const __m256i*)&T8[j * 16]);
+        __m256i lo = _mm256_shuffle_epi8(t, _mm256_and_si256(c, mask));
+        __m256i hi = _mm256_shuffle_epi8(t, _mm256_and_si256(_mm256_srli_epi16(c, 4), mask));
+        acc[0] = _mm256_add_epi16(acc[0], _mm256_unpacklo_epi8(lo, zero));
+        acc[1] = _mm256_add_epi16(acc[1], _mm256_unpackhi_epi8(lo, zero));
+        acc[2] = _mm256_add_epi16(acc[2], _mm256_unpacklo_epi8(hi, zero));
+        acc[3] = _mm256_add_epi16(acc[3], _mm256_unpackhi_epi8(hi, zero));
+    }
+    for (int a = 0; a < 4; a++) {
+        __m128i s = _mm_add_epi16(_mm256_castsi256_si128(acc[a]), _mm256_extracti128_si256(acc[a], 1));
+        _mm_storeu_si128((__m128i*)&out[a * 8], s);
+    }
+#else
+    for (int p = 0; p < PQ_BLOCK; p++) {
+        int s = 0;
+        for (int j = 0; j < mpad; j++) {
+            uint8_t byte = codes[j * 16 + p % 16];
+            s += T8[j * 16 + (p < 16 ? byte & 15 : byte >> 4)];
+        }
+        out[p] = s;
+    }
+#endif
+}
+
+
+/*
+ *  PQ_SCAN_BLOCK - pool_size() candidati (distanza ADC crescente) per un
+ *  blocco di nb <= PQ_QBLOCK query. I codici sono visitati a tile di
+ *  PQ_TILE_BYTES, scansionati da tutte le query del blocco mentre sono in
+ *  cache. T [nb x pq_m x ksub], T8 [nb x mpad x 16].
+ */
+static void pq_scan_block(const params* input, const type* Q, int64_t nb, type* T, uint8_t* T8,
+                          ID* knn_ids, type* knn_dists) {
+    int64_t N = input->N;
+    int M = input->pq_m, mpad = pq_mpad(input);
+    int ksub = 1 << input->pq_bits;
+    int m = pool_size(input);
+    topk_t lists[PQ_QBLOCK];
+
+    for (int64_t b = 0; b < nb; b++) {
+        pq_table(input, &Q[b * input->D], &T[b * M * ksub]);
+        if (input->pq_bits == 4) pq_table_u8(input, &T[b * M * ksub], &T8[b * mpad * 16]);
+        topk_init(&lists[b], &knn_ids[b * m], &knn_dists[b * m], m);
+    }
+
+    if (input->pq_bits == 8) {
+        const uint8_t* codes = input->pq_codes;
+        int64_t tile = PQ_TILE_BYTES / M;
+        for (int64_t t0 = 0; t0 < N; t0 += tile) {
+            int64_t t1 = t0 + tile < N ? t0 + tile : N;
+            for (int64_t b = 0; b < nb; b++) {
+                const type* Tb = &T[b * M * 256];
+                topk_t* top = &lists[b];
+                type bound = topk_bound(top);
+                for (int64_t i = t0; i < t1; i++) {
+                    const uint8_t* c = &codes[i * M];
+                    type s = 0.0;
+                    for (int j = 0; j < M; j++) s += Tb[j * 256 + c[j]];
+                    if (s < bound) {
+                        topk_push(top, s, i);
+                        bound = topk_bound(top);
+                    }
+                }
+            }
+        }
+    } else {
+        int64_t nblocks = (N + PQ_BLOCK - 1) / PQ_BLOCK;
+        int64_t tile = PQ_TILE_BYTES / (mpad * 16);
+        if (tile < 1) tile = 1;
+        uint16_t dist[PQ_BLOCK];
+        for (int64_t t0 = 0; t0 < nblocks; t0 += tile) {
+            int64_t t1 = t0 + tile < nblocks ? t0 + tile : nblocks;
+            for (int64_t b = 0; b < nb; b++) {
+                const uint8_t* T8b = &T8[b * mpad * 16];
+                topk_t* top = &lists[b];
+                type bound = topk_bound(top);
+                for (int64_t blk = t0; blk < t1; blk++) {
+                    pq_scan_block4(&input->pq_codes[blk * mpad * 16], T8b, mpad, dist);
+                    int64_t first = blk * PQ_BLOCK;
+                    int n = N - first < PQ_BLOCK ? N - first : PQ_BLOCK;
+                    for (int p = 0; p < n; p++) {
+                        if (dist[p] < bound) {
+                            topk_push(top, dist[p], first + p);
+                            bound = topk_bound(top);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int64_t b = 0; b < nb; b++) topk_finish(&lists[b]);
+}
+
+
+// I k migliori del pool per distanza ADC in double (4 bit: ordina le distanze quantizzate)
+static void pq_rescore(const params* input, const type* T, const ID* ids, int n,
+                       ID* out_ids, type* out_dists) {
+    int M = input->pq_m;
+    int ksub = 1 << input->pq_bits;
+    topk_t top;
+    topk_init(&top, out_ids, out_dists, input->k);
+    for (int i = 0; i < n; i++) {
+        if (ids[i] < 0) continue;
+        type s = 0.0;
+        for (int j = 0; j < M; j++) s += T[j * ksub + pq_code(input, ids[i], j)];
+        if (s <= topk_bound(&top)) topk_push(&top, s, ids[i]);
+    }
+    topk_finish(&top);
+    for (int i = 0; i < input->k; i++) out_dists[i] = sqrt(out_dists[i]);
+}
+
+
+/*
+ *  PREDICT_PQ - Modalità PQ di predict(): scansione ADC di tutti i codici,
+ *  poi riordino dei pool_size() candidati con la tabella in double oppure
+ *  (pq_refine) raffinamento esatto dal dataset in memoria o su disco.
+ */
+void predict_pq(params* input) {
+    if (input->pq_codes == NULL) {
+        fprintf(stderr, "Errore: indice PQ non costruito, chiamare fit() con mode = MODE_PQ\n");
+        exit(1);
+    }
+    int disk = input->pq_refine && input->ds_fd >= 0;
+    if (input->pq_refine && !disk && input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore: il raffinamento PQ richiede il dataset (in memoria o su disco)\n");
+        exit(1);
+    }
+
+    int64_t D = input->D;
+    int k = input->k;
+    int m = pool_size(input);
+    int M = input->pq_m, mpad = pq_mpad(input);
+    int ksub = 1 << input->pq_bits;
+    // ordine dei blocchi di dimensioni per l'early abandon, calcolato una volta
+    if (input->pq_refine && input->var_order && input->dim_order == NULL && input->DS != NULL)
+        variance_order(input);
+    const void* refine_src = input->DS_half ? input->DS_half : (const void*)input->DS;
+    uint32_t refine_dtype = input->DS_half ? input->half_dtype : DS3_F64;
+
+    // con il dataset su disco le query vanno a lotti (righe lette una volta per lotto)
+    int64_t batch = disk ? DISK_BATCH : input->nq;
+    disk_batch db;
+    type* rows_buf = NULL;
+    if (disk) {
+        db.knn_ids = malloc(batch * m * sizeof(ID));
+        db.knn_dists = malloc(batch * m * sizeof(type));
+        db.rows = malloc(batch * m * sizeof(ID));
+        rows_buf = _mm_malloc(batch * m * D * sizeof(type), align);
+        if (!db.knn_ids || !db.knn_dists || !db.rows || !rows_buf) {
+            fprintf(stderr, "Errore allocazione in predict_pq\n");
+            exit(1);
+        }
+    }
+
+    for (int64_t first = 0; first < input->nq; first += batch) {
+        int64_t last = first + batch < input->nq ? first + batch : input->nq;
+
+        #pragma omp parallel
+        {
+            type* T = malloc(PQ_QBLOCK * M * ksub * sizeof(type));
+            uint8_t* T8 = _mm_malloc(PQ_QBLOCK * mpad * 16, align);
+            ID* knn_ids = malloc(PQ_QBLOCK * m * sizeof(ID));
+            type* knn_dists = malloc(PQ_QBLOCK * m * sizeof(type));
+
+            // blocchi di query più piccoli se non bastano a occupare tutti i thread
+            int64_t bs = (last - first + omp_get_num_threads() - 1) / omp_get_num_threads();
+            if (bs > PQ_QBLOCK) bs = PQ_QBLOCK;
+
+            #pragma omp for schedule(dynamic)
+            for (int64_t q0 = first; q0 < last; q0 += bs) {
+                int64_t nb = last - q0 < bs ? last - q0 : bs;
+                pq_scan_block(input, &input->Q[q0 * D], nb, T, T8, knn_ids, knn_dists);
+
+                for (int64_t b = 0; b < nb; b++) {
+                    int64_t qi = q0 + b;
+                    if (disk)
+                        memcpy(&db.knn_ids[(qi - first) * m], &knn_ids[b * m], m * sizeof(ID));
+                    else if (input->pq_refine)
+                        refine_knn(&input->Q[qi * D], refine_src, refine_dtype, &knn_ids[b * m], m, D,
+                                   input->dim_order, k, &input->id_nn[qi * k], &input->dist_nn[qi * k]);
+                    else if (input->pq_bits == 4)
+                        pq_rescore(input, &T[b * M * ksub], &knn_ids[b * m], m,
+                                   &input->id_nn[qi * k], &input->dist_nn[qi * k]);
+                    else
+                        for (int i = 0; i < k; i++) {
+                            // 8 bit: la scansione usa già la tabella in double
+                            input->id_nn[qi * k + i] = knn_ids[b * m + i];
+                            input->dist_nn[qi * k + i] = sqrt(knn_dists[b * m + i]);
+                        }
+                }
+            }
+
+            free(T);
+            _mm_free(T8);
+            free(knn_ids);
+            free(knn_dists);
+        }
+
+        if (disk) {
+            db.first = first;
+            db.nq = last - first;
+            disk_collect_rows(input, &db);
+            disk_refine_batch(input, &db, rows_buf, m);
+        }
+    }
+
+    if (disk) {
+        free(db.knn_ids);
+        free(db.knn_dists);
+        free(db.rows);
+        _mm_free(rows_buf);
+    }
+}
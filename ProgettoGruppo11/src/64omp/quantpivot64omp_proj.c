@@ -0,0 +1,289 @@
+/*
+ *  Filtro a dimensione ridotta: PCA o proiezione casuale strutturata
+ *
+ *  Con proj_mode != PROJ_OFF fit() impara una proiezione a proj_dim = d'
+ *  righe ortonormali e conserva i vettori ridotti DS_proj [N x d']:
+ *  - PROJ_PCA: le d' componenti principali (iterazione a sottospazio sulla
+ *    covarianza di un campione di PROJ_SAMPLE righe), righe centrate
+ *  - PROJ_SRHT: segni casuali, trasformata di Walsh-Hadamard veloce sulla
+ *    lunghezza L (potenza di 2 >= D) normalizzata e d' coordinate casuali:
+ *    O(L log L) per vettore invece di O(d' D)
+ *
+ *  Le righe della proiezione sono ortonormali, quindi ||P(q - x)|| non
+ *  supera mai ||q - x||: la distanza ridotta è un lower bound economico
+ *  (d' invece di D dimensioni). In predict() filter_candidates() la usa
+ *  dopo la cascata e prima del filtro int8: restano proj_pool() candidati
+ *  per il raffinamento esatto.
+ */
+
+#define PROJ_SAMPLE         8192    // righe per la covarianza (PCA)
+#define PROJ_ITERS          24      // iterazioni a sottospazio (PCA)
+#define PROJ_DIM_DEFAULT    64      // d' predefinito (al più D)
+
+static double rand_unit(uint64_t* state);      // quantpivot64omp_pivots.c
+
+
+// Dimensione ridotta: proj_dim (<= 0: 64), al più D
+static inline int proj_dim(const params* input) {
+    int d = input->proj_dim > 0 ? input->proj_dim : PROJ_DIM_DEFAULT;
+    return d < input->D ? d : (int)input->D;
+}
+
+// Lunghezza della trasformata di Hadamard: potenza di 2 >= D
+static inline int64_t proj_len(const params* input) {
+    int64_t L = 1;
+    while (L < input->D) L *= 2;
+    return L;
+}
+
+// PROJ_POOL - Candidati che passano il filtro: max(k, proj_keep) (<= 0: 4k),
+// al più quelli in uscita dalla cascata
+static inline int proj_pool(const params* input) {
+    int k = input->k;
+    int keep = input->proj_keep > 0 ? input->proj_keep : 4 * k;
+    if (keep < k) keep = k;
+    return keep < cascade_pool(input) ? keep : cascade_pool(input);
+}
+
+// Candidati in uscita da cascata e proiezione
+static inline int prefilter_pool(const params* input) {
+    return input->proj_mode != PROJ_OFF ? proj_pool(input) : cascade_pool(input);
+}
+
+
+// Trasformata di Walsh-Hadamard in place su v[0..L), L potenza di 2 (non normalizzata)
+static void fwht(type* v, int64_t L) {
+    for (int64_t len = 1; len < L; len *= 2)
+        for (int64_t i = 0; i < L; i += 2 * len)
+            for (int64_t j = i; j < i + len; j++) {
+                type a = v[j], b = v[j + len];
+                v[j] = a + b;
+                v[j + len] = a - b;
+            }
+}
+
+
+/*
+ *  PROJECT - Vettore ridotto out[d'] di v[D]. buf: spazio di lavoro
+ *  [proj_len()] per PROJ_SRHT.
+ */
+static void project(const params* input, const type* v, type* out, type* buf) {
+    int64_t D = input->D;
+    int dp = proj_dim(input);
+    if (input->proj_mode == PROJ_PCA) {
+        for (int c = 0; c < dp; c++) {
+            const type* b = &input->proj_basis[c * D];
+            type s = 0.0;
+            for (int64_t d = 0; d < D; d++) s += b[d] * (v[d] - input->proj_mean[d]);
+            out[c] = s;
+        }
+        return;
+    }
+    int64_t L = proj_len(input);
+    for (int64_t d = 0; d < D; d++) buf[d] = input->proj_sign[d] * v[d];
+    for (int64_t d = D; d < L; d++) buf[d] = 0.0;
+    fwht(buf, L);
+    type norm = 1.0 / sqrt((type)L);
+    for (int c = 0; c < dp; c++) out[c] = buf[input->proj_coord[c]] * norm;
+}
+
+
+// Ortonormalizza le n righe di V [n x D] (Gram-Schmidt modificato), n <= D
+static void orthonormalize(type* V, int n, int64_t D) {
+    int64_t e = 0;              // prossimo vettore canonico di riserva
+    for (int c = 0; c < n; c++) {
+        type* v = &V[c * D];
+        for (int p = 0; p < c; p++) {
+            const type* u = &V[p * D];
+            type dot = 0.0;
+            for (int64_t d = 0; d < D; d++) dot += u[d] * v[d];
+            for (int64_t d = 0; d < D; d++) v[d] -= dot * u[d];
+        }
+        type nrm = 0.0;
+        for (int64_t d = 0; d < D; d++) nrm += v[d] * v[d];
+        nrm = sqrt(nrm);
+        // direzione degenere (rango < d'): un vettore canonico, di nuovo ortogonalizzato
+        if (nrm < 1e-12 && e < D) {
+            memset(v, 0, D * sizeof(type));
+            v[e++] = 1.0;
+            c--;
+            continue;
+        }
+        for (int64_t d = 0; d < D; d++) v[d] /= nrm;
+    }
+}
+
+
+// PCA: media e prime d' componenti principali di un campione a passo uniforme
+static void proj_train_pca(params* input) {
+    int64_t N = input->N, D = input->D;
+    int dp = proj_dim(input);
+    int64_t s = N < PROJ_SAMPLE ? N : PROJ_SAMPLE;
+
+    type* mean = _mm_malloc(D * sizeof(type), align);
+    type* Xt = _mm_malloc(D * s * sizeof(type), align);      // campione centrato, trasposto [D x s]
+    type* C = _mm_malloc(D * D * sizeof(type), align);
+    type* V = _mm_malloc(dp * D * sizeof(type), align);
+    type* W = _mm_malloc(dp * D * sizeof(type), align);
+    if (!mean || !Xt || !C || !V || !W) {
+        fprintf(stderr, "Errore allocazione in proj_train\n");
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        type* buf = malloc(D * sizeof(type));
+        #pragma omp for schedule(static)
+        for (int64_t r = 0; r < s; r++) {
+            const type* x = dataset_row(input, r * N / s, buf);
+            for (int64_t d = 0; d < D; d++) Xt[d * s + r] = x[d];
+        }
+        free(buf);
+    }
+    #pragma omp parallel for schedule(static)
+    for (int64_t d = 0; d < D; d++) {
+        type m = 0.0;
+        for (int64_t r = 0; r < s; r++) m += Xt[d * s + r];
+        mean[d] = m / s;
+        for (int64_t r = 0; r < s; r++) Xt[d * s + r] -= mean[d];
+    }
+
+    // covarianza (simmetrica: metà superiore, poi copia)
+    #pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < D; i++)
+        for (int64_t j = i; j < D; j++) {
+            type c = 0.0;
+            for (int64_t r = 0; r < s; r++) c += Xt[i * s + r] * Xt[j * s + r];
+            C[i * D + j] = C[j * D + i] = c / s;
+        }
+    _mm_free(Xt);
+
+    // iterazione a sottospazio: V <- orth(C V), partendo da direzioni casuali
+    uint64_t state = input->seed ^ 0x9ca9ca9cULL;
+    for (int64_t i = 0; i < dp * D; i++) V[i] = rand_unit(&state) - 0.5;
+    orthonormalize(V, dp, D);
+    for (int it = 0; it < PROJ_ITERS; it++) {
+        #pragma omp parallel for collapse(2) schedule(static)
+        for (int c = 0; c < dp; c++)
+            for (int64_t i = 0; i < D; i++) {
+                type w = 0.0;
+                for (int64_t j = 0; j < D; j++) w += C[i * D + j] * V[c * D + j];
+                W[c * D + i] = w;
+            }
+        orthonormalize(W, dp, D);
+        type* t = V;
+        V = W;
+        W = t;
+    }
+    _mm_free(C);
+    _mm_free(W);
+
+    input->proj_mean = mean;
+    input->proj_basis = V;
+}
+
+
+// SRHT: segni casuali e d' coordinate distinte della trasformata (seme input->seed)
+static void proj_train_srht(params* input) {
+    int64_t D = input->D, L = proj_len(input);
+    int dp = proj_dim(input);
+    int8_t* sign = malloc(D * sizeof(int8_t));
+    int32_t* perm = malloc(L * sizeof(int32_t));
+    if (!sign || !perm) {
+        fprintf(stderr, "Errore allocazione in proj_train\n");
+        exit(1);
+    }
+    uint64_t state = input->seed ^ 0x5eed5eedULL;
+    for (int64_t d = 0; d < D; d++) sign[d] = rand_unit(&state) < 0.5 ? -1 : 1;
+    for (int64_t i = 0; i < L; i++) perm[i] = (int32_t)i;
+    for (int c = 0; c < dp; c++) {
+        int64_t j = c + (int64_t)(rand_unit(&state) * (L - c));
+        if (j >= L) j = L - 1;
+        int32_t t = perm[c];
+        perm[c] = perm[j];
+        perm[j] = t;
+    }
+    input->proj_sign = sign;
+    input->proj_coord = realloc(perm, dp * sizeof(int32_t));
+}
+
+
+/*
+ *  PROJ_TRAIN - Proiezione (proj_mode) e vettori ridotti DS_proj di tutte
+ *  le righe dai vettori in memoria (DS o DS_half).
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int proj_train(params* input) {
+    int64_t N = input->N, D = input->D;
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore proj_train: dataset in memoria non disponibile\n");
+        return -1;
+    }
+    if (input->proj_mode != PROJ_PCA && input->proj_mode != PROJ_SRHT) {
+        fprintf(stderr, "Errore proj_train: proj_mode=%d non valido\n", input->proj_mode);
+        return -1;
+    }
+    int dp = proj_dim(input);
+    double t = omp_get_wtime();
+
+    if (input->proj_mode == PROJ_PCA) proj_train_pca(input);
+    else proj_train_srht(input);
+
+    type* red = _mm_malloc(N * dp * sizeof(type), align);
+    if (!red) {
+        fprintf(stderr, "Errore allocazione in proj_train\n");
+        exit(1);
+    }
+    #pragma omp parallel
+    {
+        type* row = malloc(D * sizeof(type));
+        type* buf = malloc(proj_len(input) * sizeof(type));
+        #pragma omp for schedule(static)
+        for (int64_t i = 0; i < N; i++)
+            project(input, dataset_row(input, i, row), &red[i * dp], buf);
+        free(row);
+        free(buf);
+    }
+    input->DS_proj = red;
+
+    if (!input->silent)
+        printf("[PROIEZIONE] %s, D=%ld -> d'=%d (%.1f MiB), %.3f s\n",
+               input->proj_mode == PROJ_PCA ? "PCA" : "SRHT", D, dp,
+               N * dp * sizeof(type) / 1048576.0, omp_get_wtime() - t);
+    return 0;
+}
+
+
+/*
+ *  PROJ_RERANK - I keep migliori tra gli n candidati ids (ids[i] < 0:
+ *  nessun candidato) per distanza ridotta, ordinati in out_ids/out_dists.
+ *  qr: buffer [d' + proj_len()] per la query ridotta e la trasformata.
+ *  out_ids non deve sovrapporsi a ids.
+ */
+static void proj_rerank(const params* input, const type* q, type* qr, const ID* ids, int n,
+                        int keep, ID* out_ids, type* out_dists) {
+    int dp = proj_dim(input);
+    const type* red = input->DS_proj;
+    project(input, q, qr, qr + dp);
+
+    topk_t top;
+    topk_init(&top, out_ids, out_dists, keep);
+    for (int i = 0; i < n && i < REFINE_AHEAD; i++)
+        if (ids[i] >= 0) prefetch_row(&red[ids[i] * dp], dp * sizeof(type));
+
+    for (int i = 0; i < n; i++) {
+        if (ids[i] < 0) continue;
+        if (i + REFINE_AHEAD < n && ids[i + REFINE_AHEAD] >= 0)
+            prefetch_row(&red[ids[i + REFINE_AHEAD] * dp], dp * sizeof(type));
+        const type* r = &red[ids[i] * dp];
+        type s = 0.0;
+        for (int c = 0; c < dp; c++) {
+            type a = qr[c] - r[c];
+            s += a * a;
+        }
+        if (s <= topk_bound(&top)) topk_push(&top, s, ids[i]);
+    }
+
+    topk_finish(&top);
+    for (int i = 0; i < keep; i++) out_dists[i] = sqrt(out_dists[i]);
+}
@@ -8,6 +8,13 @@
 
 #include "quantpivot64omp.c"
 
+// dtype NumPy degli ID restituiti da predict()
+#ifdef ID64
+#define	NPY_ID		NPY_INT64
+#else
+#define	NPY_ID		NPY_INT32
+#endif
+
 // Struttura per l'oggetto QuantPivot
 typedef struct {
 	// Espande a campi obbligatori che ogni oggetto Python deve avere
@@ -28,11 +35,8 @@ static void mm_free_destructor(PyObject* capsule) {
 
 // Deallocazione (pulizia memoria quando l'oggetto viene distrutto)
 static void QuantPivot64omp_dealloc(QuantPivot64ompObject *self) {
-	// Libera memoria allocata
-	if (self->input->P != NULL)
-		_mm_free(self->input->P);
-	if (self->input->index != NULL)
-		_mm_free(self->input->index);
+	// Libera memoria allocata (o rilascia la mappatura condivisa)
+	release_index(self->input);
 	// Decrementa riferimenti agli array NumPy
 	Py_XDECREF(self->DS_array);
 	Py_XDECREF(self->Q_array);
@@ -61,6 +65,80 @@ static int QuantPivot64omp_init(QuantPivot64ompObject *self, PyObject *args, PyO
 	self->input->id_nn = NULL;		// identificativi dei vicini
 	self->input->dist_nn = NULL;	// distanze dai vicini
 	self->input->silent = 0;		// modalità silenziosa
+	self->input->DS_quantized_plus = NULL;
+	self->input->DS_quantized_minus = NULL;
+	self->input->P_quantized_plus = NULL;
+	self->input->P_quantized_minus = NULL;
+	self->input->shm_base = NULL;	// indice privato finché non si chiama attach()
+	self->input->shm_size = 0;
+	self->input->ds_base = NULL;	// dataset mappato da fit_stream() su file
+	self->input->ds_size = 0;
+	self->input->ds_fd = -1;		// dataset in memoria finché non si chiama disk_dataset()
+	self->input->pivot_strategy = PIVOTS_UNIFORM;
+	self->input->seed = 0;
+	self->input->r = 0;				// rerank: solo i k candidati
+	self->input->plan = PLAN_AUTO;	// pruning o forza bruta scelti per lotto
+	self->input->mode = MODE_PIVOT;
+	self->input->norms = NULL;		// calcolate alla prima predict(mode='exact')
+	self->input->var_order = 0;
+	self->input->dim_order = NULL;
+	self->input->DS_half = NULL;	// dataset a 16 bit (compact() o fit_stream() su .ds3 f16/bf16)
+	self->input->half_dtype = 0;
+	self->input->half_owned = 0;
+	self->input->sq_mode = SQ_OFF;	// nessun livello int8 finché fit(sq=...) non lo chiede
+	self->input->sq_keep = 0;
+	self->input->sq_clip = 0.0;
+	self->input->DS_sq = NULL;
+	self->input->sq_min = NULL;
+	self->input->sq_scale = NULL;
+	self->input->sq_norms = NULL;
+	self->input->proj_mode = PROJ_OFF;	// nessun filtro ridotto finché fit(proj=...) non lo chiede
+	self->input->proj_dim = 0;
+	self->input->proj_keep = 0;
+	self->input->proj_mean = NULL;
+	self->input->proj_basis = NULL;
+	self->input->proj_sign = NULL;
+	self->input->proj_coord = NULL;
+	self->input->DS_proj = NULL;
+	self->input->levels = 0;		// nessuna cascata finché fit(cascade=...) non la chiede
+	for (int l = 0; l < CASCADE_MAX; l++) {
+		self->input->level_x[l] = 0;
+		self->input->level_keep[l] = 0;
+		self->input->level_vp[l] = NULL;
+		self->input->level_vm[l] = NULL;
+	}
+	self->input->pq_m = 0;			// indice PQ solo con fit(engine='pq')
+	self->input->pq_bits = 8;
+	self->input->pq_iters = 0;
+	self->input->pq_refine = 1;
+	self->input->pq_centroids = NULL;
+	self->input->pq_codes = NULL;
+	self->input->ivf_nlist = 0;		// liste invertite solo con fit(engine='ivf')
+	self->input->ivf_nprobe = 0;
+	self->input->ivf_iters = 0;
+	self->input->ivf_centroids = NULL;
+	self->input->ivf_norms = NULL;
+	self->input->ivf_offsets = NULL;
+	self->input->ivf_ids = NULL;
+	self->input->hnsw_m = 0;			// grafo solo con fit(engine='hnsw')
+	self->input->hnsw_ef_construction = 0;
+	self->input->hnsw_ef_search = 0;
+	self->input->hnsw_level = NULL;
+	self->input->hnsw_link_off = NULL;
+	self->input->hnsw_links0 = NULL;
+	self->input->hnsw_links = NULL;
+	self->input->vpt_leaf = 0;			// VP-tree solo con fit(engine='vpt')
+	self->input->vpt_nnodes = 0;
+	self->input->vpt_nodes = NULL;
+	self->input->vpt_ids = NULL;
+	self->input->vpt_table = NULL;
+	self->input->mih_m = 0;			// tabelle hash solo con fit(engine='mih')
+	self->input->mih_radius = -1;
+	self->input->mih_table = NULL;
+	self->input->mih_keys = NULL;
+	self->input->mih_bucket = NULL;
+	self->input->mih_ids = NULL;
+	memset(&self->input->stats, 0, sizeof(qp_stats));
     return 0;
 }
 
@@ -69,12 +147,140 @@ static PyObject* QuantPivot64omp_fit(QuantPivot64ompObject *self, PyObject *args
 	PyArrayObject *ds_array;
 
 	int h, x, silent = 1;
+	const char* pivots = "uniform";
+	unsigned long long seed = 0;
+	int rerank = 0;
+	const char* dim_order = "natural";
+	const char* sq = "off";
+	int sq_keep = 0;
+	double sq_clip = 0.0;
+	PyObject* cascade = NULL;
+	const char* engine = "pivot";
+	int pq_m = 0, pq_bits = 8, pq_iters = 0, pq_refine = 1;
+	int ivf_nlist = 0, ivf_iters = 0;
+	int hnsw_m = 16, ef_construction = 0;
+	int vpt_leaf = 0;
+	int mih_m = 0;
+	const char* proj = "off";
+	int proj_dim = 0, proj_keep = 0;
 
-	static char *kwlist[] = {"dataset", "n_pivots", "quant_level", "silent", NULL};
+	static char *kwlist[] = {"dataset", "n_pivots", "quant_level", "silent", "pivots", "seed",
+							 "rerank", "dim_order", "sq", "sq_keep", "sq_clip", "cascade",
+							 "engine", "pq_m", "pq_bits", "pq_iters", "pq_refine",
+							 "ivf_nlist", "ivf_iters", "hnsw_m", "ef_construction", "vpt_leaf",
+							 "mih_m", "proj", "proj_dim", "proj_keep", NULL};
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!ii|i", kwlist,
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!ii|isKissidOsiiipiiiiiisii", kwlist,
 									&PyArray_Type, &ds_array,
-									&h, &x, &silent)) {
+									&h, &x, &silent, &pivots, &seed, &rerank, &dim_order,
+									&sq, &sq_keep, &sq_clip, &cascade,
+									&engine, &pq_m, &pq_bits, &pq_iters, &pq_refine,
+									&ivf_nlist, &ivf_iters, &hnsw_m, &ef_construction, &vpt_leaf,
+									&mih_m, &proj, &proj_dim, &proj_keep)) {
+		return NULL;
+	}
+
+	// Motore dell'indice: pivot (anche a liste invertite o con tabelle hash), quantizzazione
+	// a prodotto, grafo o albero
+	int mode;
+	if (strcmp(engine, "pivot") == 0) mode = MODE_PIVOT;
+	else if (strcmp(engine, "ivf") == 0) mode = MODE_IVF;
+	else if (strcmp(engine, "pq") == 0) mode = MODE_PQ;
+	else if (strcmp(engine, "hnsw") == 0) mode = MODE_HNSW;
+	else if (strcmp(engine, "vpt") == 0) mode = MODE_VPT;
+	else if (strcmp(engine, "mih") == 0) mode = MODE_MIH;
+	else {
+		PyErr_Format(PyExc_ValueError,
+					 "Unknown engine '%s', expected 'pivot', 'ivf', 'mih', 'pq', 'hnsw' or 'vpt'", engine);
+		return NULL;
+	}
+	if (mode == MODE_HNSW && hnsw_m <= 1) {
+		PyErr_SetString(PyExc_ValueError, "hnsw_m must be at least 2");
+		return NULL;
+	}
+	if (mode == MODE_PQ && pq_bits != 4 && pq_bits != 8) {
+		PyErr_SetString(PyExc_ValueError, "pq_bits must be 4 or 8");
+		return NULL;
+	}
+	if (mode == MODE_PQ && (pq_m <= 0 || (pq_bits == 4 && pq_m > 256))) {
+		PyErr_SetString(PyExc_ValueError, "pq_m must be positive (at most 256 with pq_bits=4)");
+		return NULL;
+	}
+
+	// Cascata: sequenza di x oppure di coppie (x, keep)
+	int levels = 0, level_x[CASCADE_MAX], level_keep[CASCADE_MAX];
+	if (cascade != NULL && cascade != Py_None) {
+		PyObject* seq = PySequence_Fast(cascade, "cascade must be a sequence of x or (x, keep)");
+		if (seq == NULL)
+			return NULL;
+		levels = (int)PySequence_Fast_GET_SIZE(seq);
+		if (levels > CASCADE_MAX) {
+			Py_DECREF(seq);
+			PyErr_Format(PyExc_ValueError, "cascade has %d levels, at most %d allowed", levels, CASCADE_MAX);
+			return NULL;
+		}
+		for (int l = 0; l < levels; l++) {
+			PyObject* item = PySequence_Fast_GET_ITEM(seq, l);
+			level_keep[l] = 0;
+			int ok;
+			if (PyTuple_Check(item)) {
+				ok = PyArg_ParseTuple(item, "i|i", &level_x[l], &level_keep[l]);
+			} else {
+				level_x[l] = (int)PyLong_AsLong(item);
+				ok = !PyErr_Occurred();
+			}
+			if (!ok || level_x[l] <= 0) {
+				Py_DECREF(seq);
+				if (!PyErr_Occurred())
+					PyErr_SetString(PyExc_ValueError, "cascade levels need a positive x");
+				return NULL;
+			}
+		}
+		Py_DECREF(seq);
+	}
+
+	// Livello intermedio int8
+	int sq_mode;
+	if (strcmp(sq, "off") == 0) sq_mode = SQ_OFF;
+	else if (strcmp(sq, "rerank") == 0) sq_mode = SQ_RERANK;
+	else if (strcmp(sq, "only") == 0) sq_mode = SQ_ONLY;
+	else {
+		PyErr_Format(PyExc_ValueError, "Unknown sq '%s', expected 'off', 'rerank' or 'only'", sq);
+		return NULL;
+	}
+	if (sq_clip < 0.0 || sq_clip >= 0.5) {
+		PyErr_SetString(PyExc_ValueError, "sq_clip must be in [0, 0.5)");
+		return NULL;
+	}
+
+	// Filtro in dimensione ridotta
+	int proj_mode;
+	if (strcmp(proj, "off") == 0) proj_mode = PROJ_OFF;
+	else if (strcmp(proj, "pca") == 0) proj_mode = PROJ_PCA;
+	else if (strcmp(proj, "srht") == 0) proj_mode = PROJ_SRHT;
+	else {
+		PyErr_Format(PyExc_ValueError, "Unknown proj '%s', expected 'off', 'pca' or 'srht'", proj);
+		return NULL;
+	}
+
+	// Ordine delle dimensioni per l'early abandon del raffinamento
+	int var_order;
+	if (strcmp(dim_order, "natural") == 0) var_order = 0;
+	else if (strcmp(dim_order, "variance") == 0) var_order = 1;
+	else {
+		PyErr_Format(PyExc_ValueError, "Unknown dim_order '%s', expected 'natural' or 'variance'", dim_order);
+		return NULL;
+	}
+
+	// Strategia di selezione dei pivot
+	int strategy;
+	if (strcmp(pivots, "uniform") == 0) strategy = PIVOTS_UNIFORM;
+	else if (strcmp(pivots, "random") == 0) strategy = PIVOTS_RANDOM;
+	else if (strcmp(pivots, "fft") == 0) strategy = PIVOTS_FFT;
+	else if (strcmp(pivots, "incremental") == 0) strategy = PIVOTS_INCREMENTAL;
+	else {
+		PyErr_Format(PyExc_ValueError,
+					"Unknown pivots '%s', expected 'uniform', 'random', 'fft' or 'incremental'", pivots);
 		return NULL;
 	}
 
@@ -102,8 +308,30 @@ static PyObject* QuantPivot64omp_fit(QuantPivot64ompObject *self, PyObject *args
 	}
 
 	// Estrai dimensioni
-	self->input->N = (int)PyArray_DIM(ds_array, 0);
-	self->input->D = (int)PyArray_DIM(ds_array, 1);
+	self->input->N = PyArray_DIM(ds_array, 0);
+	self->input->D = PyArray_DIM(ds_array, 1);
+
+	// Gli ID a 32 bit non bastano oltre 2^31 righe
+	if (self->input->N > ID_MAX) {
+		PyErr_SetString(PyExc_OverflowError,
+					"Dataset has more rows than 32-bit ids allow, rebuild with QP_ID64=1");
+		return NULL;
+	}
+
+	if (mode == MODE_IVF && (ivf_nlist <= 0 || ivf_nlist > self->input->N)) {
+		PyErr_SetString(PyExc_ValueError, "ivf_nlist must be between 1 and the number of rows");
+		return NULL;
+	}
+	if (mode == MODE_MIH && (mih_m <= 0 || (self->input->D + mih_m - 1) / mih_m > MIH_SUB_MAX)) {
+		PyErr_Format(PyExc_ValueError, "mih_m must be at least ceil(D / %d) = %ld", MIH_SUB_MAX,
+					 (long)((self->input->D + MIH_SUB_MAX - 1) / MIH_SUB_MAX));
+		return NULL;
+	}
+	if (mode == MODE_PQ && (self->input->D % pq_m != 0 || self->input->N < (1 << pq_bits))) {
+		PyErr_Format(PyExc_ValueError, "pq_m=%d must divide D=%ld and N must be at least %d",
+					 pq_m, (long)self->input->D, 1 << pq_bits);
+		return NULL;
+	}
 
 	// Estrae il numero di pivot
 	self->input->h = h;
@@ -114,6 +342,36 @@ static PyObject* QuantPivot64omp_fit(QuantPivot64ompObject *self, PyObject *args
 	// Estrae il flag silent
 	self->input->silent = silent;
 
+	self->input->pivot_strategy = strategy;
+	self->input->seed = seed;
+	self->input->r = rerank;
+	self->input->var_order = var_order;
+	self->input->sq_mode = sq_mode;
+	self->input->sq_keep = sq_keep;
+	self->input->sq_clip = sq_clip;
+	self->input->proj_mode = proj_mode;
+	self->input->proj_dim = proj_dim;
+	self->input->proj_keep = proj_keep;
+	self->input->levels = levels;
+	for (int l = 0; l < levels; l++) {
+		self->input->level_x[l] = level_x[l];
+		self->input->level_keep[l] = level_keep[l];
+	}
+	self->input->mode = mode;
+	self->input->pq_m = pq_m;
+	self->input->pq_bits = pq_bits;
+	self->input->pq_iters = pq_iters;
+	self->input->pq_refine = pq_refine;
+	self->input->ivf_nlist = ivf_nlist;
+	self->input->ivf_iters = ivf_iters;
+	self->input->hnsw_m = hnsw_m;
+	self->input->hnsw_ef_construction = ef_construction;
+	self->input->vpt_leaf = vpt_leaf;
+	self->input->mih_m = mih_m;
+
+	// Rilascia un eventuale indice precedente (fit ripetuto o attach)
+	release_index(self->input);
+
 	// Salva riferimento all'array con INCREF
 	Py_INCREF(ds_array);
 	Py_XDECREF(self->DS_array);
@@ -130,24 +388,275 @@ static PyObject* QuantPivot64omp_fit(QuantPivot64ompObject *self, PyObject *args
 	return (PyObject *)self;
 }
 
+// Sorgente a blocchi su un iteratore Python di array (n, D)
+typedef struct {
+	PyObject* iter;
+	PyArrayObject* current;		// blocco corrente, tenuto vivo fino al successivo
+	PyArrayObject* pending;		// primo blocco, già letto per ricavare D
+	int64_t D;
+} py_source;
+
+static int64_t py_source_next(void* ctx, const type** rows) {
+	py_source* ps = ctx;
+	PyArrayObject* arr;
+
+	Py_CLEAR(ps->current);
+	if (ps->pending != NULL) {
+		arr = ps->pending;
+		ps->pending = NULL;
+	} else {
+		PyObject* item = PyIter_Next(ps->iter);
+		if (item == NULL)
+			return PyErr_Occurred() ? -1 : 0;
+		arr = (PyArrayObject*)PyArray_FROMANY(item, NPY_FLOAT64, 2, 2,
+											 NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED);
+		Py_DECREF(item);
+		if (arr == NULL)
+			return -1;
+	}
+
+	if (PyArray_DIM(arr, 1) != ps->D) {
+		PyErr_SetString(PyExc_ValueError, "All chunks must have the same number of columns");
+		Py_DECREF(arr);
+		return -1;
+	}
+
+	ps->current = arr;
+	*rows = (const type*)PyArray_DATA(arr);
+	return PyArray_DIM(arr, 0);
+}
+
+// Metodo fit_stream
+static PyObject* QuantPivot64omp_fit_stream(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	PyObject* source;
+	PyArrayObject* ds_array = NULL;
+	const char* pivots = NULL;
+	int h, x, silent = 1;
+	Py_ssize_t n_rows = -1, chunk_rows = 65536;
+	unsigned long long seed = 0;
+
+	static char* kwlist[] = {"source", "n_pivots", "quant_level", "n_rows", "chunk_rows",
+							 "pivots", "seed", "dataset", "silent", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oii|nnzKO!i", kwlist,
+									&source, &h, &x, &n_rows, &chunk_rows,
+									&pivots, &seed, &PyArray_Type, &ds_array, &silent))
+		return NULL;
+
+	int is_path = PyUnicode_Check(source);
+
+	// Default: prima passata sui file (stessi pivot di fit()), reservoir sugli iteratori
+	int mode = is_path ? STREAM_PIVOTS_FIRST_PASS : STREAM_PIVOTS_RESERVOIR;
+	if (pivots != NULL) {
+		if (strcmp(pivots, "first_pass") == 0) {
+			mode = STREAM_PIVOTS_FIRST_PASS;
+		} else if (strcmp(pivots, "reservoir") == 0) {
+			mode = STREAM_PIVOTS_RESERVOIR;
+		} else {
+			PyErr_SetString(PyExc_ValueError, "pivots must be 'first_pass' or 'reservoir'");
+			return NULL;
+		}
+	}
+	if (!is_path && mode == STREAM_PIVOTS_FIRST_PASS) {
+		PyErr_SetString(PyExc_ValueError,
+					"pivots='first_pass' needs a file path, iterators can only be read once");
+		return NULL;
+	}
+	if (h <= 0 || x <= 0) {
+		PyErr_SetString(PyExc_ValueError, "n_pivots and quant_level must be positive");
+		return NULL;
+	}
+
+	release_index(self->input);
+	Py_CLEAR(self->DS_array);
+	self->input->DS = NULL;
+	self->input->h = h;
+	self->input->x = x;
+	self->input->silent = silent;
+
+	// Sempre l'indice a pivot semplice: motore e livelli di un fit() precedente non valgono
+	self->input->mode = MODE_PIVOT;
+	self->input->pq_m = 0;
+	self->input->ivf_nlist = 0;
+	self->input->vpt_leaf = 0;
+	self->input->mih_m = 0;
+	self->input->sq_mode = SQ_OFF;
+	self->input->proj_mode = PROJ_OFF;
+	self->input->levels = 0;
+
+	int ret;
+	if (is_path) {
+		const char* filename = PyUnicode_AsUTF8(source);
+		if (filename == NULL)
+			return NULL;
+
+		Py_BEGIN_ALLOW_THREADS
+		ret = fit_file(self->input, filename, chunk_rows, mode, seed);
+		Py_END_ALLOW_THREADS
+
+		if (ret != 0) {
+			release_index(self->input);
+			PyErr_Format(PyExc_OSError, "Streaming fit from '%s' failed", filename);
+			return NULL;
+		}
+	} else {
+		if (n_rows < h) {
+			PyErr_SetString(PyExc_ValueError,
+						"n_rows (total rows, at least n_pivots) is required for iterators");
+			return NULL;
+		}
+		if (n_rows > ID_MAX) {
+			PyErr_SetString(PyExc_OverflowError,
+						"Dataset has more rows than 32-bit ids allow, rebuild with QP_ID64=1");
+			return NULL;
+		}
+
+		py_source ps = {NULL, NULL, NULL, 0};
+		ps.iter = PyObject_GetIter(source);
+		if (ps.iter == NULL)
+			return NULL;
+
+		// Il primo blocco fissa D
+		PyObject* first = PyIter_Next(ps.iter);
+		if (first == NULL) {
+			if (!PyErr_Occurred())
+				PyErr_SetString(PyExc_ValueError, "Empty iterator");
+			Py_DECREF(ps.iter);
+			return NULL;
+		}
+		ps.pending = (PyArrayObject*)PyArray_FROMANY(first, NPY_FLOAT64, 2, 2,
+													 NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED);
+		Py_DECREF(first);
+		if (ps.pending == NULL) {
+			Py_DECREF(ps.iter);
+			return NULL;
+		}
+		ps.D = PyArray_DIM(ps.pending, 1);
+
+		self->input->N = n_rows;
+		self->input->D = ps.D;
+
+		chunk_source src = { py_source_next, NULL, &ps };
+		ret = fit_stream(self->input, &src, mode, seed);
+
+		Py_XDECREF(ps.pending);
+		Py_XDECREF(ps.current);
+		Py_DECREF(ps.iter);
+
+		if (ret != 0) {
+			release_index(self->input);
+			if (!PyErr_Occurred())
+				PyErr_SetString(PyExc_ValueError,
+							"Iterator produced a different number of rows than n_rows");
+			return NULL;
+		}
+	}
+
+	// Vettori per il raffinamento forniti dal chiamante (es. np.memmap)
+	if (ds_array != NULL) {
+		if (PyArray_NDIM(ds_array) != 2 || PyArray_TYPE(ds_array) != NPY_FLOAT64 ||
+			PyArray_DIM(ds_array, 0) != self->input->N || PyArray_DIM(ds_array, 1) != self->input->D ||
+			!PyArray_IS_C_CONTIGUOUS(ds_array) || (uintptr_t)PyArray_DATA(ds_array) % align != 0) {
+			release_index(self->input);
+			PyErr_SetString(PyExc_ValueError,
+						"dataset must be an aligned C-contiguous float64 array of shape (N, D)");
+			return NULL;
+		}
+		if (self->input->ds_base != NULL) {
+			munmap(self->input->ds_base, self->input->ds_size);
+			self->input->ds_base = NULL;
+			self->input->ds_size = 0;
+		}
+		Py_INCREF(ds_array);
+		self->DS_array = ds_array;
+		self->input->DS = (type*)PyArray_DATA(ds_array);
+	}
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
 // Metodo predict
 static PyObject* QuantPivot64omp_predict(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
 	PyArrayObject* query_array;
 	int k, silent = 0;
+	const char* plan = "auto";
+	const char* mode = NULL;
+	int nprobe = 0, ef_search = 0, radius = -1;
 
-	static char* kwlist[] = {"query", "k", "silent", NULL};
+	static char* kwlist[] = {"query", "k", "silent", "plan", "mode", "nprobe", "ef_search", "radius",
+							 NULL};
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!i|i", kwlist,
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!i|isziii", kwlist,
 									&PyArray_Type, &query_array,
-									&k, &silent))
+									&k, &silent, &plan, &mode, &nprobe, &ef_search, &radius))
+		return NULL;
+
+	// Liste visitate per query (solo per fit(engine='ivf')) e candidati del grafo
+	self->input->ivf_nprobe = nprobe;
+	self->input->hnsw_ef_search = ef_search;
+	self->input->mih_radius = radius;
+
+	// Motore costruito da fit(): indice quantizzato, PQ, grafo o albero
+	int built = self->input->index != NULL ? MODE_PIVOT :
+				self->input->pq_codes != NULL ? MODE_PQ :
+				self->input->hnsw_links0 != NULL ? MODE_HNSW : MODE_VPT;
+
+	// Motore: quello costruito da fit() (default), uno dei quattro o forza bruta esatta
+	if (mode == NULL) self->input->mode = built;
+	else if (strcmp(mode, "pivot") == 0) self->input->mode = MODE_PIVOT;
+	else if (strcmp(mode, "pq") == 0) self->input->mode = MODE_PQ;
+	else if (strcmp(mode, "hnsw") == 0) self->input->mode = MODE_HNSW;
+	else if (strcmp(mode, "vpt") == 0) self->input->mode = MODE_VPT;
+	else if (strcmp(mode, "exact") == 0) self->input->mode = MODE_EXACT;
+	else {
+		PyErr_Format(PyExc_ValueError,
+					 "Unknown mode '%s', expected 'pivot', 'pq', 'hnsw', 'vpt' or 'exact'", mode);
+		return NULL;
+	}
+
+	// Strategia di scansione: scelta dal planner o forzata
+	if (strcmp(plan, "auto") == 0) self->input->plan = PLAN_AUTO;
+	else if (strcmp(plan, "prune") == 0) self->input->plan = PLAN_PRUNE;
+	else if (strcmp(plan, "brute") == 0) self->input->plan = PLAN_BRUTE;
+	else {
+		PyErr_Format(PyExc_ValueError, "Unknown plan '%s', expected 'auto', 'prune' or 'brute'", plan);
 		return NULL;
+	}
 
 	// Verifica che fit sia stato chiamato
-	if (self->input->index == NULL) {
+	if (self->input->index == NULL && self->input->pq_codes == NULL &&
+		self->input->hnsw_links0 == NULL && self->input->vpt_nodes == NULL) {
 		PyErr_SetString(PyExc_RuntimeError,
 					"Model not fitted, call fit() before predict()");
 		return NULL;
 	}
+	if (self->input->mode != built && self->input->mode != MODE_EXACT) {
+		PyErr_Format(PyExc_RuntimeError, "mode='%s' needs fit(engine='%s')", mode, mode);
+		return NULL;
+	}
+
+	// Dopo fit_stream() su iteratore i vettori completi vanno forniti a parte
+	// (il motore PQ ne fa a meno senza raffinamento)
+	if (self->input->DS == NULL && self->input->DS_half == NULL && self->input->ds_fd < 0 &&
+		!(self->input->sq_mode == SQ_ONLY && self->input->DS_sq != NULL) &&
+		!(self->input->mode == MODE_PQ && !self->input->pq_refine)) {
+		PyErr_SetString(PyExc_RuntimeError,
+					"No full-precision dataset for refinement, pass dataset= to fit_stream() "
+					"or call disk_dataset()");
+		return NULL;
+	}
+	if ((self->input->mode == MODE_HNSW || self->input->mode == MODE_VPT) &&
+		self->input->DS == NULL && self->input->DS_half == NULL) {
+		PyErr_Format(PyExc_RuntimeError, "mode='%s' needs the dataset in memory, not disk_dataset()",
+					 self->input->mode == MODE_HNSW ? "hnsw" : "vpt");
+		return NULL;
+	}
+	if (self->input->mode == MODE_EXACT && self->input->DS == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+					"mode='exact' needs the float64 dataset in memory, not disk_dataset() or compact()");
+		return NULL;
+	}
 
 	// Verifica che Q sia un array NumPy valido
 	if (PyArray_NDIM(query_array) != 2) {
@@ -173,7 +682,7 @@ static PyObject* QuantPivot64omp_predict(QuantPivot64ompObject *self, PyObject *
 	}
 
 	// Estrai dimensioni
-	self->input->nq = (int)PyArray_DIM(query_array, 0);
+	self->input->nq = PyArray_DIM(query_array, 0);
 
 	// Estrae il numero di K vicini
 	self->input->k = k;
@@ -184,13 +693,12 @@ static PyObject* QuantPivot64omp_predict(QuantPivot64ompObject *self, PyObject *
 	// le stesse modifiche fatte nelle due verisoni precedenti
 	self->input->Q = query;
 	
-	// salva riferimento 
-	riferimento all'array con INCREF
+	// salva riferimento all'array con INCREF
 	Py_INCREF(query_array);
 	Py_XDECREF(self->Q_array);
 	self->Q_array = query_array;
 
-	self->input->id_nn = (int*) _mm_malloc(self->input->nq * self->input->k * sizeof(int), align);
+	self->input->id_nn = (ID*) _mm_malloc(self->input->nq * self->input->k * sizeof(ID), align);
 	self->input->dist_nn = (type*) _mm_malloc(self->input->nq * self->input->k * sizeof(type), align);
 
 	// ========================================= //
@@ -203,7 +711,7 @@ static PyObject* QuantPivot64omp_predict(QuantPivot64ompObject *self, PyObject *
 	PyArrayObject* id_nn_array = (PyArrayObject*)PyArray_SimpleNewFromData(
 		2,				// ndim
 		dims,			// shape
-		NPY_INT32,		// dtype
+		NPY_ID,			// dtype
 		self->input->id_nn		// data pointer (usa la memoria allineata)
 	);
 	// Crea un capsule per gestire la deallocazione
@@ -237,6 +745,256 @@ static PyObject* QuantPivot64omp_predict(QuantPivot64ompObject *self, PyObject *
     return result;
 }
 
+// Metodo stats
+static PyObject* QuantPivot64omp_stats(QuantPivot64ompObject *self, PyObject *Py_UNUSED(ignored)) {
+	const qp_stats* st = &self->input->stats;
+	return Py_BuildValue("{s:L,s:L,s:d,s:d,s:L,s:L}",
+						 "batches_pruned", (long long)st->batches_pruned,
+						 "batches_brute", (long long)st->batches_brute,
+						 "est_prune_rate", st->est_prune_rate,
+						 "cost_ratio", st->cost_ratio,
+						 "rows_scanned", (long long)st->rows_scanned,
+						 "rows_pruned", (long long)st->rows_pruned);
+}
+
+// Metodo autotune
+static PyObject* QuantPivot64omp_autotune(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	PyArrayObject *ds_array, *query_array;
+	int k, silent = 1, apply = 1;
+	PyObject *recall_obj = Py_None, *latency_obj = Py_None;
+	long long sample_rows = TUNE_ROWS;
+	const char* pivots = "uniform";
+	unsigned long long seed = 0;
+
+	static char *kwlist[] = {"dataset", "queries", "k", "recall", "latency", "sample_rows",
+							 "apply", "pivots", "seed", "silent", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|OOLpsKi", kwlist,
+									&PyArray_Type, &ds_array, &PyArray_Type, &query_array,
+									&k, &recall_obj, &latency_obj, &sample_rows,
+									&apply, &pivots, &seed, &silent))
+		return NULL;
+
+	// Obiettivo: recall@k minimo (default 0.9) oppure budget di latenza per query
+	int target_kind = TUNE_RECALL;
+	double target = 0.9;
+	if (recall_obj != Py_None && latency_obj != Py_None) {
+		PyErr_SetString(PyExc_ValueError, "Pass either recall or latency, not both");
+		return NULL;
+	}
+	if (latency_obj != Py_None) {
+		target_kind = TUNE_LATENCY;
+		target = PyFloat_AsDouble(latency_obj);
+	} else if (recall_obj != Py_None) {
+		target = PyFloat_AsDouble(recall_obj);
+	}
+	if (PyErr_Occurred())
+		return NULL;
+
+	if (PyArray_NDIM(ds_array) != 2 || PyArray_NDIM(query_array) != 2 ||
+		PyArray_TYPE(ds_array) != NPY_FLOAT64 || PyArray_TYPE(query_array) != NPY_FLOAT64 ||
+		!PyArray_IS_C_CONTIGUOUS(ds_array) || !PyArray_IS_C_CONTIGUOUS(query_array) ||
+		PyArray_DIM(ds_array, 1) != PyArray_DIM(query_array, 1)) {
+		PyErr_SetString(PyExc_ValueError,
+					"dataset and queries must be C-contiguous float64 2D arrays with the same D");
+		return NULL;
+	}
+	if ((uintptr_t)PyArray_DATA(ds_array) % align != 0 ||
+		(uintptr_t)PyArray_DATA(query_array) % align != 0) {
+		PyErr_SetString(PyExc_ValueError, "Input arrays not aligned");
+		return NULL;
+	}
+
+	// parametri di lavoro: il modello corrente non viene toccato
+	params tune;
+	memset(&tune, 0, sizeof(tune));
+	tune.DS = (type*)PyArray_DATA(ds_array);
+	tune.N = PyArray_DIM(ds_array, 0);
+	tune.D = PyArray_DIM(ds_array, 1);
+	tune.silent = silent;
+	tune.ds_fd = -1;
+	tune.seed = seed;
+	tune.pivot_strategy = strcmp(pivots, "random") == 0 ? PIVOTS_RANDOM :
+						  strcmp(pivots, "fft") == 0 ? PIVOTS_FFT :
+						  strcmp(pivots, "incremental") == 0 ? PIVOTS_INCREMENTAL : PIVOTS_UNIFORM;
+
+	qp_tuning best;
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = autotune(&tune, (type*)PyArray_DATA(query_array), PyArray_DIM(query_array, 0), k,
+				   target_kind, target, sample_rows, &best);
+	Py_END_ALLOW_THREADS
+
+	if (ret != 0) {
+		PyErr_SetString(PyExc_ValueError, "Autotune failed, see stderr");
+		return NULL;
+	}
+
+	// applica: fit sul dataset completo con la configurazione scelta
+	if (apply) {
+		PyObject* fit_args = Py_BuildValue("(Oiii)", ds_array, best.h, best.x, silent);
+		PyObject* fit_kwargs = Py_BuildValue("{s:s,s:K,s:i}", "pivots", pivots, "seed", seed,
+											 "rerank", best.r);
+		PyObject* res = fit_args && fit_kwargs ? QuantPivot64omp_fit(self, fit_args, fit_kwargs) : NULL;
+		Py_XDECREF(fit_args);
+		Py_XDECREF(fit_kwargs);
+		if (res == NULL)
+			return NULL;
+		Py_DECREF(res);
+	}
+
+	return Py_BuildValue("{s:i,s:i,s:i,s:d,s:d}", "n_pivots", best.h, "quant_level", best.x,
+						 "rerank", best.r, "recall", best.recall, "latency", best.latency);
+}
+
+// Metodo disk_dataset
+static PyObject* QuantPivot64omp_disk_dataset(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	const char* path;
+	int silent = 1;
+
+	static char* kwlist[] = {"path", "silent", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist, &path, &silent))
+		return NULL;
+
+	if (self->input->hnsw_links0 != NULL || self->input->vpt_nodes != NULL) {
+		PyErr_Format(PyExc_RuntimeError, "engine='%s' needs the dataset in memory",
+					 self->input->hnsw_links0 != NULL ? "hnsw" : "vpt");
+		return NULL;
+	}
+	if (self->input->index == NULL && self->input->pq_codes == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+					"Model not fitted, call fit() or fit_stream() before disk_dataset()");
+		return NULL;
+	}
+
+	self->input->silent = silent;
+
+	if (open_disk_dataset(self->input, path) != 0) {
+		PyErr_Format(PyExc_OSError, "Cannot use '%s' as on-disk dataset", path);
+		return NULL;
+	}
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+// Metodo compact
+static PyObject* QuantPivot64omp_compact(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	const char* dtype = "f16";
+	int release = 1, silent = 1;
+
+	static char* kwlist[] = {"dtype", "release", "silent", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|sii", kwlist, &dtype, &release, &silent))
+		return NULL;
+
+	uint32_t code;
+	if (strcmp(dtype, "f16") == 0) code = DS3_F16;
+	else if (strcmp(dtype, "bf16") == 0) code = DS3_BF16;
+	else {
+		PyErr_Format(PyExc_ValueError, "Unknown dtype '%s', expected 'f16' or 'bf16'", dtype);
+		return NULL;
+	}
+
+	if ((self->input->index == NULL && self->input->pq_codes == NULL &&
+		 self->input->hnsw_links0 == NULL && self->input->vpt_nodes == NULL) || self->input->DS == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+					"compact() needs a fitted model with the float64 dataset in memory");
+		return NULL;
+	}
+
+	self->input->silent = silent;
+
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = compact_dataset(self->input, code, release);
+	Py_END_ALLOW_THREADS
+
+	if (ret != 0) {
+		PyErr_SetString(PyExc_RuntimeError, "compact() failed");
+		return NULL;
+	}
+
+	// senza DS il modello non tiene più in vita l'array del chiamante
+	if (release)
+		Py_CLEAR(self->DS_array);
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+// Metodo export_shared
+static PyObject* QuantPivot64omp_export_shared(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	const char* name;
+
+	static char* kwlist[] = {"name", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &name))
+		return NULL;
+
+	if (self->input->index == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+					"Model not fitted, call fit() before export_shared()");
+		return NULL;
+	}
+
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = export_index(self->input, name);
+	Py_END_ALLOW_THREADS
+
+	if (ret != 0) {
+		PyErr_Format(PyExc_OSError, "Cannot export index to '%s'", name);
+		return NULL;
+	}
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+// Metodo attach
+static PyObject* QuantPivot64omp_attach(QuantPivot64ompObject *self, PyObject *args, PyObject *kwargs) {
+	const char* name;
+	int silent = 1;
+
+	static char* kwlist[] = {"name", "silent", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist, &name, &silent))
+		return NULL;
+
+	// Rilascia l'indice privato: da qui in poi i dati vivono nella mappatura
+	release_index(self->input);
+	Py_CLEAR(self->DS_array);
+
+	self->input->silent = silent;
+
+	if (attach_index(self->input, name) != 0) {
+		PyErr_Format(PyExc_OSError, "Cannot attach shared index '%s'", name);
+		return NULL;
+	}
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+// Metodo statico unlink_shared
+static PyObject* QuantPivot64omp_unlink_shared(PyObject *cls, PyObject *args, PyObject *kwargs) {
+	const char* name;
+
+	static char* kwlist[] = {"name", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &name))
+		return NULL;
+
+	if (unlink_index(name) != 0) {
+		PyErr_Format(PyExc_OSError, "Cannot unlink shared index '%s'", name);
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
 // Tabella dei metodi
 static PyMethodDef QuantPivot64omp_methods[] = {
 	{
@@ -249,6 +1007,155 @@ static PyMethodDef QuantPivot64omp_methods[] = {
 		"  n_pivots: number of pivots\n"
 		"  x: quantization level\n"
 		"  s: silent (default=False)\n"
+		"  pivots: 'uniform' (rows at stride N/h, default), 'random',\n"
+		"          'fft' (farthest-first) or 'incremental' (max mean lower bound);\n"
+		"          non-uniform strategies run on a random sample of the dataset\n"
+		"  seed: seed for 'random', 'fft' and 'incremental' (default=0)\n"
+		"  rerank: candidates refined per query with the exact distance,\n"
+		"          values <= k mean k (default=0)\n"
+		"  dim_order: 'natural' (default) or 'variance': refinement visits\n"
+		"             dimension blocks by decreasing variance, so candidates\n"
+		"             are abandoned earlier\n"
+		"  sq: 'off' (default), 'rerank' or 'only': also store int8 codes\n"
+		"      (per-dimension affine ranges, 1 byte per value). 'rerank' keeps\n"
+		"      the best sq_keep candidates by int8 distance before the exact\n"
+		"      refinement, 'only' returns the int8 distances and never reads\n"
+		"      the full-precision vectors\n"
+		"  sq_keep: candidates kept by sq='rerank', values <= 0 mean 2k (default=0)\n"
+		"  sq_clip: fraction of each tail clipped when training the ranges,\n"
+		"           0 uses min/max (default=0)\n"
+		"  cascade: finer quantization levels applied after the scan, as a\n"
+		"           sequence of x or (x, keep), e.g. [(8, 200), (32, 50)]: each\n"
+		"           level re-scores the survivors with its codes and keeps the\n"
+		"           best keep (default: a quarter of the previous stage)\n"
+		"  proj: 'off' (default), 'pca' or 'srht': also store the rows reduced\n"
+		"        to proj_dim dimensions (principal components of a sample, or\n"
+		"        random signs + Walsh-Hadamard transform + random coordinates).\n"
+		"        After the cascade, the best proj_keep candidates by reduced\n"
+		"        distance (a lower bound of the exact one) go on to sq and the\n"
+		"        exact refinement\n"
+		"  proj_dim: reduced dimensions, values <= 0 mean min(D, 64) (default=0)\n"
+		"  proj_keep: candidates kept by proj, values <= 0 mean 4k (default=0)\n"
+		"  engine: 'pivot' (default), 'ivf', 'mih', 'pq', 'hnsw' or 'vpt'.\n"
+		"          'ivf' splits the pivot index into ivf_nlist inverted lists\n"
+		"          (k-means centroids) and predict() scans only the nprobe\n"
+		"          nearest lists. 'mih' adds hash tables on mih_m substrings of\n"
+		"          the quantized codes: predict() takes its candidates from the\n"
+		"          buckets within a small Hamming radius instead of all rows.\n"
+		"          'pq' uses product quantization instead of the pivot index\n"
+		"          (n_pivots, quant_level, sq, proj and cascade are ignored):\n"
+		"          predict() scans asymmetric distance tables and keeps\n"
+		"          max(rerank, k) candidates. 'hnsw' builds a hierarchical\n"
+		"          proximity graph on the full vectors (same ignored parameters):\n"
+		"          predict() walks it\n"
+		"          with ef_search candidates and returns exact distances. 'vpt'\n"
+		"          builds a vantage-point tree with local pivots (each row keeps\n"
+		"          its distances to n_pivots ancestors): predict() is an exact\n"
+		"          best-first search with the triangle-inequality bound\n"
+		"  ivf_nlist: number of inverted lists for engine='ivf'\n"
+		"  ivf_iters: k-means iterations, values <= 0 mean 10 (default=0)\n"
+		"  mih_m: code substrings hashed by engine='mih', at most 32 dimensions\n"
+		"         each\n"
+		"  pq_m: PQ sub-quantizers, must divide D (pq_m bytes per row with 8 bits)\n"
+		"  pq_bits: 8 (256 centroids per sub-space, default) or 4 (16 centroids,\n"
+		"           SIMD fast-scan with in-register lookup tables)\n"
+		"  pq_iters: k-means iterations, values <= 0 mean 20 (default=0)\n"
+		"  pq_refine: refine the PQ candidates with the exact distance\n"
+		"             (default=True); False returns the PQ distances\n"
+		"  hnsw_m: graph neighbors per node, 2*hnsw_m on the bottom layer\n"
+		"          (default=16)\n"
+		"  ef_construction: candidates explored per insertion, values <= 0\n"
+		"                   mean 200 (default=0)\n"
+		"  vpt_leaf: rows per leaf for engine='vpt', values <= 0 mean 32\n"
+		"            (default=0)\n"
+		"\n"
+		"Returns:\n"
+		"  self"
+	},
+	{
+		"fit_stream",
+		(PyCFunction)QuantPivot64omp_fit_stream,
+		METH_VARARGS | METH_KEYWORDS,
+		"Build the index out-of-core, reading the dataset in chunks\n\n"
+		"Always builds the plain pivot index: the engine, sq, proj and\n"
+		"cascade settings of a previous fit() are reset.\n\n"
+		"Parameters:\n"
+		"  source: path of a .ds2/.ds3 file, or an iterator of (n, D) arrays\n"
+		"  n_pivots: number of pivots\n"
+		"  quant_level: quantization level\n"
+		"  n_rows: total number of rows (required for iterators)\n"
+		"  chunk_rows: rows per chunk when reading a file (default=65536)\n"
+		"  pivots: 'first_pass' (files only, same pivots as fit) or\n"
+		"          'reservoir' (single pass, default for iterators)\n"
+		"  seed: seed for reservoir sampling (default=0)\n"
+		"  dataset: float64 (N, D) array used for refinement, e.g. a np.memmap\n"
+		"           (default: the file itself when it stores float64)\n"
+		"  silent: silent (default=True)\n"
+		"\n"
+		"Returns:\n"
+		"  self"
+	},
+	{
+		"stats",
+		(PyCFunction)QuantPivot64omp_stats,
+		METH_NOARGS,
+		"Statistics of the last predict()\n\n"
+		"Returns:\n"
+		"  dict with batches_pruned / batches_brute (planner choices),\n"
+		"  est_prune_rate (planner estimate of the pruned fraction),\n"
+		"  cost_ratio (bound cost / approximate distance cost per row),\n"
+		"  rows_scanned and rows_pruned (actual)"
+	},
+	{
+		"autotune",
+		(PyCFunction)QuantPivot64omp_autotune,
+		METH_VARARGS | METH_KEYWORDS,
+		"Choose n_pivots, quant_level and rerank depth for a target\n\n"
+		"Sweeps a grid of configurations on a row subsample of the dataset,\n"
+		"measuring recall@k against an exact brute-force baseline and the\n"
+		"predict time per query on the given queries.\n\n"
+		"Parameters:\n"
+		"  dataset: numpy array of shape (N, D)\n"
+		"  queries: sample queries, numpy array of shape (nq, D)\n"
+		"  k: number of neighbors\n"
+		"  recall: minimum recall@k, fastest such configuration wins (default=0.9)\n"
+		"  latency: seconds per query budget, best recall within it wins\n"
+		"  sample_rows: dataset rows used for tuning (default=50000)\n"
+		"  apply: fit the model on the whole dataset with the result (default=True)\n"
+		"  pivots, seed: pivot selection, as in fit()\n"
+		"  silent: silent (default=True)\n"
+		"\n"
+		"Returns:\n"
+		"  dict with n_pivots, quant_level, rerank, recall, latency"
+	},
+	{
+		"disk_dataset",
+		(PyCFunction)QuantPivot64omp_disk_dataset,
+		METH_VARARGS | METH_KEYWORDS,
+		"Keep the full-precision vectors on disk for refinement\n\n"
+		"predict() then reads only the candidate rows of each query batch\n"
+		"from the file, with readahead overlapped with the scan of the next batch.\n"
+		"Call after fit()/fit_stream(); a new fit() closes the file.\n\n"
+		"Parameters:\n"
+		"  path: .ds2 (float64) or .ds3 file with the indexed dataset\n"
+		"  silent: silent (default=True)\n"
+		"\n"
+		"Returns:\n"
+		"  self"
+	},
+	{
+		"compact",
+		(PyCFunction)QuantPivot64omp_compact,
+		METH_VARARGS | METH_KEYWORDS,
+		"Keep the dataset used for refinement as 16-bit floats\n\n"
+		"Converts the float64 dataset to FP16 or BF16 (4x less memory); the\n"
+		"refinement kernel converts rows on the fly and accumulates in float64.\n"
+		"Fitting from a f16/bf16 .ds3 file with fit_stream() does the same\n"
+		"without a copy. mode='exact' and autotune() need the float64 dataset.\n\n"
+		"Parameters:\n"
+		"  dtype: 'f16' (default) or 'bf16'\n"
+		"  release: drop the reference to the float64 dataset (default=True)\n"
+		"  silent: silent (default=True)\n"
 		"\n"
 		"Returns:\n"
 		"  self"
@@ -262,10 +1169,58 @@ static PyMethodDef QuantPivot64omp_methods[] = {
 		"  query: numpy array of shape (nq, D)\n"
 		"  k: number of neighbors\n"
 		"  s: silent (default=False)\n"
+		"  plan: 'auto' (planner picks pivot pruning or brute force per batch,\n"
+		"        default; a query's neighbours may depend on its batch), 'prune'\n"
+		"        or 'brute'; see stats()\n"
+		"  mode: 'pivot' (quantized index), 'pq' (product quantization),\n"
+		"        'hnsw' (proximity graph), 'vpt' (vantage-point tree) or 'exact'\n"
+		"        (blocked brute force on the full-precision dataset); default:\n"
+		"        the engine built by fit()\n"
+		"  nprobe: inverted lists scanned per query after fit(engine='ivf'),\n"
+		"          values <= 0 mean ivf_nlist / 16 (default=0)\n"
+		"  radius: largest Hamming radius probed after fit(engine='mih'); the\n"
+		"          probe stops at the first radius giving max(rerank, k)\n"
+		"          candidates, negative values mean 1 (default=-1)\n"
+		"  ef_search: graph candidates per query after fit(engine='hnsw'),\n"
+		"             values <= 0 mean 64, never fewer than max(rerank, k)\n"
+		"             (default=0)\n"
 		"\n"
 		"Returns:\n"
 		"  numpy array of indices"
 	},
+	{
+		"export_shared",
+		(PyCFunction)QuantPivot64omp_export_shared,
+		METH_VARARGS | METH_KEYWORDS,
+		"Publish the fitted index as a read-only shared segment\n\n"
+		"Parameters:\n"
+		"  name: '/name' for a POSIX shared memory segment (must not exist\n"
+		"        yet), any other path for a shared mmap file (replaced\n"
+		"        atomically, attached processes keep the old index)\n"
+		"\n"
+		"Returns:\n"
+		"  self"
+	},
+	{
+		"attach",
+		(PyCFunction)QuantPivot64omp_attach,
+		METH_VARARGS | METH_KEYWORDS,
+		"Map an index published with export_shared() (no copy)\n\n"
+		"Parameters:\n"
+		"  name: segment name or file path used by export_shared()\n"
+		"  silent: silent (default=True)\n"
+		"\n"
+		"Returns:\n"
+		"  self, ready for predict()"
+	},
+	{
+		"unlink_shared",
+		(PyCFunction)QuantPivot64omp_unlink_shared,
+		METH_VARARGS | METH_KEYWORDS | METH_STATIC,
+		"Remove a shared index (attached processes keep their mapping)\n\n"
+		"Parameters:\n"
+		"  name: segment name or file path used by export_shared()"
+	},
 	{NULL, NULL, 0, NULL}
 };
 
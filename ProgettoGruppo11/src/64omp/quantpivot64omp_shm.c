@@ -0,0 +1,487 @@
+/*
+ *  Indice condiviso tra processi
+ *
+ *  export_index() serializza l'indice costruito da fit() in un'unica area
+ *  contigua, attach_index() la mappa in sola lettura e fa puntare i campi di
+ *  params direttamente dentro la mappatura (nessuna copia).
+ *
+ *  Il nome decide il supporto:
+ *  - "/nome" (un solo '/', in testa) → segmento POSIX shm_open (/dev/shm)
+ *  - qualsiasi altro percorso        → file regolare mappato con mmap
+ *
+ *  Layout:
+ *  - header (qp_index_header) con magic, versione e tabella delle sezioni
+ *  - sezioni dati, ognuna allineata a QP_INDEX_ALIGN byte
+ *
+ *  I vettori completi sono DS oppure, dopo compact(), il dataset a 16 bit.
+ *  Un file esistente viene sostituito con rename() di una copia temporanea
+ *  completa: chi l'ha già mappato continua a vedere il vecchio indice. Un
+ *  segmento shm esistente non viene mai sovrascritto (unlink_index() prima).
+ */
+
+#define QP_INDEX_MAGIC          "QPIDX64"
+#define QP_INDEX_VERSION        2       // 2: sezioni IVF (tabella e codici in ordine di lista)
+#define QP_INDEX_ALIGN          64
+#define QP_INDEX_MAX_SECTIONS   32
+
+// identificativi delle sezioni
+enum {
+    QP_SEC_DS = 1,              // dataset [N x D] type (oppure QP_SEC_DS_F16/BF16)
+    QP_SEC_P,                   // indici dei pivot [h] ID
+    QP_SEC_INDEX,               // tabella delle distanze [N x h] type
+    QP_SEC_CODES_PLUS,          // codici quantizzati v+ [N x D] uint8_t
+    QP_SEC_CODES_MINUS,         // codici quantizzati v- [N x D] uint8_t
+    QP_SEC_PIVOT_PLUS,          // codici dei pivot v+ [h x D] uint8_t (opzionale)
+    QP_SEC_PIVOT_MINUS,         // codici dei pivot v- [h x D] uint8_t (opzionale)
+    QP_SEC_IVF_CENTROIDS,       // centroidi delle liste [nlist x D] type (solo MODE_IVF)
+    QP_SEC_IVF_OFFSETS,         // inizio delle liste [nlist + 1] int64_t (solo MODE_IVF)
+    QP_SEC_IVF_IDS,             // ID per posizione dell'indice [N] ID (solo MODE_IVF)
+    QP_SEC_DS_F16,              // dataset a 16 bit [N x D] uint16_t (DS3_F16)
+    QP_SEC_DS_BF16,             // dataset a 16 bit [N x D] uint16_t (DS3_BF16)
+    QP_SEC_MIH_TABLE,           // inizio delle chiavi per tabella [mih_m + 1] int64_t (solo MODE_MIH)
+    QP_SEC_MIH_KEYS,            // chiavi distinte [chiavi] uint64_t (solo MODE_MIH)
+    QP_SEC_MIH_BUCKET,          // inizio dei bucket [chiavi + 1] int64_t (solo MODE_MIH)
+    QP_SEC_MIH_IDS,             // righe dei bucket [bucket[chiavi]] ID (solo MODE_MIH)
+    QP_SEC_IVF_NORMS,           // ||c||^2 dei centroidi [nlist] type (solo MODE_IVF)
+};
+
+typedef struct {
+    uint32_t tag;               // QP_SEC_*
+    uint32_t elem_size;         // dimensione di un elemento in byte
+    uint64_t offset;            // offset dall'inizio della mappatura
+    uint64_t count;             // numero di elementi
+} qp_section;
+
+typedef struct {
+    char magic[8];              // QP_INDEX_MAGIC
+    uint32_t version;           // QP_INDEX_VERSION
+    uint32_t nsections;         // sezioni valide in sec[]
+    int64_t N;                  // righe del dataset
+    int64_t D;                  // colonne del dataset
+    int32_t h;                  // numero di pivot
+    int32_t x;                  // parametro di quantizzazione
+    qp_section sec[QP_INDEX_MAX_SECTIONS];
+} qp_index_header;
+
+
+// Vero se il nome indica un segmento POSIX shm ("/nome")
+static int is_shm_name(const char* name) {
+    return name[0] == '/' && strchr(name + 1, '/') == NULL;
+}
+
+static size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+// Aggiunge una sezione all'header e restituisce il primo offset libero dopo di essa
+static size_t add_section(qp_index_header* hdr, uint32_t tag, uint32_t elem_size,
+                          uint64_t count, size_t offset) {
+    qp_section* s = &hdr->sec[hdr->nsections++];
+    s->tag = tag;
+    s->elem_size = elem_size;
+    s->offset = align_up(offset, QP_INDEX_ALIGN);
+    s->count = count;
+    return s->offset + (size_t)elem_size * count;
+}
+
+static const qp_section* find_section(const qp_index_header* hdr, uint32_t tag) {
+    for (uint32_t i = 0; i < hdr->nsections; i++)
+        if (hdr->sec[i].tag == tag) return &hdr->sec[i];
+    return NULL;
+}
+
+
+// EXPORT_INDEX - Scrive l'indice in un segmento condiviso o file (0 = ok, -1 = errore)
+int export_index(const params* input, const char* name) {
+    if (input->index == NULL) {
+        fprintf(stderr, "Errore export_index: indice non costruito\n");
+        return -1;
+    }
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore export_index: vettori completi non in memoria (dataset su disco "
+                        "o liberato con SQ_ONLY), l'indice condiviso deve contenerli\n");
+        return -1;
+    }
+
+    size_t N = input->N, D = input->D, h = input->h;
+
+    qp_index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, QP_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = QP_INDEX_VERSION;
+    hdr.N = input->N;
+    hdr.D = input->D;
+    hdr.h = input->h;
+    hdr.x = input->x;
+
+    size_t off = sizeof(hdr);
+    if (input->DS != NULL)
+        off = add_section(&hdr, QP_SEC_DS, sizeof(type), N * D, off);
+    else
+        off = add_section(&hdr, input->half_dtype == DS3_BF16 ? QP_SEC_DS_BF16 : QP_SEC_DS_F16,
+                          sizeof(uint16_t), N * D, off);
+    off = add_section(&hdr, QP_SEC_P, sizeof(ID), h, off);
+    off = add_section(&hdr, QP_SEC_INDEX, sizeof(type), N * h, off);
+    off = add_section(&hdr, QP_SEC_CODES_PLUS, sizeof(uint8_t), N * D, off);
+    off = add_section(&hdr, QP_SEC_CODES_MINUS, sizeof(uint8_t), N * D, off);
+    if (input->P_quantized_plus != NULL && input->P_quantized_minus != NULL) {
+        off = add_section(&hdr, QP_SEC_PIVOT_PLUS, sizeof(uint8_t), h * D, off);
+        off = add_section(&hdr, QP_SEC_PIVOT_MINUS, sizeof(uint8_t), h * D, off);
+    }
+    size_t nlist = input->ivf_nlist;
+    if (input->ivf_offsets != NULL) {
+        off = add_section(&hdr, QP_SEC_IVF_CENTROIDS, sizeof(type), nlist * D, off);
+        off = add_section(&hdr, QP_SEC_IVF_OFFSETS, sizeof(int64_t), nlist + 1, off);
+        off = add_section(&hdr, QP_SEC_IVF_IDS, sizeof(ID), N, off);
+        off = add_section(&hdr, QP_SEC_IVF_NORMS, sizeof(type), nlist, off);
+    }
+    size_t mih_m = input->mih_m, nkeys = 0, nids = 0;
+    if (input->mih_keys != NULL) {
+        nkeys = input->mih_table[mih_m];
+        nids = input->mih_bucket[nkeys];
+        off = add_section(&hdr, QP_SEC_MIH_TABLE, sizeof(int64_t), mih_m + 1, off);
+        off = add_section(&hdr, QP_SEC_MIH_KEYS, sizeof(uint64_t), nkeys, off);
+        off = add_section(&hdr, QP_SEC_MIH_BUCKET, sizeof(int64_t), nkeys + 1, off);
+        off = add_section(&hdr, QP_SEC_MIH_IDS, sizeof(ID), nids, off);
+    }
+    size_t total = align_up(off, QP_INDEX_ALIGN);
+
+    // shm: mai sopra un segmento esistente; file: copia temporanea, poi rename()
+    int shm = is_shm_name(name);
+    char tmp[4096];
+    if (!shm && snprintf(tmp, sizeof(tmp), "%s.tmp%ld", name, (long)getpid()) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "Errore export_index: nome '%s' troppo lungo\n", name);
+        return -1;
+    }
+    int fd = shm ? shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644)
+                 : open(tmp, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        if (shm && errno == EEXIST)
+            fprintf(stderr, "Errore export_index: il segmento '%s' esiste già (unlink_index() "
+                            "prima di riesportare)\n", name);
+        else
+            fprintf(stderr, "Errore export_index: impossibile creare '%s'\n", name);
+        return -1;
+    }
+    uint8_t* base = MAP_FAILED;
+    if (ftruncate(fd, total) != 0)
+        fprintf(stderr, "Errore export_index: ftruncate di %zu byte fallita\n", total);
+    else if ((base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        fprintf(stderr, "Errore export_index: mmap fallita\n");
+    close(fd);
+    if (base == MAP_FAILED) {
+        if (shm) shm_unlink(name);
+        else unlink(tmp);
+        return -1;
+    }
+
+    memcpy(base, &hdr, sizeof(hdr));
+    if (input->DS != NULL)
+        memcpy(base + find_section(&hdr, QP_SEC_DS)->offset, input->DS, N * D * sizeof(type));
+    else
+        memcpy(base + hdr.sec[0].offset, input->DS_half, N * D * sizeof(uint16_t));
+    memcpy(base + find_section(&hdr, QP_SEC_P)->offset, input->P, h * sizeof(ID));
+    memcpy(base + find_section(&hdr, QP_SEC_INDEX)->offset, input->index, N * h * sizeof(type));
+    memcpy(base + find_section(&hdr, QP_SEC_CODES_PLUS)->offset, input->DS_quantized_plus, N * D);
+    memcpy(base + find_section(&hdr, QP_SEC_CODES_MINUS)->offset, input->DS_quantized_minus, N * D);
+    if (find_section(&hdr, QP_SEC_PIVOT_PLUS) != NULL) {
+        memcpy(base + find_section(&hdr, QP_SEC_PIVOT_PLUS)->offset, input->P_quantized_plus, h * D);
+        memcpy(base + find_section(&hdr, QP_SEC_PIVOT_MINUS)->offset, input->P_quantized_minus, h * D);
+    }
+    if (input->ivf_offsets != NULL) {
+        memcpy(base + find_section(&hdr, QP_SEC_IVF_CENTROIDS)->offset, input->ivf_centroids,
+               nlist * D * sizeof(type));
+        memcpy(base + find_section(&hdr, QP_SEC_IVF_OFFSETS)->offset, input->ivf_offsets,
+               (nlist + 1) * sizeof(int64_t));
+        memcpy(base + find_section(&hdr, QP_SEC_IVF_IDS)->offset, input->ivf_ids, N * sizeof(ID));
+        memcpy(base + find_section(&hdr, QP_SEC_IVF_NORMS)->offset, input->ivf_norms,
+               nlist * sizeof(type));
+    }
+    if (input->mih_keys != NULL) {
+        memcpy(base + find_section(&hdr, QP_SEC_MIH_TABLE)->offset, input->mih_table,
+               (mih_m + 1) * sizeof(int64_t));
+        memcpy(base + find_section(&hdr, QP_SEC_MIH_KEYS)->offset, input->mih_keys,
+               nkeys * sizeof(uint64_t));
+        memcpy(base + find_section(&hdr, QP_SEC_MIH_BUCKET)->offset, input->mih_bucket,
+               (nkeys + 1) * sizeof(int64_t));
+        memcpy(base + find_section(&hdr, QP_SEC_MIH_IDS)->offset, input->mih_ids, nids * sizeof(ID));
+    }
+
+    // su file regolare i dati sono su disco prima che il nome punti alla nuova copia
+    if (!shm) msync(base, total, MS_SYNC);
+    munmap(base, total);
+    if (!shm && rename(tmp, name) != 0) {
+        fprintf(stderr, "Errore export_index: impossibile sostituire '%s'\n", name);
+        unlink(tmp);
+        return -1;
+    }
+
+    if (!input->silent)
+        printf("[EXPORT] Indice scritto in '%s' (%zu byte)\n", name, total);
+    return 0;
+}
+
+
+/*
+ *  CHECK_SECTION - Vero se la sezione ha elementi da elem_size byte, esattamente
+ *  rows x cols elementi e sta tutta dentro la mappatura di size byte.
+ */
+static int check_section(const qp_section* s, uint32_t elem_size, uint64_t rows, uint64_t cols,
+                         size_t size) {
+    if (s->elem_size != elem_size || (cols != 0 && rows > UINT64_MAX / cols) ||
+        s->count != rows * cols || s->offset % QP_INDEX_ALIGN != 0 || s->offset > size ||
+        s->count > (size - s->offset) / elem_size) {
+        fprintf(stderr, "Errore attach_index: sezione %u non valida (attesi %lu x %lu elementi "
+                        "da %u byte dentro %zu byte)\n", s->tag, rows, cols, elem_size, size);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ *  CHECK_INDEX - Verifica header e sezioni di un indice mappato di size byte
+ *  prima di usarne i puntatori: ogni sezione deve avere le dimensioni date da
+ *  N, D e h dell'header e stare dentro la mappatura.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+static int check_index(const qp_index_header* hdr, size_t size) {
+    if (memcmp(hdr->magic, QP_INDEX_MAGIC, sizeof(hdr->magic)) != 0) {
+        fprintf(stderr, "Errore attach_index: magic non valido\n");
+        return -1;
+    }
+    // un'altra versione può disporre le sezioni diversamente: mai interpretarla
+    if (hdr->version != QP_INDEX_VERSION) {
+        fprintf(stderr, "Errore attach_index: versione %u non supportata (attesa %d), "
+                        "riesportare l'indice\n", hdr->version, QP_INDEX_VERSION);
+        return -1;
+    }
+    if (hdr->nsections > QP_INDEX_MAX_SECTIONS || hdr->N <= 0 || hdr->D <= 0 || hdr->h < 0) {
+        fprintf(stderr, "Errore attach_index: header non valido (%u sezioni, N=%ld, D=%ld, h=%d)\n",
+                hdr->nsections, hdr->N, hdr->D, hdr->h);
+        return -1;
+    }
+    uint64_t N = hdr->N, D = hdr->D, h = hdr->h;
+
+    const qp_section* s_ds = find_section(hdr, QP_SEC_DS);
+    const qp_section* s_dh = find_section(hdr, QP_SEC_DS_F16);
+    if (s_dh == NULL) s_dh = find_section(hdr, QP_SEC_DS_BF16);
+    const qp_section* s_p = find_section(hdr, QP_SEC_P);
+    const qp_section* s_idx = find_section(hdr, QP_SEC_INDEX);
+    const qp_section* s_cp = find_section(hdr, QP_SEC_CODES_PLUS);
+    const qp_section* s_cm = find_section(hdr, QP_SEC_CODES_MINUS);
+    if ((!s_ds && !s_dh) || !s_p || !s_idx || !s_cp || !s_cm) {
+        fprintf(stderr, "Errore attach_index: sezioni mancanti\n");
+        return -1;
+    }
+    if (s_p->elem_size != sizeof(ID) || (s_ds && s_ds->elem_size != sizeof(type))) {
+        fprintf(stderr, "Errore attach_index: indice costruito con ID o type di dimensione diversa\n");
+        return -1;
+    }
+    if (!(s_ds ? check_section(s_ds, sizeof(type), N, D, size)
+               : check_section(s_dh, sizeof(uint16_t), N, D, size)) ||
+        !check_section(s_p, sizeof(ID), h, 1, size) ||
+        !check_section(s_idx, sizeof(type), N, h, size) ||
+        !check_section(s_cp, sizeof(uint8_t), N, D, size) ||
+        !check_section(s_cm, sizeof(uint8_t), N, D, size))
+        return -1;
+    const uint8_t* base = (const uint8_t*)hdr;
+    const ID* P = (const ID*)(base + s_p->offset);
+    for (uint64_t j = 0; j < h; j++)
+        if (P[j] < 0 || (uint64_t)P[j] >= N) {
+            fprintf(stderr, "Errore attach_index: pivot %lu fuori dal dataset\n", j);
+            return -1;
+        }
+
+    // codici dei pivot (opzionali): entrambi o nessuno
+    const qp_section* s_pp = find_section(hdr, QP_SEC_PIVOT_PLUS);
+    const qp_section* s_pm = find_section(hdr, QP_SEC_PIVOT_MINUS);
+    if ((s_pp || s_pm) &&
+        (!s_pp || !s_pm || !check_section(s_pp, sizeof(uint8_t), h, D, size) ||
+         !check_section(s_pm, sizeof(uint8_t), h, D, size))) {
+        fprintf(stderr, "Errore attach_index: codici dei pivot incompleti\n");
+        return -1;
+    }
+
+    const qp_section* s_ic = find_section(hdr, QP_SEC_IVF_CENTROIDS);
+    const qp_section* s_io = find_section(hdr, QP_SEC_IVF_OFFSETS);
+    const qp_section* s_ii = find_section(hdr, QP_SEC_IVF_IDS);
+    const qp_section* s_in = find_section(hdr, QP_SEC_IVF_NORMS);
+    if ((s_ic || s_io || s_ii || s_in) &&
+        (!s_ic || !s_io || !s_ii || !s_in || s_io->count < 2 || s_io->count - 1 > N ||
+         !check_section(s_ic, sizeof(type), s_io->count - 1, D, size) ||
+         !check_section(s_io, sizeof(int64_t), s_io->count, 1, size) ||
+         !check_section(s_ii, sizeof(ID), N, 1, size) ||
+         !check_section(s_in, sizeof(type), s_io->count - 1, 1, size))) {
+        fprintf(stderr, "Errore attach_index: sezioni IVF incomplete\n");
+        return -1;
+    }
+    // liste invertite: inizi crescenti da 0 a N, ogni posizione con un ID del dataset
+    if (s_io != NULL) {
+        const int64_t* offsets = (const int64_t*)(base + s_io->offset);
+        const ID* ids = (const ID*)(base + s_ii->offset);
+        uint64_t nlist = s_io->count - 1;
+        int ok = offsets[0] == 0 && (uint64_t)offsets[nlist] == N;
+        for (uint64_t l = 0; ok && l < nlist; l++) ok = offsets[l] <= offsets[l + 1];
+        for (uint64_t i = 0; ok && i < N; i++) ok = ids[i] >= 0 && (uint64_t)ids[i] < N;
+        if (!ok) {
+            fprintf(stderr, "Errore attach_index: liste IVF non valide\n");
+            return -1;
+        }
+    }
+
+    const qp_section* s_mt = find_section(hdr, QP_SEC_MIH_TABLE);
+    const qp_section* s_mk = find_section(hdr, QP_SEC_MIH_KEYS);
+    const qp_section* s_mb = find_section(hdr, QP_SEC_MIH_BUCKET);
+    const qp_section* s_mi = find_section(hdr, QP_SEC_MIH_IDS);
+    if ((s_mt || s_mk || s_mb || s_mi) &&
+        (!s_mt || !s_mk || !s_mb || !s_mi || s_mt->count < 2 ||
+         !check_section(s_mt, sizeof(int64_t), s_mt->count, 1, size) ||
+         !check_section(s_mk, sizeof(uint64_t), s_mk->count, 1, size) ||
+         !check_section(s_mb, sizeof(int64_t), s_mk->count + 1, 1, size) ||
+         !check_section(s_mi, sizeof(ID), s_mi->count, 1, size))) {
+        fprintf(stderr, "Errore attach_index: sezioni MIH incomplete\n");
+        return -1;
+    }
+    // tabelle MIH: sottostringhe valide per D, inizi crescenti e dentro le
+    // sezioni (mih_scan_block() li usa come indici), righe nel dataset
+    if (s_mt != NULL) {
+        const int64_t* table = (const int64_t*)(base + s_mt->offset);
+        const int64_t* bucket = (const int64_t*)(base + s_mb->offset);
+        const ID* ids = (const ID*)(base + s_mi->offset);
+        uint64_t m = s_mt->count - 1, nkeys = s_mk->count, nids = s_mi->count;
+        int ok = m <= D && (D + m - 1) / m <= MIH_SUB_MAX && table[0] == 0 &&
+                 (uint64_t)table[m] == nkeys && bucket[0] == 0 && (uint64_t)bucket[nkeys] == nids;
+        for (uint64_t j = 0; ok && j < m; j++) ok = table[j] <= table[j + 1];
+        for (uint64_t i = 0; ok && i < nkeys; i++) ok = bucket[i] <= bucket[i + 1];
+        for (uint64_t i = 0; ok && i < nids; i++) ok = ids[i] >= 0 && (uint64_t)ids[i] < N;
+        if (!ok) {
+            fprintf(stderr, "Errore attach_index: tabelle MIH non valide\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+// ATTACH_INDEX - Mappa in sola lettura un indice esportato (0 = ok, -1 = errore)
+int attach_index(params* input, const char* name) {
+    int fd = is_shm_name(name) ? shm_open(name, O_RDONLY, 0) : open(name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Errore attach_index: impossibile aprire '%s'\n", name);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(qp_index_header)) {
+        fprintf(stderr, "Errore attach_index: '%s' non contiene un indice\n", name);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    uint8_t* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Errore attach_index: mmap fallita\n");
+        return -1;
+    }
+
+    // header e sezioni verificati prima di far puntare params dentro la mappatura
+    const qp_index_header* hdr = (const qp_index_header*)base;
+    if (check_index(hdr, size) != 0) {
+        munmap(base, size);
+        return -1;
+    }
+
+    const qp_section* s_ds = find_section(hdr, QP_SEC_DS);
+    const qp_section* s_dh = find_section(hdr, QP_SEC_DS_F16);
+    uint32_t half_dtype = DS3_F16;
+    if (s_dh == NULL) {
+        s_dh = find_section(hdr, QP_SEC_DS_BF16);
+        half_dtype = DS3_BF16;
+    }
+    const qp_section* s_p = find_section(hdr, QP_SEC_P);
+    const qp_section* s_idx = find_section(hdr, QP_SEC_INDEX);
+    const qp_section* s_cp = find_section(hdr, QP_SEC_CODES_PLUS);
+    const qp_section* s_cm = find_section(hdr, QP_SEC_CODES_MINUS);
+    const qp_section* s_pp = find_section(hdr, QP_SEC_PIVOT_PLUS);
+    const qp_section* s_pm = find_section(hdr, QP_SEC_PIVOT_MINUS);
+    const qp_section* s_ic = find_section(hdr, QP_SEC_IVF_CENTROIDS);
+    const qp_section* s_io = find_section(hdr, QP_SEC_IVF_OFFSETS);
+    const qp_section* s_ii = find_section(hdr, QP_SEC_IVF_IDS);
+    const qp_section* s_in = find_section(hdr, QP_SEC_IVF_NORMS);
+    const qp_section* s_mt = find_section(hdr, QP_SEC_MIH_TABLE);
+    const qp_section* s_mk = find_section(hdr, QP_SEC_MIH_KEYS);
+    const qp_section* s_mb = find_section(hdr, QP_SEC_MIH_BUCKET);
+    const qp_section* s_mi = find_section(hdr, QP_SEC_MIH_IDS);
+
+    input->N = hdr->N;
+    input->D = hdr->D;
+    input->h = hdr->h;
+    input->x = hdr->x;
+
+    // i campi puntano dentro la mappatura (sola lettura, nessuna copia)
+    // dataset a piena precisione oppure a 16 bit (indice esportato dopo compact())
+    input->DS = s_ds ? (type*)(base + s_ds->offset) : NULL;
+    input->DS_half = s_ds ? NULL : base + s_dh->offset;
+    input->half_dtype = s_ds ? 0 : half_dtype;
+    input->half_owned = 0;
+    input->P = (ID*)(base + s_p->offset);
+    input->index = (type*)(base + s_idx->offset);
+    input->DS_quantized_plus = base + s_cp->offset;
+    input->DS_quantized_minus = base + s_cm->offset;
+    // indici esportati senza codici dei pivot: predict() li ricalcola
+    input->P_quantized_plus = s_pp ? base + s_pp->offset : NULL;
+    input->P_quantized_minus = s_pm ? base + s_pm->offset : NULL;
+    // liste invertite: tabella e codici sono nell'ordine delle liste
+    input->ivf_nlist = s_io ? (int)(s_io->count - 1) : 0;
+    input->ivf_centroids = s_ic ? (type*)(base + s_ic->offset) : NULL;
+    input->ivf_norms = s_in ? (type*)(base + s_in->offset) : NULL;
+    input->ivf_offsets = s_io ? (int64_t*)(base + s_io->offset) : NULL;
+    input->ivf_ids = s_ii ? (ID*)(base + s_ii->offset) : NULL;
+    // tabelle hash sulle sottostringhe dei codici
+    input->mih_m = s_mt ? (int)(s_mt->count - 1) : 0;
+    input->mih_table = s_mt ? (int64_t*)(base + s_mt->offset) : NULL;
+    input->mih_keys = s_mk ? (uint64_t*)(base + s_mk->offset) : NULL;
+    input->mih_bucket = s_mb ? (int64_t*)(base + s_mb->offset) : NULL;
+    input->mih_ids = s_mi ? (ID*)(base + s_mi->offset) : NULL;
+
+    input->shm_base = base;
+    input->shm_size = size;
+
+    if (!input->silent)
+        printf("[ATTACH] Indice '%s' mappato: N=%ld, D=%ld, h=%d, x=%d\n",
+               name, input->N, input->D, input->h, input->x);
+    return 0;
+}
+
+
+// DETACH_INDEX - Rilascia la mappatura creata da attach_index()
+void detach_index(params* input) {
+    if (input->shm_base == NULL) return;
+    munmap(input->shm_base, input->shm_size);
+    input->shm_base = NULL;
+    input->shm_size = 0;
+    input->DS = NULL;
+    input->DS_half = NULL;
+    input->ivf_centroids = NULL;
+    input->ivf_norms = NULL;
+    input->ivf_offsets = NULL;
+    input->ivf_ids = NULL;
+    input->mih_table = NULL;
+    input->mih_keys = NULL;
+    input->mih_bucket = NULL;
+    input->mih_ids = NULL;
+}
+
+
+// UNLINK_INDEX - Rimuove il segmento o file (i processi già collegati restano validi)
+int unlink_index(const char* name) {
+    int ret = is_shm_name(name) ? shm_unlink(name) : unlink(name);
+    if (ret != 0) {
+        fprintf(stderr, "Errore unlink_index: impossibile rimuovere '%s'\n", name);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+/*
+ *  Livello intermedio: quantizzazione scalare a 8 bit (SQ)
+ *
+ *  Tra i codici a 1 bit di quantize() e i vettori completi: ogni dimensione
+ *  d ha un intervallo affine [min_d, min_d + 255 * scale_d] addestrato in
+ *  fit() e ogni riga è memorizzata come D codici uint8 (8 volte meno dei
+ *  double). La ricostruzione è x_d ≈ min_d + scale_d * c_d, quindi
+ *
+ *      ||q - x||^2 ≈ ||q||^2 + ||x~||^2 - 2 q·min - 2 Σ (q_d scale_d) c_d
+ *
+ *  con ||x~||^2 (norma della riga ricostruita) calcolata una volta. Per la
+ *  query u_d = q_d scale_d viene quantizzato a int8 con una scala per query
+ *  (alpha): la somma Σ u_d c_d è un prodotto uint8 x int8 accumulato in
+ *  int32, vpdpbusd con AVX-512 VNNI / AVX-VNNI, vpmaddubsw + vpmaddwd con
+ *  AVX2. vpmaddubsw satura a 16 bit la somma di due prodotti: senza VNNI la
+ *  query usa quindi ±63 invece di ±127 (2 * 255 * 63 < 32767).
+ *
+ *  Gli intervalli sono i min/max di ogni dimensione oppure, con sq_clip > 0,
+ *  i quantili sq_clip e 1 - sq_clip su un campione di SQ_SAMPLE righe: i
+ *  valori estremi vengono saturati e gli altri guadagnano risoluzione.
+ *
+ *  In predict() i candidati della scansione (cascata e proiezione) passano per
+ *  sq_rerank() in filter_candidates():
+ *  - SQ_RERANK: restano sq_pool() candidati, poi raffinamento esatto
+ *  - SQ_ONLY: i k migliori per distanza SQ sono il risultato, i vettori
+ *    completi non servono più
+ */
+
+#define SQ_SAMPLE   16384       // righe campionate per i quantili (sq_clip > 0)
+
+#if defined(__AVX512VNNI__) || defined(__AVXVNNI__)
+#define SQ_QMAX     127         // range della query quantizzata
+#else
+#define SQ_QMAX     63          // vpmaddubsw: niente saturazione a 16 bit
+#endif
+
+
+// SQ_POOL - Candidati che passano il filtro SQ: k con SQ_ONLY, altrimenti
+// max(k, sq_keep) (sq_keep <= 0: 2k), al più quelli in uscita da cascata e proiezione
+static inline int sq_pool(const params* input) {
+    int k = input->k;
+    if (input->sq_mode == SQ_ONLY) return k;
+    int keep = input->sq_keep > 0 ? input->sq_keep : 2 * k;
+    if (keep < k) keep = k;
+    return keep < prefilter_pool(input) ? keep : prefilter_pool(input);
+}
+
+
+#if defined(__AVX2__)
+// Somma delle 8 corsie int32
+static inline int32_t hsum_epi32(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+
+// Prodotti uint8 x int8 di 4 righe di codici con la query: out[b] = Σ r[b][d] * u[d]
+static inline void sq_dot4(const int8_t* u, const uint8_t* const r[4], int64_t D, int32_t out[4]) {
+    int64_t d = 0;
+    for (int b = 0; b < 4; b++) out[b] = 0;
+#if defined(__AVX512VNNI__)
+    __m512i acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm512_setzero_si512();
+    for (; d + 64 <= D; d += 64) {
+        __m512i uv = _mm512_loadu_si512(&u[d]);
+        for (int b = 0; b < 4; b++)
+            acc[b] = _mm512_dpbusd_epi32(acc[b], _mm512_loadu_si512(&r[b][d]), uv);
+    }
+    for (int b = 0; b < 4; b++) out[b] = _mm512_reduce_add_epi32(acc[b]);
+#elif defined(__AVXVNNI__)
+    __m256i acc[4];
+    for (int b = 0; b < 4; b++) acc[b] = _mm256_setzero_si256();
+    for (; d + 32 <= D; d += 32) {
+        __m256i uv = _mm256_loadu_si256((const __m256i*)&u[d]);
+        for (int b = 0; b < 4; b++)
+            acc[b] = _mm256_dpbusd_avx_epi32(acc[b], _mm256_loadu_si256((const __m256i*)&r[b][d]), uv);
+    }
+    for (int b = 0; b < 4; b++) out[b] = hsum_epi32(acc[b]);
+#elif defined(__AVX2__)
+    __m256i acc[4];
+    __m256i ones = _mm256_set1_epi16(1);
+    for (int b = 0; b < 4; b++) acc[b] = _mm256_setzero_si256();
+    for (; d + 32 <= D; d += 32) {
+        __m256i uv = _mm256_loadu_si256((const __m256i*)&u[d]);
+        for (int b = 0; b < 4; b++) {
+            __m256i p = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)&r[b][d]), uv);
+            acc[b] = _mm256_add_epi32(acc[b], _mm256_madd_epi16(p, ones));
+        }
+    }
+    for (int b = 0; b < 4; b++) out[b] = hsum_epi32(acc[b]);
+#endif
+    for (; d < D; d++)
+        for (int b = 0; b < 4; b++) out[b] += r[b][d] * u[d];
+}
+
+
+static int cmp_type(const void* a, const void* b) {
+    type x = *(const type*)a, y = *(const type*)b;
+    return (x > y) - (x < y);
+}
+
+
+/*
+ *  SQ_TRAIN - Intervalli per dimensione e codici int8 di tutte le righe
+ *  (input->DS_sq, sq_min, sq_scale, sq_norms) dai vettori in memoria
+ *  (DS o DS_half). Restituisce 0 se ok, -1 in caso di errore.
+ */
+int sq_train(params* input) {
+    int64_t N = input->N, D = input->D;
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore sq_train: dataset in memoria non disponibile\n");
+        return -1;
+    }
+    if (input->sq_clip < 0.0 || input->sq_clip >= 0.5) {
+        fprintf(stderr, "Errore sq_train: sq_clip=%g fuori da [0, 0.5)\n", input->sq_clip);
+        return -1;
+    }
+
+    type* lo = _mm_malloc(D * sizeof(type), align);
+    type* hi = _mm_malloc(D * sizeof(type), align);
+    uint8_t* codes = _mm_malloc(N * D * sizeof(uint8_t), align);
+    type* norms = _mm_malloc(N * sizeof(type), align);
+    if (!lo || !hi || !codes || !norms) {
+        fprintf(stderr, "Errore allocazione in sq_train\n");
+        exit(1);
+    }
+
+    if (input->sq_clip == 0.0) {
+        // min/max esatti: ogni thread sulle sue righe, poi fusione
+        for (int64_t d = 0; d < D; d++) {
+            lo[d] = INFINITY;
+            hi[d] = -INFINITY;
+        }
+        #pragma omp parallel
+        {
+            type* tlo = malloc(D * sizeof(type));
+            type* thi = malloc(D * sizeof(type));
+            type* buf = malloc(D * sizeof(type));
+            for (int64_t d = 0; d < D; d++) {
+                tlo[d] = INFINITY;
+                thi[d] = -INFINITY;
+            }
+            #pragma omp for schedule(static)
+            for (int64_t i = 0; i < N; i++) {
+                const type* x = dataset_row(input, i, buf);
+                for (int64_t d = 0; d < D; d++) {
+                    if (x[d] < tlo[d]) tlo[d] = x[d];
+                    if (x[d] > thi[d]) thi[d] = x[d];
+                }
+            }
+            #pragma omp critical
+            for (int64_t d = 0; d < D; d++) {
+                if (tlo[d] < lo[d]) lo[d] = tlo[d];
+                if (thi[d] > hi[d]) hi[d] = thi[d];
+            }
+            free(tlo);
+            free(thi);
+            free(buf);
+        }
+    } else {
+        // quantili su SQ_SAMPLE righe a passo uniforme
+        int64_t s = N < SQ_SAMPLE ? N : SQ_SAMPLE;
+        type* sample = malloc(s * D * sizeof(type));
+        if (!sample) {
+            fprintf(stderr, "Errore allocazione in sq_train\n");
+            exit(1);
+        }
+        #pragma omp parallel
+        {
+            type* buf = malloc(D * sizeof(type));
+            #pragma omp for schedule(static)
+            for (int64_t r = 0; r < s; r++)
+                memcpy(&sample[r * D], dataset_row(input, r * N / s, buf), D * sizeof(type));
+            free(buf);
+        }
+        #pragma omp parallel
+        {
+            type* col = malloc(s * sizeof(type));
+            #pragma omp for schedule(static)
+            for (int64_t d = 0; d < D; d++) {
+                for (int64_t r = 0; r < s; r++) col[r] = sample[r * D + d];
+                qsort(col, s, sizeof(type), cmp_type);
+                lo[d] = col[(int64_t)floor(input->sq_clip * (s - 1))];
+                hi[d] = col[(int64_t)ceil((1.0 - input->sq_clip) * (s - 1))];
+            }
+            free(col);
+        }
+        free(sample);
+    }
+
+    // scala per dimensione: 255 passi sull'intervallo (dimensioni costanti: codice 0)
+    type* scale = hi;           // riusa hi
+    for (int64_t d = 0; d < D; d++)
+        scale[d] = hi[d] > lo[d] ? (hi[d] - lo[d]) / 255.0 : 1.0;
+
+    #pragma omp parallel
+    {
+        type* buf = malloc(D * sizeof(type));
+        #pragma omp for schedule(static)
+        for (int64_t i = 0; i < N; i++) {
+            const type* x = dataset_row(input, i, buf);
+            type s = 0.0;
+            for (int64_t d = 0; d < D; d++) {
+                long c = lrint((x[d] - lo[d]) / scale[d]);
+                if (c < 0) c = 0;
+                if (c > 255) c = 255;
+                codes[i * D + d] = (uint8_t)c;
+                type v = lo[d] + scale[d] * c;
+                s += v * v;
+            }
+            norms[i] = s;
+        }
+        free(buf);
+    }
+
+    _mm_free(input->DS_sq);
+    _mm_free(input->sq_min);
+    _mm_free(input->sq_scale);
+    _mm_free(input->sq_norms);
+    input->DS_sq = codes;
+    input->sq_min = lo;
+    input->sq_scale = scale;
+    input->sq_norms = norms;
+
+    if (!input->silent)
+        printf("[SQ] Codici int8 (%s): %.1f MiB invece di %.1f MiB\n",
+               input->sq_clip > 0.0 ? "quantili" : "min/max",
+               N * D / 1048576.0, N * D * sizeof(type) / 1048576.0);
+    return 0;
+}
+
+
+/*
+ *  SQ_RERANK - I keep migliori tra gli n candidati ids (ids[i] < 0: nessun
+ *  candidato) per distanza SQ, ordinati in out_ids/out_dists (distanze
+ *  euclidee approssimate). u: buffer [D] per la query quantizzata.
+ *  out_ids non deve sovrapporsi a ids.
+ */
+static void sq_rerank(const params* input, const type* q, int8_t* u, const ID* ids, int n,
+                      int keep, ID* out_ids, type* out_dists) {
+    int64_t D = input->D;
+    const uint8_t* codes = input->DS_sq;
+
+    // query: u_d = q_d * scale_d in int8 con scala alpha, termini costanti in base
+    type amax = 0.0, base = 0.0;
+    for (int64_t d = 0; d < D; d++) {
+        type v = fabs(q[d] * input->sq_scale[d]);
+        if (v > amax) amax = v;
+        base += q[d] * q[d] - 2.0 * q[d] * input->sq_min[d];
+    }
+    type alpha = amax > 0.0 ? amax / SQ_QMAX : 1.0;
+    for (int64_t d = 0; d < D; d++)
+        u[d] = (int8_t)lrint(q[d] * input->sq_scale[d] / alpha);
+
+    topk_t top;
+    topk_init(&top, out_ids, out_dists, keep);
+    for (int i = 0; i < n && i < REFINE_AHEAD; i++)
+        if (ids[i] >= 0) prefetch_row(&codes[ids[i] * D], D);
+
+    for (int i = 0; i < n; i += 4) {
+        const uint8_t* r[4];
+        for (int b = 0; b < 4; b++)
+            r[b] = i + b < n && ids[i + b] >= 0 ? &codes[ids[i + b] * D] : codes;
+        for (int b = i + REFINE_AHEAD; b < i + REFINE_AHEAD + 4 && b < n; b++)
+            if (ids[b] >= 0) prefetch_row(&codes[ids[b] * D], D);
+
+        int32_t dot[4];
+        sq_dot4(u, r, D, dot);
+        for (int b = 0; b < 4 && i + b < n; b++) {
+            if (ids[i + b] < 0) continue;
+            type s = base + input->sq_norms[ids[i + b]] - 2.0 * alpha * dot[b];
+            if (s <= topk_bound(&top)) topk_push(&top, s, ids[i + b]);
+        }
+    }
+
+    topk_finish(&top);
+    // la forma espansa può dare valori appena negativi
+    for (int i = 0; i < keep; i++) out_dists[i] = out_dists[i] > 0.0 ? sqrt(out_dists[i]) : 0.0;
+}
+
+
+// Buffer di un thread per filter_candidates()
+typedef struct {
+    uint8_t* q_vp;              // codici della query a un livello [D]
+    uint8_t* q_vm;
+    int8_t* q_sq;               // query int8 [D]
+    type* q_proj;               // query ridotta e trasformata [d' + proj_len()]
+    ID* ids;                    // liste intermedie [pool_size()]
+    type* dists;
+} filter_buf;
+
+static void filter_buf_init(const params* input, filter_buf* fb) {
+    int m = pool_size(input);
+    fb->q_vp = malloc(input->D);
+    fb->q_vm = malloc(input->D);
+    fb->q_sq = malloc(input->D);
+    fb->q_proj = input->proj_mode != PROJ_OFF
+        ? malloc((proj_dim(input) + proj_len(input)) * sizeof(type)) : NULL;
+    fb->ids = malloc(m * sizeof(ID));
+    fb->dists = malloc(m * sizeof(type));
+}
+
+static void filter_buf_free(filter_buf* fb) {
+    free(fb->q_vp);
+    free(fb->q_vm);
+    free(fb->q_sq);
+    free(fb->q_proj);
+    free(fb->ids);
+    free(fb->dists);
+}
+
+
+/*
+ *  FILTER_CANDIDATES - Riduce gli m candidati della scansione in cand
+ *  (in place): cascata dei livelli fini, distanza ridotta, poi filtro
+ *  int8. I sopravvissuti restano in testa a cand, in ordine di distanza
+ *  dell'ultimo stadio, e le posizioni successive valgono -1. Restituisce
+ *  il numero di posizioni da raffinare; con SQ_ONLY i k risultati vanno
+ *  direttamente in out_ids/out_dists e restituisce 0.
+ */
+static int filter_candidates(const params* input, const type* q, filter_buf* fb,
+                             ID* cand, int m, ID* out_ids, type* out_dists) {
+    int n = m;
+    for (int l = 0; l < input->levels; l++) {
+        int keep = level_keep(input, l);
+        level_rerank(input, l, q, fb->q_vp, fb->q_vm, cand, n, keep, fb->ids, fb->dists);
+        memcpy(cand, fb->ids, keep * sizeof(ID));
+        n = keep;
+    }
+
+    if (input->proj_mode != PROJ_OFF) {
+        int keep = proj_pool(input);
+        proj_rerank(input, q, fb->q_proj, cand, n, keep, fb->ids, fb->dists);
+        memcpy(cand, fb->ids, keep * sizeof(ID));
+        n = keep;
+    }
+
+    if (input->sq_mode == SQ_ONLY) {
+        sq_rerank(input, q, fb->q_sq, cand, n, input->k, out_ids, out_dists);
+        n = 0;
+    } else if (input->sq_mode == SQ_RERANK) {
+        int keep = sq_pool(input);
+        sq_rerank(input, q, fb->q_sq, cand, n, keep, fb->ids, fb->dists);
+        memcpy(cand, fb->ids, keep * sizeof(ID));
+        n = keep;
+    }
+
+    for (int i = n; i < m; i++) cand[i] = -1;
+    return n;
+}
+
+
+// REFINE_POOL - Posizioni da raffinare per query dopo filter_candidates()
+static inline int refine_pool(const params* input) {
+    if (input->sq_mode == SQ_ONLY) return 0;
+    return input->sq_mode == SQ_RERANK ? sq_pool(input) : prefilter_pool(input);
+}
@@ -0,0 +1,331 @@
+/*
+ *  Fit out-of-core
+ *
+ *  fit_stream() costruisce l'indice leggendo il dataset a blocchi da una
+ *  sorgente (file o iteratore Python) senza mai tenerlo tutto in memoria:
+ *  ogni blocco viene quantizzato direttamente nella sua fetta degli array
+ *  di codici e, se i pivot sono già noti, anche della tabella [N x h].
+ *  In memoria restano solo il blocco corrente, gli h pivot e le strutture
+ *  finali dell'indice.
+ *
+ *  Scelta dei pivot:
+ *  - STREAM_PIVOTS_FIRST_PASS: una prima passata legge le righe a passo
+ *    uniforme N/h (gli stessi pivot di fit()), poi la sorgente viene
+ *    riavvolta e la seconda passata riempie codici e tabella.
+ *    Richiede una sorgente riavvolgibile.
+ *  - STREAM_PIVOTS_RESERVOIR: una sola passata, h pivot estratti con
+ *    reservoir sampling (algoritmo L); la tabella viene costruita alla fine
+ *    dai codici già in memoria. Funziona con qualsiasi iteratore.
+ */
+
+#define STREAM_PIVOTS_FIRST_PASS    0
+#define STREAM_PIVOTS_RESERVOIR     1
+
+typedef struct {
+    // blocco successivo: restituisce il numero di righe (0 = fine, -1 = errore)
+    // e in *rows il puntatore alle righe, valido fino alla chiamata seguente
+    int64_t (*next)(void* ctx, const type** rows);
+    // riporta la sorgente all'inizio (0 = ok), NULL se non riavvolgibile
+    int (*rewind)(void* ctx);
+    void* ctx;
+} chunk_source;
+
+
+// Quantizza un blocco di righe nella sua fetta dei codici (e della tabella se P_vp != NULL)
+static void stream_quantize_chunk(params* input, const type* rows, int64_t first, int64_t n,
+                                  const uint8_t* P_vp, const uint8_t* P_vm) {
+    int64_t D = input->D;
+    #pragma omp parallel for schedule(static)
+    for (int64_t r = 0; r < n; r++) {
+        int64_t i = first + r;
+        uint8_t* vp = &input->DS_quantized_plus[i * D];
+        uint8_t* vm = &input->DS_quantized_minus[i * D];
+        quantize(&rows[r * D], D, input->x, vp, vm);
+        if (P_vp != NULL) {
+            for (int j = 0; j < input->h; j++)
+                input->index[i * input->h + j] =
+                    approx_distance(vp, vm, &P_vp[j * D], &P_vm[j * D], D);
+        }
+    }
+}
+
+
+/*
+ *  FIT_STREAM - Costruzione dell'indice da una sorgente a blocchi
+ *
+ *  input->N e input->D devono essere già impostati (righe attese).
+ *  input->DS non viene usato: per la fase di raffinamento di predict()
+ *  il chiamante lo imposta dopo il fit (es. file mappato).
+ *  Restituisce 0 se ok, -1 se la sorgente fallisce o ha un numero di righe diverso da N.
+ */
+int fit_stream(params* input, chunk_source* src, int pivot_mode, uint64_t seed) {
+    int64_t N = input->N, D = input->D;
+    int h = input->h;
+
+    if (!input->silent) {
+        printf("[FIT] Inizio costruzione indice a blocchi...\n");
+        printf("      N=%ld, D=%ld, h=%d, x=%d, pivot=%s\n", N, D, h, input->x,
+               pivot_mode == STREAM_PIVOTS_RESERVOIR ? "reservoir" : "prima passata");
+    }
+
+    if (N < h) {
+        fprintf(stderr, "Errore: N < h\n");
+        exit(1);
+    }
+    if (N > ID_MAX) {
+        fprintf(stderr, "Errore: N=%ld non rappresentabile negli ID, ricompilare con -DID64\n", N);
+        exit(1);
+    }
+    if (pivot_mode == STREAM_PIVOTS_FIRST_PASS && src->rewind == NULL) {
+        fprintf(stderr, "Errore fit_stream: la prima passata richiede una sorgente riavvolgibile\n");
+        return -1;
+    }
+    if (input->mode == MODE_IVF) {
+        // le liste riordinano le righe: servono tutte prima di costruire l'indice
+        fprintf(stderr, "Errore fit_stream: le liste invertite richiedono fit() sul dataset in memoria\n");
+        return -1;
+    }
+
+    input->P = _mm_malloc(h * sizeof(ID), align);
+    input->index = _mm_malloc(N * h * sizeof(type), align);
+    input->DS_quantized_plus = _mm_malloc(N * D * sizeof(uint8_t), align);
+    input->DS_quantized_minus = _mm_malloc(N * D * sizeof(uint8_t), align);
+    type* pivots = _mm_malloc(h * D * sizeof(type), align);
+    uint8_t* P_vp = input->P_quantized_plus = _mm_malloc(h * D * sizeof(uint8_t), align);
+    uint8_t* P_vm = input->P_quantized_minus = _mm_malloc(h * D * sizeof(uint8_t), align);
+
+    if (!input->P || !input->index || !input->DS_quantized_plus ||
+        !input->DS_quantized_minus || !pivots || !P_vp || !P_vm) {
+        fprintf(stderr, "Errore allocazione in fit_stream\n");
+        exit(1);
+    }
+
+    int ret = 0;
+    int64_t seen = 0;
+    int64_t n;
+    const type* rows;
+
+    if (pivot_mode == STREAM_PIVOTS_FIRST_PASS) {
+        // Passata 1: copia le righe a passo uniforme (come fit())
+        int64_t step = N / h;
+        for (int j = 0; j < h; j++)
+            input->P[j] = step * j < N ? step * j : N - 1;
+
+        int next_pivot = 0;
+        while (next_pivot < h && (n = src->next(src->ctx, &rows)) > 0) {
+            while (next_pivot < h && input->P[next_pivot] < seen + n) {
+                memcpy(&pivots[next_pivot * D], &rows[(input->P[next_pivot] - seen) * D],
+                       D * sizeof(type));
+                next_pivot++;
+            }
+            seen += n;
+        }
+        if (next_pivot < h || src->rewind(src->ctx) != 0) {
+            ret = -1;
+            goto done;
+        }
+
+        for (int j = 0; j < h; j++)
+            quantize(&pivots[j * D], D, input->x, &P_vp[j * D], &P_vm[j * D]);
+
+        // Passata 2: codici e tabella riempiti blocco per blocco
+        seen = 0;
+        while ((n = src->next(src->ctx, &rows)) > 0) {
+            if (seen + n > N) { ret = -1; goto done; }
+            stream_quantize_chunk(input, rows, seen, n, P_vp, P_vm);
+            seen += n;
+            if (!input->silent)
+                printf("      %ld/%ld righe\n", seen, N);
+        }
+    } else {
+        // Passata unica: codici per blocco + reservoir sampling dei pivot (algoritmo L)
+        uint64_t state = seed;
+        double W = exp(log(rand_unit(&state)) / h);
+        int64_t next_pick = h + (int64_t)floor(log(rand_unit(&state)) / log(1.0 - W));
+
+        while ((n = src->next(src->ctx, &rows)) > 0) {
+            if (seen + n > N) { ret = -1; goto done; }
+            stream_quantize_chunk(input, rows, seen, n, NULL, NULL);
+
+            // i primi h punti riempiono il reservoir
+            for (int64_t r = 0; r < n && seen + r < h; r++) {
+                memcpy(&pivots[(seen + r) * D], &rows[r * D], D * sizeof(type));
+                input->P[seen + r] = seen + r;
+            }
+            // poi si salta direttamente al prossimo punto estratto
+            while (next_pick < seen + n) {
+                int slot = splitmix64(&state) % h;
+                memcpy(&pivots[slot * D], &rows[(next_pick - seen) * D], D * sizeof(type));
+                input->P[slot] = next_pick;
+                W *= exp(log(rand_unit(&state)) / h);
+                next_pick += 1 + (int64_t)floor(log(rand_unit(&state)) / log(1.0 - W));
+            }
+
+            seen += n;
+            if (!input->silent)
+                printf("      %ld/%ld righe\n", seen, N);
+        }
+
+        if (n == 0 && seen == N) {
+            for (int j = 0; j < h; j++)
+                quantize(&pivots[j * D], D, input->x, &P_vp[j * D], &P_vm[j * D]);
+
+            // Tabella [N x h] dai codici già in memoria
+            if (!input->silent) printf("[FIT] Costruzione indice [%ld x %d]...\n", N, h);
+            #pragma omp parallel for collapse(2) schedule(static)
+            for (int64_t i = 0; i < N; i++) {
+                for (int j = 0; j < h; j++) {
+                    input->index[i * h + j] =
+                        approx_distance(&input->DS_quantized_plus[i * D],
+                                        &input->DS_quantized_minus[i * D],
+                                        &P_vp[j * D], &P_vm[j * D], D);
+                }
+            }
+        }
+    }
+
+    if (n < 0 || seen != N) ret = -1;
+
+done:
+    if (ret != 0)
+        fprintf(stderr, "Errore fit_stream: sorgente fallita o con %ld righe invece di %ld\n",
+                seen, N);
+
+    _mm_free(pivots);
+
+    // tabelle hash dai codici appena costruiti
+    if (ret == 0 && input->mode == MODE_MIH)
+        ret = mih_build(input);
+
+    if (ret == 0 && !input->silent)
+        printf("[FIT] Completato! Picco RSS: %.1f MiB\n", peak_rss() / 1048576.0);
+    return ret;
+}
+
+
+// Sorgente a blocchi su file .ds2 / .ds3
+typedef struct {
+    int fd;
+    uint32_t dtype;             // DS3_* degli elementi nel file
+    off_t data_offset;          // inizio del payload
+    int64_t rows, cols;
+    int64_t next_row;
+    int64_t chunk_rows;
+    void* raw;                  // blocco letto dal file
+    type* buf;                  // blocco convertito in type (== raw se dtype è F64)
+} file_source;
+
+static int64_t file_source_next(void* ctx, const type** rows) {
+    file_source* fs = ctx;
+    int64_t n = fs->rows - fs->next_row;
+    if (n > fs->chunk_rows) n = fs->chunk_rows;
+    if (n <= 0) return 0;
+
+    size_t esize = ds3_elem_size(fs->dtype);
+    off_t off = fs->data_offset + (off_t)fs->next_row * fs->cols * esize;
+    if (parallel_pread(fs->fd, fs->raw, n * fs->cols * esize, off, "blocco", 1) != 0)
+        return -1;
+    if (fs->buf != fs->raw)
+        ds3_convert(fs->raw, fs->dtype, fs->buf, n * fs->cols);
+
+    fs->next_row += n;
+    *rows = fs->buf;
+    return n;
+}
+
+static int file_source_rewind(void* ctx) {
+    ((file_source*)ctx)->next_row = 0;
+    return 0;
+}
+
+
+/*
+ *  FIT_FILE - Fit out-of-core da un file .ds2 (double) o .ds3 (qualsiasi dtype)
+ *
+ *  Se il file contiene double, al termine input->DS punta al payload mappato
+ *  in sola lettura (le pagine vengono caricate solo per le righe usate dal
+ *  raffinamento e restano sfrattabili dalla page cache); se contiene f16 o
+ *  bf16 è input->DS_half a puntare al payload (quantpivot64omp_half.c);
+ *  altrimenti input->DS resta NULL e va fornito dal chiamante prima di
+ *  predict().
+ *  Con mode = MODE_PQ, MODE_HNSW o MODE_VPT non c'è passata a blocchi:
+ *  fit_pq(), fit_hnsw() e fit_vpt() lavorano sul file mappato, che deve
+ *  quindi essere double, f16 o bf16. Con MODE_EXACT il file (double) viene
+ *  solo mappato.
+ *  Restituisce 0 se ok, -1 in caso di errore.
+ */
+int fit_file(params* input, const char* filename, int64_t chunk_rows, int pivot_mode, uint64_t seed) {
+    file_source fs;
+    memset(&fs, 0, sizeof(fs));
+
+    fs.fd = open_data_file(filename, &fs.dtype, &fs.data_offset, &fs.rows, &fs.cols);
+    if (fs.fd < 0)
+        return -1;
+
+    fs.chunk_rows = chunk_rows > 0 ? chunk_rows : 65536;
+    fs.raw = _mm_malloc(fs.chunk_rows * fs.cols * ds3_elem_size(fs.dtype), align);
+    fs.buf = fs.dtype == DS3_F64 ? fs.raw : _mm_malloc(fs.chunk_rows * fs.cols * sizeof(type), align);
+    if (!fs.raw || !fs.buf) {
+        fprintf(stderr, "Errore allocazione in fit_file\n");
+        exit(1);
+    }
+
+    input->N = fs.rows;
+    input->D = fs.cols;
+    input->DS = NULL;
+
+    chunk_source src = { file_source_next, file_source_rewind, &fs };
+    int mapped_only = input->mode == MODE_PQ || input->mode == MODE_HNSW || input->mode == MODE_VPT ||
+                      input->mode == MODE_EXACT;
+    int ret = mapped_only ? 0 : fit_stream(input, &src, pivot_mode, seed);
+
+    if (ret == 0 && (fs.dtype == DS3_F64 || fs.dtype == DS3_F16 || fs.dtype == DS3_BF16)) {
+        // dataset per il raffinamento: file mappato, niente copia residente
+        size_t size = fs.data_offset + (size_t)fs.rows * fs.cols * ds3_elem_size(fs.dtype);
+        uint8_t* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fs.fd, 0);
+        if (base != MAP_FAILED) {
+            input->ds_base = base;
+            input->ds_size = size;
+            if (fs.dtype == DS3_F64) {
+                input->DS = (MATRIX)(base + fs.data_offset);
+            } else {
+                // a 16 bit: usato direttamente dal kernel di raffinamento
+                input->DS_half = base + fs.data_offset;
+                input->half_dtype = fs.dtype;
+                input->half_owned = 0;
+            }
+        }
+    }
+
+    if (ret == 0 && input->mode == MODE_EXACT) {
+        if (input->DS == NULL) {
+            fprintf(stderr, "Errore fit_file: la modalità esatta richiede '%s' in double (dtype %u)\n",
+                    filename, fs.dtype);
+            ret = -1;
+        }
+    } else if (ret == 0 && mapped_only) {
+        if (input->DS == NULL && input->DS_half == NULL) {
+            fprintf(stderr, "Errore fit_file: '%s' non mappabile per l'indice %s (dtype %u)\n", filename,
+                    input->mode == MODE_PQ ? "PQ" : input->mode == MODE_HNSW ? "HNSW" : "VP-tree", fs.dtype);
+            ret = -1;
+        } else if (input->mode == MODE_PQ) {
+            fit_pq(input);
+        } else if (input->mode == MODE_HNSW) {
+            fit_hnsw(input);
+        } else {
+            ret = fit_vpt(input);
+        }
+    }
+
+    // cascata, proiezione e codici int8 finché i vettori sono mappati (open_disk_dataset() li smappa)
+    if (ret == 0 && !mapped_only && (input->DS != NULL || input->DS_half != NULL)) {
+        if (input->levels > 0) ret = cascade_build(input);
+        if (ret == 0 && input->proj_mode != PROJ_OFF) ret = proj_train(input);
+        if (ret == 0 && input->sq_mode != SQ_OFF) ret = sq_train(input);
+    }
+
+    if (fs.buf != fs.raw) _mm_free(fs.buf);
+    _mm_free(fs.raw);
+    close(fs.fd);
+    return ret;
+}
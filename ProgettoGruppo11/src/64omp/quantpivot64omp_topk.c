@@ -0,0 +1,179 @@
+/*
+ *  Selezione dei k migliori (top-k)
+ *
+ *  Una lista topk_t tiene i k elementi (distanza, ID) migliori visti finora
+ *  negli array del chiamante. L'ordine è lessicografico: distanza
+ *  crescente, a parità di distanza l'ID minore. Il risultato quindi non
+ *  dipende dall'ordine di inserimento né dalla struttura usata.
+ *
+ *  La struttura si sceglie in base a k:
+ *  - k < TOPK_HEAP_MIN: array ordinato. La posizione di inserimento si
+ *    trova senza salti contando con confronti SIMD gli elementi minori,
+ *    poi un memmove sposta la coda. Per k piccolo costa pochi cicli.
+ *  - k >= TOPK_HEAP_MIN: max-heap binario con la peggiore in radice.
+ *    L'inserimento costa O(log k) invece di O(k).
+ *  In entrambi i casi topk_bound() restituisce la soglia da battere in O(1)
+ *  e topk_finish() produce la lista ordinata in O(k log k) (heapsort).
+ */
+
+#define TOPK_HEAP_MIN   64      // da questo k in su si usa lo heap
+
+
+typedef struct {
+    ID* ids;
+    type* dists;
+    int k;                      // capacità
+    int n;                      // elementi presenti
+    int heap;                   // 1: max-heap, 0: array ordinato
+} topk_t;
+
+
+// Confronto tra ID per qsort (ordine crescente)
+static int cmp_id(const void* a, const void* b) {
+    ID x = *(const ID*)a, y = *(const ID*)b;
+    return (x > y) - (x < y);
+}
+
+// (da, ia) precede (db, ib)?
+static inline int topk_less(type da, ID ia, type db, ID ib) {
+    return da < db || (da == db && ia < ib);
+}
+
+// TOPK_INIT - Lista vuota di capacità k sugli array ids/dists [k]
+static inline void topk_init(topk_t* t, ID* ids, type* dists, int k) {
+    t->ids = ids;
+    t->dists = dists;
+    t->k = k;
+    t->n = 0;
+    t->heap = k >= TOPK_HEAP_MIN;
+}
+
+// TOPK_BOUND - Distanza da battere (INFINITY finché la lista non è piena)
+static inline type topk_bound(const topk_t* t) {
+    if (t->n < t->k) return INFINITY;
+    return t->heap ? t->dists[0] : t->dists[t->k - 1];
+}
+
+
+// Numero di elementi di dists[0..n) strettamente minori di d (senza salti)
+static inline int count_less(const type* dists, int n, type d) {
+    int c = 0, i = 0;
+#if defined(__AVX512F__)
+    __m512d dv = _mm512_set1_pd(d);
+    for (; i + 8 <= n; i += 8)
+        c += __builtin_popcount(_mm512_cmp_pd_mask(_mm512_loadu_pd(&dists[i]), dv, _CMP_LT_OQ));
+#elif defined(__AVX__)
+    __m256d dv = _mm256_set1_pd(d);
+    for (; i + 4 <= n; i += 4)
+        c += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(&dists[i]), dv, _CMP_LT_OQ)));
+#endif
+    for (; i < n; i++) c += dists[i] < d;
+    return c;
+}
+
+// Ripristina lo heap scendendo dalla posizione i (n elementi)
+static inline void topk_sift_down(ID* ids, type* dists, int n, int i) {
+    type d = dists[i];
+    ID id = ids[i];
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= n) break;
+        if (c + 1 < n && topk_less(dists[c], ids[c], dists[c + 1], ids[c + 1])) c++;
+        if (!topk_less(d, id, dists[c], ids[c])) break;
+        dists[i] = dists[c];
+        ids[i] = ids[c];
+        i = c;
+    }
+    dists[i] = d;
+    ids[i] = id;
+}
+
+
+// TOPK_PUSH - Inserisce (d, id) se migliore del peggiore della lista piena
+static inline void topk_push(topk_t* t, type d, ID id) {
+    int k = t->k;
+    ID* ids = t->ids;
+    type* dists = t->dists;
+
+    if (t->heap) {
+        if (t->n < k) {
+            // risalita verso la radice (max-heap)
+            int i = t->n++;
+            while (i > 0) {
+                int p = (i - 1) / 2;
+                if (!topk_less(dists[p], ids[p], d, id)) break;
+                dists[i] = dists[p];
+                ids[i] = ids[p];
+                i = p;
+            }
+            dists[i] = d;
+            ids[i] = id;
+        } else if (topk_less(d, id, dists[0], ids[0])) {
+            dists[0] = d;
+            ids[0] = id;
+            topk_sift_down(ids, dists, k, 0);
+        }
+        return;
+    }
+
+    int n = t->n;
+    if (n == k && !topk_less(d, id, dists[k - 1], ids[k - 1])) return;
+    int pos = count_less(dists, n, d);
+    while (pos < n && dists[pos] == d && ids[pos] < id) pos++;
+    int tail = (n < k ? n : k - 1) - pos;
+    memmove(&dists[pos + 1], &dists[pos], tail * sizeof(type));
+    memmove(&ids[pos + 1], &ids[pos], tail * sizeof(ID));
+    dists[pos] = d;
+    ids[pos] = id;
+    if (n < k) t->n++;
+}
+
+
+// Heapsort crescente di n elementi (O(n log n), in place)
+static void topk_heapsort(ID* ids, type* dists, int n) {
+    for (int i = n / 2 - 1; i >= 0; i--) topk_sift_down(ids, dists, n, i);
+    for (int end = n - 1; end > 0; end--) {
+        type d = dists[0];
+        ID id = ids[0];
+        dists[0] = dists[end];
+        ids[0] = ids[end];
+        dists[end] = d;
+        ids[end] = id;
+        topk_sift_down(ids, dists, end, 0);
+    }
+}
+
+
+// TOPK_FINISH - Lista ordinata crescente in ids/dists; posizioni vuote: -1 / INFINITY
+static void topk_finish(topk_t* t) {
+    if (t->heap) {
+        topk_heapsort(t->ids, t->dists, t->n);
+        t->heap = 0;            // da qui in poi è un array ordinato
+    }
+    for (int i = t->n; i < t->k; i++) {
+        t->ids[i] = -1;
+        t->dists[i] = INFINITY;
+    }
+}
+
+
+// SORT_KNN - Riordina k risultati (es. dopo il ricalcolo delle distanze):
+// inserimento per k piccolo, heapsort altrimenti
+static void sort_knn(ID* knn_ids, type* knn_dists, int k) {
+    if (k >= TOPK_HEAP_MIN) {
+        topk_heapsort(knn_ids, knn_dists, k);
+        return;
+    }
+    for (int i = 1; i < k; i++) {
+        type d = knn_dists[i];
+        ID id = knn_ids[i];
+        int j = i;
+        while (j > 0 && topk_less(d, id, knn_dists[j - 1], knn_ids[j - 1])) {
+            knn_dists[j] = knn_dists[j - 1];
+            knn_ids[j] = knn_ids[j - 1];
+            j--;
+        }
+        knn_dists[j] = d;
+        knn_ids[j] = id;
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ *  Auto-tuning di h, x e profondità di rerank
+ *
+ *  autotune() prova una griglia di configurazioni (h, x, r) su un
+ *  sottocampione del dataset e su un campione di query, confrontando i
+ *  risultati con i K-NN esatti calcolati dal motore GEMM (knn_exact) sullo
+ *  stesso sottocampione. Per ogni (h, x) l'indice viene costruito una volta e
+ *  interrogato con tutti gli r della griglia.
+ *
+ *  Obiettivi:
+ *  - TUNE_RECALL:  la configurazione più veloce con recall@k >= target
+ *                  (se nessuna lo raggiunge, quella con recall massimo)
+ *  - TUNE_LATENCY: la configurazione con recall@k massimo entro target
+ *                  secondi per query (se nessuna ci sta, la più veloce)
+ *
+ *  La latenza è il tempo di predict() sul campione diviso per il numero di
+ *  query (tutti i thread attivi, come in produzione).
+ */
+
+#define TUNE_RECALL     0
+#define TUNE_LATENCY    1
+
+#define TUNE_ROWS       50000       // righe del sottocampione di default
+
+typedef struct {
+    int h;                      // numero di pivot
+    int x;                      // parametro di quantizzazione
+    int r;                      // candidati raffinati per query
+    double recall;              // recall@k medio sul campione
+    double latency;             // secondi per query
+} qp_tuning;
+
+static const int tune_h[] = {4, 8, 16, 32, 64};
+static const int tune_x[] = {1, 2, 4, 8, 16, 32};
+static const int tune_r[] = {1, 2, 4, 8};          // multipli di k
+
+
+// Frazione dei K-NN esatti ritrovati
+static double recall_at_k(const ID* exact, const ID* approx, int64_t nq, int k) {
+    int64_t hits = 0;
+    for (int64_t qi = 0; qi < nq; qi++)
+        for (int i = 0; i < k; i++)
+            for (int j = 0; j < k; j++)
+                if (approx[qi * k + i] == exact[qi * k + j] && exact[qi * k + j] >= 0) {
+                    hits++;
+                    break;
+                }
+    return (double)hits / (nq * k);
+}
+
+// Vero se a è preferibile a b per l'obiettivo dato
+static int tune_better(const qp_tuning* a, const qp_tuning* b, int target_kind, double target) {
+    if (target_kind == TUNE_RECALL) {
+        int ok_a = a->recall >= target, ok_b = b->recall >= target;
+        if (ok_a != ok_b) return ok_a;
+        return ok_a ? a->latency < b->latency : a->recall > b->recall;
+    }
+    int ok_a = a->latency <= target, ok_b = b->latency <= target;
+    if (ok_a != ok_b) return ok_a;
+    return ok_a ? a->recall > b->recall : a->latency < b->latency;
+}
+
+
+/*
+ *  AUTOTUNE - Sceglie h, x e r per input->DS con le query Qs[nqs x D]
+ *
+ *  max_rows limita il sottocampione del dataset (<= 0: TUNE_ROWS).
+ *  La configurazione scelta viene scritta in *best e applicata a input
+ *  (h, x, r): l'indice va poi ricostruito con fit().
+ *  Restituisce 0 se ok, -1 se i parametri non sono validi.
+ */
+int autotune(params* input, const type* Qs, int64_t nqs, int k,
+             int target_kind, double target, int64_t max_rows, qp_tuning* best) {
+    if (input->DS == NULL || nqs <= 0 || k <= 0) {
+        fprintf(stderr, "Errore autotune: servono dataset in memoria, query e k > 0\n");
+        return -1;
+    }
+
+    int64_t D = input->D;
+    int64_t n = max_rows > 0 ? max_rows : TUNE_ROWS;
+    if (n > input->N) n = input->N;
+    if (k > n) {
+        fprintf(stderr, "Errore autotune: k=%d maggiore del sottocampione (%ld righe)\n", k, n);
+        return -1;
+    }
+
+    // Sottocampione del dataset (copia contigua, righe in ordine)
+    type* sub = input->DS;
+    if (n < input->N) {
+        uint64_t state = input->seed;
+        int64_t* rows = malloc(n * sizeof(int64_t));
+        sub = _mm_malloc(n * D * sizeof(type), align);
+        if (!rows || !sub) {
+            fprintf(stderr, "Errore allocazione in autotune\n");
+            exit(1);
+        }
+        sample_rows(input->N, n, &state, rows);
+        #pragma omp parallel for schedule(static)
+        for (int64_t i = 0; i < n; i++)
+            memcpy(&sub[i * D], &input->DS[rows[i] * D], D * sizeof(type));
+        free(rows);
+    }
+
+    ID* exact = malloc(nqs * k * sizeof(ID));
+    type* exact_dists = malloc(nqs * k * sizeof(type));
+    if (!exact || !exact_dists) {
+        fprintf(stderr, "Errore allocazione in autotune\n");
+        exit(1);
+    }
+    double t = omp_get_wtime();
+    knn_exact(sub, sub == input->DS ? input->norms : NULL, n, D, Qs, nqs, k, exact, exact_dists);
+    t = omp_get_wtime() - t;
+    free(exact_dists);
+
+    if (!input->silent) {
+        printf("[TUNE] Sottocampione %ld x %ld, %ld query, k=%d\n", n, D, nqs, k);
+        printf("[TUNE] Baseline esatta: %.3e s/query\n", t / nqs);
+        printf("[TUNE]    h    x    r   recall   s/query\n");
+    }
+
+    // Indice temporaneo sul sottocampione
+    params tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.DS = sub;
+    tmp.N = n;
+    tmp.D = D;
+    tmp.Q = (MATRIX)Qs;
+    tmp.nq = nqs;
+    tmp.k = k;
+    tmp.silent = 1;
+    tmp.ds_fd = -1;
+    tmp.plan = input->plan;
+    tmp.pivot_strategy = input->pivot_strategy;
+    tmp.seed = input->seed;
+    tmp.id_nn = _mm_malloc(nqs * k * sizeof(ID), align);
+    tmp.dist_nn = _mm_malloc(nqs * k * sizeof(type), align);
+    if (!tmp.id_nn || !tmp.dist_nn) {
+        fprintf(stderr, "Errore allocazione in autotune\n");
+        exit(1);
+    }
+
+    int found = 0;
+    for (size_t hi = 0; hi < sizeof(tune_h) / sizeof(tune_h[0]); hi++) {
+        if (tune_h[hi] > n) break;
+        for (size_t xi = 0; xi < sizeof(tune_x) / sizeof(tune_x[0]); xi++) {
+            if (tune_x[xi] > D) break;
+
+            tmp.h = tune_h[hi];
+            tmp.x = tune_x[xi];
+            tmp.r = 0;
+            fit(&tmp);
+
+            for (size_t ri = 0; ri < sizeof(tune_r) / sizeof(tune_r[0]); ri++) {
+                qp_tuning c;
+                c.h = tmp.h;
+                c.x = tmp.x;
+                c.r = tmp.r = tune_r[ri] * k;
+                if (c.r > n) break;
+
+                t = omp_get_wtime();
+                predict(&tmp);
+                c.latency = (omp_get_wtime() - t) / nqs;
+                c.recall = recall_at_k(exact, tmp.id_nn, nqs, k);
+
+                if (!input->silent)
+                    printf("[TUNE] %4d %4d %4d   %.4f   %.3e\n", c.h, c.x, c.r, c.recall, c.latency);
+                if (!found || tune_better(&c, best, target_kind, target)) {
+                    *best = c;
+                    found = 1;
+                }
+            }
+            release_index(&tmp);
+        }
+    }
+
+    _mm_free(tmp.id_nn);
+    _mm_free(tmp.dist_nn);
+    free(exact);
+    if (sub != input->DS) _mm_free(sub);
+
+    if (!found) {
+        fprintf(stderr, "Errore autotune: nessuna configurazione valida\n");
+        return -1;
+    }
+
+    input->h = best->h;
+    input->x = best->x;
+    input->r = best->r;
+
+    if (!input->silent)
+        printf("[TUNE] Scelta: h=%d, x=%d, r=%d (recall %.4f, %.3e s/query)\n",
+               best->h, best->x, best->r, best->recall, best->latency);
+    return 0;
+}
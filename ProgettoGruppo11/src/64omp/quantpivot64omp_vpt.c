@@ -0,0 +1,358 @@
+/*
+ *  Motore VP-tree: pivot locali in una gerarchia
+ *
+ *  La tabella [N x h] usa gli stessi h pivot per tutte le righe, quindi il
+ *  bound è debole lontano da tutti i pivot. Con mode = MODE_VPT fit()
+ *  costruisce un albero di punti di vantaggio: ogni nodo interno sceglie un
+ *  pivot nel proprio sottoinsieme e lo divide alla mediana della distanza
+ *  (figlio 0: vicini, figlio 1: lontani), fino a foglie di al più vpt_leaf
+ *  righe. Ogni riga conserva le distanze euclidee dai suoi h antenati più
+ *  vicini (pivot locali) in vpt_table, nell'ordine delle foglie.
+ *
+ *  predict() visita i nodi best-first, in ordine di lower bound, con lo
+ *  stesso bound triangolare della scansione: |d(q,p) - d(x,p)| per il nodo
+ *  (intervallo [lo, hi] delle distanze da p nel figlio) e max_j sugli h
+ *  antenati per le righe delle foglie. Nodi e righe con bound oltre il
+ *  k-esimo vicino sono scartati: il risultato è esatto rispetto alle
+ *  distanze del raffinamento (DS o DS_half).
+ *
+ *  I nodi sono in ordine di visita in ampiezza (i figli di un nodo sono
+ *  adiacenti, i livelli alti stanno in poche linee di cache); le righe di
+ *  ogni foglia e le loro distanze dagli antenati sono contigue.
+ */
+
+#define VPT_LEAF_DEFAULT    32      // righe per foglia predefinite
+
+
+// Distanza e ID di una riga durante la divisione di un nodo
+typedef struct {
+    type d;
+    ID id;
+} vpt_pair;
+
+static int cmp_vpt_pair(const void* a, const void* b) {
+    const vpt_pair* x = a;
+    const vpt_pair* y = b;
+    if (x->d != y->d) return x->d < y->d ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+
+/*
+ *  VPT_SPLIT - Divide il nodo t (righe perm[first, first+n)): pivot = riga
+ *  più lontana da una riga casuale, le altre ordinate per distanza dal
+ *  pivot. anc [N x h] riceve la distanza nella colonna depth % h; pairs e d
+ *  hanno almeno n posti, buf D.
+ */
+static void vpt_split(params* input, int64_t t, ID* perm, type* anc, vpt_pair* pairs, type* d,
+                      type* buf) {
+    vpt_node* node = &input->vpt_nodes[t];
+    int64_t s = node->first, n = node->n;
+    int h = input->h;
+    uint64_t state = input->seed ^ ((uint64_t)(t + 1) * 0x9e3779b97f4a7c15ULL);
+
+    // pivot: il punto più lontano da una riga a caso (vicino al bordo del sottoinsieme)
+    ID a = perm[s + (int64_t)(rand_unit(&state) * n) % n];
+    hnsw_dists(input, dataset_row(input, a, buf), &perm[s], n, d);
+    int64_t far = 0;
+    for (int64_t i = 1; i < n; i++)
+        if (d[i] > d[far]) far = i;
+    ID vp = perm[s + far];
+    perm[s + far] = perm[s];
+    perm[s] = vp;
+
+    hnsw_dists(input, dataset_row(input, vp, buf), &perm[s + 1], n - 1, d);
+    for (int64_t i = 0; i < n - 1; i++) {
+        pairs[i].d = sqrt(d[i]);
+        pairs[i].id = perm[s + 1 + i];
+    }
+    qsort(pairs, n - 1, sizeof(vpt_pair), cmp_vpt_pair);
+    for (int64_t i = 0; i < n - 1; i++) {
+        perm[s + 1 + i] = pairs[i].id;
+        if (h > 0) anc[(int64_t)pairs[i].id * h + node->depth % h] = pairs[i].d;
+    }
+
+    int64_t mid = (n - 1) / 2;
+    node->vp = vp;
+    node->lo[0] = pairs[0].d;
+    node->hi[0] = pairs[mid - 1].d;
+    node->lo[1] = pairs[mid].d;
+    node->hi[1] = pairs[n - 2].d;
+}
+
+
+/*
+ *  FIT_VPT - Costruisce l'albero su DS (o DS_half), un livello alla volta:
+ *  i nodi di un livello si dividono in parallelo, poi i loro figli vengono
+ *  accodati in ordine. Restituisce 0 se ok, -1 in caso di errore.
+ */
+int fit_vpt(params* input) {
+    int64_t N = input->N;
+    int h = input->h > 0 ? input->h : 0;
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore fit_vpt: dataset in memoria non disponibile\n");
+        return -1;
+    }
+    if (N > ID_MAX) {
+        fprintf(stderr, "Errore: N=%ld non rappresentabile negli ID, ricompilare con -DID64\n", N);
+        return -1;
+    }
+    if (input->vpt_leaf <= 0) input->vpt_leaf = VPT_LEAF_DEFAULT;
+    if (input->vpt_leaf < 2) input->vpt_leaf = 2;
+    int64_t leaf = input->vpt_leaf;
+    double t_fit = omp_get_wtime();
+
+    ID* perm = _mm_malloc(N * sizeof(ID), align);
+    type* anc = calloc(N * (h > 0 ? h : 1), sizeof(type));
+    int64_t cap = 2 * (N / leaf + 1) + 1;
+    vpt_node* nodes = malloc(cap * sizeof(vpt_node));
+    if (!perm || !anc || !nodes) {
+        fprintf(stderr, "Errore allocazione in fit_vpt\n");
+        exit(1);
+    }
+    for (int64_t i = 0; i < N; i++) perm[i] = i;
+    nodes[0] = (vpt_node){ .vp = -1, .depth = 0, .parent = -1, .first = 0, .n = N };
+    int64_t nnodes = 1;
+    int depth = 0;
+
+    for (int64_t lv0 = 0, lv1 = 1; lv0 < lv1; lv0 = lv1, lv1 = nnodes) {
+        input->vpt_nodes = nodes;
+
+        #pragma omp parallel
+        {
+            vpt_pair* pairs = NULL;
+            type* d = NULL;
+            int64_t room = 0;
+            type* buf = malloc(input->D * sizeof(type));
+
+            #pragma omp for schedule(dynamic)
+            for (int64_t t = lv0; t < lv1; t++) {
+                int64_t n = nodes[t].n;
+                if (n <= leaf) continue;
+                if (n > room) {
+                    room = n;
+                    pairs = realloc(pairs, room * sizeof(vpt_pair));
+                    d = realloc(d, room * sizeof(type));
+                    if (!pairs || !d) {
+                        fprintf(stderr, "Errore allocazione in fit_vpt\n");
+                        exit(1);
+                    }
+                }
+                vpt_split(input, t, perm, anc, pairs, d, buf);
+            }
+            free(pairs);
+            free(d);
+            free(buf);
+        }
+
+        // figli del livello in ordine: 0 = righe vicine al pivot, 1 = lontane
+        for (int64_t t = lv0; t < lv1; t++) {
+            if (nodes[t].n <= leaf) continue;
+            if (nnodes + 2 > cap) {
+                cap *= 2;
+                nodes = realloc(nodes, cap * sizeof(vpt_node));
+                if (!nodes) {
+                    fprintf(stderr, "Errore allocazione in fit_vpt\n");
+                    exit(1);
+                }
+            }
+            int64_t s = nodes[t].first + 1, mid = (nodes[t].n - 1) / 2;
+            nodes[nnodes] = (vpt_node){ .vp = -1, .depth = nodes[t].depth + 1, .parent = t,
+                                        .first = s, .n = mid };
+            nodes[nnodes + 1] = (vpt_node){ .vp = -1, .depth = nodes[t].depth + 1, .parent = t,
+                                            .first = s + mid, .n = nodes[t].n - 1 - mid };
+            nodes[t].first = nnodes;
+            nodes[t].n = 0;
+            nnodes += 2;
+        }
+        if (lv1 < nnodes) depth++;
+    }
+
+    // distanze di ogni riga dagli antenati, nell'ordine delle foglie: colonna j = antenato j+1 livelli sopra
+    type* table = _mm_malloc(N * (h > 0 ? h : 1) * sizeof(type), align);
+    if (!table) {
+        fprintf(stderr, "Errore allocazione in fit_vpt\n");
+        exit(1);
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int64_t t = 0; t < nnodes; t++) {
+        if (nodes[t].vp >= 0) continue;
+        for (int64_t p = nodes[t].first; p < nodes[t].first + nodes[t].n; p++)
+            for (int j = 0; j < h; j++) {
+                int a = nodes[t].depth - 1 - j;
+                table[p * h + j] = a >= 0 ? anc[(int64_t)perm[p] * h + a % h] : 0.0;
+            }
+    }
+    free(anc);
+
+    input->vpt_nodes = nodes;
+    input->vpt_nnodes = nnodes;
+    input->vpt_ids = perm;
+    input->vpt_table = table;
+
+    if (!input->silent)
+        printf("[FIT] VP-tree: %ld nodi, profondità %d, foglie di al più %ld righe, "
+               "%d antenati per riga, %.3f s\n", nnodes, depth + 1, leaf, h, omp_get_wtime() - t_fit);
+    return 0;
+}
+
+
+// Min-heap dei nodi da visitare per lower bound crescente
+typedef struct {
+    type* b;
+    int64_t* t;
+    int n, cap;
+} vpt_queue;
+
+static inline void vpt_queue_push(vpt_queue* h, type b, int64_t t) {
+    if (h->n == h->cap) {
+        h->cap = h->cap ? 2 * h->cap : 64;
+        h->b = realloc(h->b, h->cap * sizeof(type));
+        h->t = realloc(h->t, h->cap * sizeof(int64_t));
+        if (!h->b || !h->t) {
+            fprintf(stderr, "Errore allocazione in vpt_queue_push\n");
+            exit(1);
+        }
+    }
+    int i = h->n++;
+    while (i > 0 && h->b[(i - 1) / 2] > b) {
+        h->b[i] = h->b[(i - 1) / 2];
+        h->t[i] = h->t[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->b[i] = b;
+    h->t[i] = t;
+}
+
+static inline void vpt_queue_pop(vpt_queue* h) {
+    type b = h->b[--h->n];
+    int64_t t = h->t[h->n];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= h->n) break;
+        if (c + 1 < h->n && h->b[c + 1] < h->b[c]) c++;
+        if (h->b[c] >= b) break;
+        h->b[i] = h->b[c];
+        h->t[i] = h->t[c];
+        i = c;
+    }
+    h->b[i] = b;
+    h->t[i] = t;
+}
+
+
+/*
+ *  VPT_SEARCH - I k vicini di q (distanze al quadrato in top). qd [nnodes]
+ *  riceve d(q, pivot) dei nodi espansi: le foglie la leggono per i loro
+ *  antenati, sempre espansi prima. Restituisce le distanze calcolate.
+ */
+static int64_t vpt_search(const params* input, const type* q, topk_t* top, vpt_queue* queue,
+                          type* qd, type* qa, ID* ids, type* d) {
+    const vpt_node* nodes = input->vpt_nodes;
+    int h = input->h > 0 ? input->h : 0;
+    int64_t computed = 0;
+
+    queue->n = 0;
+    vpt_queue_push(queue, 0.0, 0);
+    while (queue->n > 0) {
+        type b = queue->b[0];
+        int64_t t = queue->t[0];
+        vpt_queue_pop(queue);
+        if (b * b >= topk_bound(top)) break;
+        const vpt_node* node = &nodes[t];
+
+        if (node->vp >= 0) {
+            // il pivot è anche un candidato; bound dei figli da [lo, hi]
+            type dq;
+            hnsw_dists(input, q, &node->vp, 1, &dq);
+            computed++;
+            if (dq < topk_bound(top)) topk_push(top, dq, node->vp);
+            dq = sqrt(dq);
+            qd[t] = dq;
+            for (int c = 0; c < 2; c++) {
+                type lb = b;
+                if (node->lo[c] - dq > lb) lb = node->lo[c] - dq;
+                if (dq - node->hi[c] > lb) lb = dq - node->hi[c];
+                if (lb * lb < topk_bound(top)) vpt_queue_push(queue, lb, node->first + c);
+            }
+            continue;
+        }
+
+        // foglia: distanze della query dagli antenati, poi bound per riga come scan_rows()
+        int na = node->depth < h ? node->depth : h;
+        int64_t a = node->parent;
+        for (int j = 0; j < na; j++, a = nodes[a].parent) qa[j] = qd[a];
+        type bound = topk_bound(top);
+        int m = 0;
+        for (int64_t p = node->first; p < node->first + node->n; p++) {
+            const type* row = &input->vpt_table[p * h];
+            type max_bound = 0.0;
+            for (int j = 0; j < na; j++) {
+                type lb = fabs(row[j] - qa[j]);
+                if (lb > max_bound) max_bound = lb;
+            }
+            if (max_bound * max_bound < bound) ids[m++] = input->vpt_ids[p];
+        }
+        hnsw_dists(input, q, ids, m, d);
+        computed += m;
+        for (int i = 0; i < m; i++)
+            if (d[i] < topk_bound(top)) topk_push(top, d[i], ids[i]);
+    }
+    return computed;
+}
+
+
+// PREDICT_VPT - Modalità VP-tree di predict(): ricerca best-first esatta per ogni query
+void predict_vpt(params* input) {
+    if (input->vpt_nodes == NULL) {
+        fprintf(stderr, "Errore: VP-tree non costruito, chiamare fit() con mode = MODE_VPT\n");
+        exit(1);
+    }
+    if (input->DS == NULL && input->DS_half == NULL) {
+        fprintf(stderr, "Errore: la modalità VP-tree richiede il dataset in memoria\n");
+        exit(1);
+    }
+    int k = input->k;
+    int64_t computed = 0;
+
+    #pragma omp parallel reduction(+:computed)
+    {
+        vpt_queue queue = { NULL, NULL, 0, 0 };
+        type* qd = malloc(input->vpt_nnodes * sizeof(type));
+        type* qa = malloc((input->h > 0 ? input->h : 1) * sizeof(type));
+        ID* ids = malloc(input->vpt_leaf * sizeof(ID));
+        type* d = malloc(input->vpt_leaf * sizeof(type));
+        ID* top_ids = malloc(k * sizeof(ID));
+        type* top_d = malloc(k * sizeof(type));
+        if (!qd || !qa || !ids || !d || !top_ids || !top_d) {
+            fprintf(stderr, "Errore allocazione in predict_vpt\n");
+            exit(1);
+        }
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t qi = 0; qi < input->nq; qi++) {
+            topk_t top;
+            topk_init(&top, top_ids, top_d, k);
+            computed += vpt_search(input, &input->Q[qi * input->D], &top, &queue, qd, qa, ids, d);
+            topk_finish(&top);
+            for (int i = 0; i < k; i++) {
+                input->id_nn[qi * k + i] = i < top.n ? top_ids[i] : -1;
+                input->dist_nn[qi * k + i] = i < top.n ? sqrt(top_d[i]) : INFINITY;
+            }
+        }
+
+        free(queue.b);
+        free(queue.t);
+        free(qd);
+        free(qa);
+        free(ids);
+        free(d);
+        free(top_ids);
+        free(top_d);
+    }
+
+    memset(&input->stats, 0, sizeof(input->stats));
+    input->stats.rows_scanned = input->nq * input->N;
+    input->stats.rows_pruned = input->stats.rows_scanned - computed;
+}
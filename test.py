@@ -10,6 +10,7 @@ import numpy.random
 import struct
 import pyfftw
 from pathlib import Path
+from gruppo11.ds3 import load_ds3
 
 def load_ds2(filename, dtype, alignment):
     with open(filename, 'rb') as f:
@@ -43,8 +44,11 @@ def load_file(file_name, dtype, alignment, delimiter=','):
     path = Path(file_name)
     name = path.stem
     ext = path.suffix
-    if ext.lower() not in ['.csv', '.ds2']:
+    if ext.lower() not in ['.csv', '.ds2', '.ds3']:
         raise("Formato file non riconosciuto")
+    if ext == ".ds3":
+        # mappato senza copia se il dtype coincide, altrimenti convertito
+        return load_ds3(file_name, dtype)
     if ext == ".csv":
         if not Path(f"{name}.ds2").is_file():
             csv_to_ds2(file_name, dtype)
@@ -56,8 +60,8 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='Test del progetto QuantPivot')
 
     # Definizione dei parametri
-    parser.add_argument('DS', help='nome file dataset (csv o ds2)')
-    parser.add_argument('Q', help='nome file query (csv o ds2)')
+    parser.add_argument('DS', help='nome file dataset (csv, ds2 o ds3)')
+    parser.add_argument('Q', help='nome file query (csv, ds2 o ds3)')
     parser.add_argument('h', type=int, help='numero di pivot')
     parser.add_argument('k', type=int, help='numero di vicini')
     parser.add_argument('x', type=int, help='parametro di quantizzazione')
@@ -76,8 +80,8 @@ if __name__ == "__main__":
         sys.exit(1)
 
     ds_path = Path(args.DS)
-    if ds_path.suffix.lower() not in ['.csv', '.ds2']:
-        print(f"Errore: Il file {args.DS} deve avere estensione .csv o .ds2")
+    if ds_path.suffix.lower() not in ['.csv', '.ds2', '.ds3']:
+        print(f"Errore: Il file {args.DS} deve avere estensione .csv, .ds2 o .ds3")
         sys.exit(1)
 
     # Validazione file Q
@@ -86,8 +90,8 @@ if __name__ == "__main__":
         sys.exit(1)
 
     q_path = Path(args.Q)
-    if q_path.suffix.lower() not in ['.csv', '.ds2']:
-        print(f"Errore: Il file {args.Q} deve avere estensione .csv o .ds2")
+    if q_path.suffix.lower() not in ['.csv', '.ds2', '.ds3']:
+        print(f"Errore: Il file {args.Q} deve avere estensione .csv, .ds2 o .ds3")
         sys.exit(1)
 
     # Validazione parametri numerici